@@ -15,6 +15,7 @@ app_t *app_create(app_settings_t *settings, void *disp) {
     app->settings = settings;
     app->main_thread_id = SDL_ThreadID();
     app->running = true;
+    app->dispatch = app_dispatch_create();
     bool client_info_loaded = client_info_load(&app->client_info);
     assert(client_info_loaded);
     app->input_manager = input_manager_create();
@@ -31,6 +32,7 @@ void app_destroy(app_t *app) {
     host_manager_destroy(app->host_manager);
     input_manager_destroy(app->input_manager);
     client_info_clear(&app->client_info);
+    app_dispatch_destroy(app->dispatch);
     free(app);
 }
 
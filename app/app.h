@@ -13,6 +13,7 @@ typedef struct app_ui_t app_ui_t;
 typedef struct stream_manager_t stream_manager_t;
 typedef struct host_manager_t host_manager_t;
 typedef struct input_manager_t input_manager_t;
+typedef struct app_dispatch_t app_dispatch_t;
 
 typedef struct app_t {
     bool running;
@@ -24,6 +25,7 @@ typedef struct app_t {
     host_manager_t *host_manager;
     stream_manager_t *stream_manager;
     input_manager_t *input_manager;
+    app_dispatch_t *dispatch;
 } app_t;
 
 typedef enum app_event_type_t {
@@ -53,8 +55,30 @@ void app_post_event(app_t *app, app_event_type_t type, void *data1, void *data2)
 
 void app_run_on_main(app_t *app, app_run_action_fn action, void *data);
 
+/**
+ * Run action on main thread with a copy of data, so callers don't need to allocate. The copy is only valid during
+ * the action.
+ */
+void app_run_on_main_copy(app_t *app, app_run_action_fn action, const void *data, size_t size);
+
 void app_run_on_main_sync(app_t *app, app_run_action_fn action, void *data);
 
+/**
+ * Like app_run_on_main_sync, but gives up if the main thread doesn't start the action in time. The action is then
+ * never run, so data can be released by the caller.
+ * @return false if timed out
+ */
+bool app_run_on_main_sync_timeout(app_t *app, app_run_action_fn action, void *data, Uint32 timeout_ms);
+
 void app_sdl_input_event(app_t *app, const SDL_Event *event);
 
+app_dispatch_t *app_dispatch_create();
+
+void app_dispatch_destroy(app_dispatch_t *dispatch);
+
+/**
+ * Run actions posted with app_run_on_main. Called on main thread when APP_RUN_ON_MAIN is received.
+ */
+void app_dispatch_run(app_t *app);
+
 void app_assert_main_thread(app_t *app);
\ No newline at end of file
@@ -1,16 +1,136 @@
 #include "app.h"
+#include "app_watchdog.h"
 
-typedef struct bus_blocking_action_t {
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/mpsc_queue.h"
+
+/* Actions queued without allocation. More are kept in the overflow list until the main thread catches up */
+#define APP_DISPATCH_CAPACITY 128
+/* Payloads of app_run_on_main_copy up to this size are stored in the queue, larger ones are allocated */
+#define APP_DISPATCH_INLINE_SIZE 256
+/* Threads that can wait for app_run_on_main_sync at once without allocating */
+#define APP_SYNC_WAITER_POOL_SIZE 4
+
+typedef struct app_dispatch_entry_t {
     app_run_action_fn action;
+    void *data;
+    /* Payload allocated by app_run_on_main_copy, freed after the action */
+    void *heap;
+    max_align_t payload[APP_DISPATCH_INLINE_SIZE / sizeof(max_align_t)];
+} app_dispatch_entry_t;
 
+typedef struct app_dispatch_overflow_t {
+    struct app_dispatch_overflow_t *next;
+    app_dispatch_entry_t entry;
+} app_dispatch_overflow_t;
+
+typedef enum app_sync_state_t {
+    APP_SYNC_PENDING,
+    APP_SYNC_RUNNING,
+    APP_SYNC_DONE,
+    /* Caller gave up waiting before the action started, so it will be skipped */
+    APP_SYNC_CANCELLED,
+} app_sync_state_t;
+
+typedef struct app_sync_waiter_t {
+    SDL_sem *sem;
+    /* Only for waiters from the pool */
+    SDL_atomic_t in_use;
+    bool pooled;
+    SDL_atomic_t state;
+    app_run_action_fn action;
     void *data;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
-    bool done;
-} bus_action_sync_t;
+} app_sync_waiter_t;
+
+struct app_dispatch_t {
+    mpsc_queue_t *queue;
+    app_sync_waiter_t waiters[APP_SYNC_WAITER_POOL_SIZE];
+    /* Set once a wakeup event is pushed, cleared by the main thread before it drains the queue */
+    SDL_atomic_t wakeup_pending;
+    /* Actions posted while the queue was full. Later actions go here too until it's drained, to keep the order */
+    SDL_SpinLock overflow_lock;
+    SDL_atomic_t overflow_count;
+    app_dispatch_overflow_t *overflow_head, *overflow_tail;
+};
+
+static void dispatch_post(app_t *app, app_run_action_fn action, void *data, const void *copy, size_t size);
+
+static void dispatch_fill_entry(app_dispatch_entry_t *entry, app_run_action_fn action, void *data, const void *copy,
+                                size_t size);
+
+static void dispatch_invoke(app_t *app, app_dispatch_entry_t *entry);
+
+static app_sync_waiter_t *sync_waiter_obtain(app_dispatch_t *dispatch);
+
+static void sync_waiter_release(app_sync_waiter_t *waiter);
 
 static void invoke_action_sync(app_t *app, void *data);
 
+app_dispatch_t *app_dispatch_create() {
+    app_dispatch_t *dispatch = calloc(1, sizeof(app_dispatch_t));
+    dispatch->queue = mpsc_queue_create(APP_DISPATCH_CAPACITY, sizeof(app_dispatch_entry_t));
+    for (int i = 0; i < APP_SYNC_WAITER_POOL_SIZE; i++) {
+        dispatch->waiters[i].sem = SDL_CreateSemaphore(0);
+        dispatch->waiters[i].pooled = true;
+    }
+    return dispatch;
+}
+
+void app_dispatch_destroy(app_dispatch_t *dispatch) {
+    // Actions posted after the main loop exited are discarded, like other pending events
+    app_dispatch_entry_t *entry;
+    while ((entry = mpsc_queue_read_begin(dispatch->queue)) != NULL) {
+        free(entry->heap);
+        mpsc_queue_read_end(dispatch->queue);
+    }
+    for (app_dispatch_overflow_t *node = dispatch->overflow_head, *next; node != NULL; node = next) {
+        next = node->next;
+        free(node->entry.heap);
+        free(node);
+    }
+    mpsc_queue_destroy(dispatch->queue);
+    for (int i = 0; i < APP_SYNC_WAITER_POOL_SIZE; i++) {
+        SDL_DestroySemaphore(dispatch->waiters[i].sem);
+    }
+    free(dispatch);
+}
+
+void app_dispatch_run(app_t *app) {
+    app_dispatch_t *dispatch = app->dispatch;
+    SDL_AtomicSet(&dispatch->wakeup_pending, 0);
+    // Actions posted by the actions themselves wait for the next wakeup, so the loop can't be starved
+    for (int i = 0; i < APP_DISPATCH_CAPACITY; i++) {
+        app_dispatch_entry_t *entry = mpsc_queue_read_begin(dispatch->queue);
+        if (entry == NULL) {
+            break;
+        }
+        dispatch_invoke(app, entry);
+        mpsc_queue_read_end(dispatch->queue);
+    }
+    if (mpsc_queue_read_begin(dispatch->queue) != NULL) {
+        if (SDL_AtomicCAS(&dispatch->wakeup_pending, 0, 1)) {
+            app_post_event(app, APP_RUN_ON_MAIN, NULL, NULL);
+        }
+        return;
+    }
+    if (SDL_AtomicGet(&dispatch->overflow_count) == 0) {
+        return;
+    }
+    SDL_AtomicLock(&dispatch->overflow_lock);
+    app_dispatch_overflow_t *node = dispatch->overflow_head;
+    dispatch->overflow_head = dispatch->overflow_tail = NULL;
+    SDL_AtomicSet(&dispatch->overflow_count, 0);
+    SDL_AtomicUnlock(&dispatch->overflow_lock);
+    while (node != NULL) {
+        app_dispatch_overflow_t *next = node->next;
+        dispatch_invoke(app, &node->entry);
+        free(node);
+        node = next;
+    }
+}
+
 void app_post_event(app_t *app, app_event_type_t type, void *data1, void *data2) {
     (void) app;
     SDL_Event event;
@@ -21,34 +141,126 @@ void app_post_event(app_t *app, app_event_type_t type, void *data1, void *data2)
 }
 
 void app_run_on_main(app_t *app, app_run_action_fn action, void *data) {
-    (void) app;
-    app_post_event(app, APP_RUN_ON_MAIN, action, data);
+    dispatch_post(app, action, data, NULL, 0);
+}
+
+void app_run_on_main_copy(app_t *app, app_run_action_fn action, const void *data, size_t size) {
+    dispatch_post(app, action, NULL, data, size);
 }
 
 void app_run_on_main_sync(app_t *app, app_run_action_fn action, void *data) {
-    bus_action_sync_t sync = {
-            .action = action,
-            .data = data,
-            .mutex = SDL_CreateMutex(),
-            .cond = SDL_CreateCond(),
-            .done = false,
-    };
-    app_run_on_main(app, invoke_action_sync, &sync);
-    SDL_LockMutex(sync.mutex);
-    while (!sync.done) {
-        SDL_CondWait(sync.cond, sync.mutex);
-    }
-    SDL_UnlockMutex(sync.mutex);
-    SDL_DestroyMutex(sync.mutex);
-    SDL_DestroyCond(sync.cond);
+    app_run_on_main_sync_timeout(app, action, data, SDL_MUTEX_MAXWAIT);
+}
+
+bool app_run_on_main_sync_timeout(app_t *app, app_run_action_fn action, void *data, Uint32 timeout_ms) {
+    if (SDL_ThreadID() == app->main_thread_id) {
+        // Waiting for the main loop here would never return
+        action(app, data);
+        return true;
+    }
+    app_sync_waiter_t *waiter = sync_waiter_obtain(app->dispatch);
+    waiter->action = action;
+    waiter->data = data;
+    SDL_AtomicSet(&waiter->state, APP_SYNC_PENDING);
+    app_run_on_main(app, invoke_action_sync, waiter);
+    if (SDL_SemWaitTimeout(waiter->sem, timeout_ms) != 0) {
+        if (SDL_AtomicCAS(&waiter->state, APP_SYNC_PENDING, APP_SYNC_CANCELLED)) {
+            // Main thread will release the waiter when it gets to the action
+            return false;
+        }
+        // Action is already running, and still uses data
+        SDL_SemWait(waiter->sem);
+    }
+    sync_waiter_release(waiter);
+    return true;
+}
+
+/**
+ * Queue the action, and wake up the main loop unless a wakeup is already pending.
+ */
+static void dispatch_post(app_t *app, app_run_action_fn action, void *data, const void *copy, size_t size) {
+    app_dispatch_t *dispatch = app->dispatch;
+    app_dispatch_entry_t *entry = NULL;
+    if (SDL_AtomicGet(&dispatch->overflow_count) == 0) {
+        entry = mpsc_queue_write_begin(dispatch->queue);
+    }
+    if (entry != NULL) {
+        dispatch_fill_entry(entry, action, data, copy, size);
+        mpsc_queue_write_commit(dispatch->queue, entry);
+    } else {
+        app_dispatch_overflow_t *node = malloc(sizeof(app_dispatch_overflow_t));
+        node->next = NULL;
+        dispatch_fill_entry(&node->entry, action, data, copy, size);
+        SDL_AtomicLock(&dispatch->overflow_lock);
+        if (dispatch->overflow_tail != NULL) {
+            dispatch->overflow_tail->next = node;
+        } else {
+            dispatch->overflow_head = node;
+        }
+        dispatch->overflow_tail = node;
+        SDL_AtomicAdd(&dispatch->overflow_count, 1);
+        SDL_AtomicUnlock(&dispatch->overflow_lock);
+    }
+    if (SDL_AtomicCAS(&dispatch->wakeup_pending, 0, 1)) {
+        app_post_event(app, APP_RUN_ON_MAIN, NULL, NULL);
+    }
+}
+
+static void dispatch_fill_entry(app_dispatch_entry_t *entry, app_run_action_fn action, void *data, const void *copy,
+                                size_t size) {
+    entry->action = action;
+    entry->heap = NULL;
+    if (copy == NULL) {
+        entry->data = data;
+    } else if (size <= sizeof(entry->payload)) {
+        memcpy(entry->payload, copy, size);
+        entry->data = entry->payload;
+    } else {
+        entry->heap = malloc(size);
+        memcpy(entry->heap, copy, size);
+        entry->data = entry->heap;
+    }
+}
+
+static void dispatch_invoke(app_t *app, app_dispatch_entry_t *entry) {
+    Uint64 begin = SDL_GetPerformanceCounter();
+    entry->action(app, entry->data);
+    app_watchdog_record_action(entry->action, begin);
+    free(entry->heap);
+}
+
+/**
+ * Take a waiter from the pool, or create one if all of them are in use.
+ */
+static app_sync_waiter_t *sync_waiter_obtain(app_dispatch_t *dispatch) {
+    for (int i = 0; i < APP_SYNC_WAITER_POOL_SIZE; i++) {
+        app_sync_waiter_t *waiter = &dispatch->waiters[i];
+        if (SDL_AtomicCAS(&waiter->in_use, 0, 1)) {
+            return waiter;
+        }
+    }
+    app_sync_waiter_t *waiter = calloc(1, sizeof(app_sync_waiter_t));
+    waiter->sem = SDL_CreateSemaphore(0);
+    return waiter;
+}
+
+static void sync_waiter_release(app_sync_waiter_t *waiter) {
+    if (waiter->pooled) {
+        SDL_AtomicSet(&waiter->in_use, 0);
+        return;
+    }
+    SDL_DestroySemaphore(waiter->sem);
+    free(waiter);
 }
 
 static void invoke_action_sync(app_t *app, void *data) {
-    (void) app;
-    bus_action_sync_t *sync = data;
-    SDL_LockMutex(sync->mutex);
-    sync->action(app, sync->data);
-    sync->done = true;
-    SDL_CondSignal(sync->cond);
-    SDL_UnlockMutex(sync->mutex);
-}
\ No newline at end of file
+    app_sync_waiter_t *waiter = data;
+    if (!SDL_AtomicCAS(&waiter->state, APP_SYNC_PENDING, APP_SYNC_RUNNING)) {
+        // Caller timed out
+        sync_waiter_release(waiter);
+        return;
+    }
+    waiter->action(app, waiter->data);
+    SDL_AtomicSet(&waiter->state, APP_SYNC_DONE);
+    SDL_SemPost(waiter->sem);
+}
@@ -0,0 +1,228 @@
+#include "app_watchdog.h"
+
+#include <signal.h>
+#include <string.h>
+
+#include "logging/app_logging.h"
+#include "util/latency_histogram.h"
+
+/* Distinct actions timed separately. Others are only counted in APP_LOOP_PHASE_ACTIONS */
+#define APP_WATCHDOG_MAX_ACTIONS 32
+/* Stalls are logged at most this often, the others are counted */
+#define APP_WATCHDOG_LOG_INTERVAL_MS 1000
+
+typedef struct watchdog_action_t {
+    app_run_action_fn action;
+    latency_histogram_t histogram;
+} watchdog_action_t;
+
+typedef struct watchdog_t {
+    bool enabled;
+    uint32_t threshold_us;
+    Uint64 counter_frequency;
+    Uint64 iteration_begin;
+    Uint64 phase_begin[APP_LOOP_PHASE_COUNT];
+    /* Time spent in each phase this iteration, including nested phases */
+    uint64_t phase_us[APP_LOOP_PHASE_COUNT];
+    bool phase_ran[APP_LOOP_PHASE_COUNT];
+    app_run_action_fn slowest_action;
+    uint32_t slowest_action_us;
+    latency_histogram_t iterations;
+    latency_histogram_t phases[APP_LOOP_PHASE_COUNT];
+    watchdog_action_t actions[APP_WATCHDOG_MAX_ACTIONS];
+    int actions_count;
+    uint32_t stalls, stalls_suppressed;
+    Uint32 last_log_ticks;
+} watchdog_t;
+
+static const char *phase_names[APP_LOOP_PHASE_COUNT] = {
+        [APP_LOOP_PHASE_EVENTS] = "events",
+        [APP_LOOP_PHASE_ACTIONS] = "actions",
+        [APP_LOOP_PHASE_LVGL] = "lvgl",
+        [APP_LOOP_PHASE_PRESENT] = "present",
+};
+
+static watchdog_t watchdog;
+
+static volatile sig_atomic_t dump_requested = 0;
+
+static uint32_t elapsed_us(Uint64 begin, Uint64 end);
+
+static void log_histogram(const char *name, const latency_histogram_t *histogram);
+
+static void log_stall(uint32_t total_us, const uint32_t exclusive_us[APP_LOOP_PHASE_COUNT]);
+
+#ifdef SIGUSR1
+
+static void handle_dump_signal(int sig);
+
+#endif
+
+void app_watchdog_init(uint32_t threshold_ms) {
+    memset(&watchdog, 0, sizeof(watchdog));
+    watchdog.enabled = threshold_ms > 0;
+    watchdog.threshold_us = threshold_ms * 1000;
+    watchdog.counter_frequency = SDL_GetPerformanceFrequency();
+#ifdef SIGUSR1
+    if (watchdog.enabled) {
+        signal(SIGUSR1, handle_dump_signal);
+    }
+#endif
+}
+
+void app_watchdog_deinit() {
+    if (!watchdog.enabled) {
+        return;
+    }
+#ifdef SIGUSR1
+    signal(SIGUSR1, SIG_DFL);
+#endif
+    app_watchdog_dump();
+    watchdog.enabled = false;
+}
+
+void app_watchdog_iteration_begin() {
+    if (!watchdog.enabled) {
+        return;
+    }
+    watchdog.iteration_begin = SDL_GetPerformanceCounter();
+    memset(watchdog.phase_us, 0, sizeof(watchdog.phase_us));
+    memset(watchdog.phase_ran, 0, sizeof(watchdog.phase_ran));
+    watchdog.slowest_action = NULL;
+    watchdog.slowest_action_us = 0;
+}
+
+void app_watchdog_iteration_end() {
+    if (!watchdog.enabled || watchdog.iteration_begin == 0) {
+        return;
+    }
+    uint32_t total_us = elapsed_us(watchdog.iteration_begin, SDL_GetPerformanceCounter());
+    latency_histogram_record(&watchdog.iterations, total_us);
+    // Nested phases are only counted once
+    uint32_t exclusive_us[APP_LOOP_PHASE_COUNT];
+    for (int i = 0; i < APP_LOOP_PHASE_COUNT; i++) {
+        exclusive_us[i] = (uint32_t) watchdog.phase_us[i];
+    }
+    exclusive_us[APP_LOOP_PHASE_EVENTS] -= SDL_min(exclusive_us[APP_LOOP_PHASE_EVENTS],
+                                                   exclusive_us[APP_LOOP_PHASE_ACTIONS]);
+    exclusive_us[APP_LOOP_PHASE_LVGL] -= SDL_min(exclusive_us[APP_LOOP_PHASE_LVGL],
+                                                 exclusive_us[APP_LOOP_PHASE_PRESENT]);
+    for (int i = 0; i < APP_LOOP_PHASE_COUNT; i++) {
+        if (watchdog.phase_ran[i]) {
+            latency_histogram_record(&watchdog.phases[i], exclusive_us[i]);
+        }
+    }
+    if (total_us > watchdog.threshold_us) {
+        watchdog.stalls++;
+        log_stall(total_us, exclusive_us);
+    }
+    watchdog.iteration_begin = 0;
+    if (dump_requested) {
+        dump_requested = 0;
+        app_watchdog_dump();
+    }
+}
+
+void app_watchdog_phase_begin(app_loop_phase_t phase) {
+    if (!watchdog.enabled) {
+        return;
+    }
+    watchdog.phase_begin[phase] = SDL_GetPerformanceCounter();
+}
+
+void app_watchdog_phase_end(app_loop_phase_t phase) {
+    if (!watchdog.enabled) {
+        return;
+    }
+    watchdog.phase_us[phase] += elapsed_us(watchdog.phase_begin[phase], SDL_GetPerformanceCounter());
+    watchdog.phase_ran[phase] = true;
+}
+
+void app_watchdog_record_action(app_run_action_fn action, uint64_t begin) {
+    if (!watchdog.enabled) {
+        return;
+    }
+    uint32_t us = elapsed_us(begin, SDL_GetPerformanceCounter());
+    watchdog.phase_us[APP_LOOP_PHASE_ACTIONS] += us;
+    watchdog.phase_ran[APP_LOOP_PHASE_ACTIONS] = true;
+    if (us >= watchdog.slowest_action_us) {
+        watchdog.slowest_action = action;
+        watchdog.slowest_action_us = us;
+    }
+    watchdog_action_t *entry = NULL;
+    for (int i = 0; i < watchdog.actions_count; i++) {
+        if (watchdog.actions[i].action == action) {
+            entry = &watchdog.actions[i];
+            break;
+        }
+    }
+    if (entry == NULL && watchdog.actions_count < APP_WATCHDOG_MAX_ACTIONS) {
+        entry = &watchdog.actions[watchdog.actions_count++];
+        entry->action = action;
+        latency_histogram_reset(&entry->histogram);
+    }
+    if (entry != NULL) {
+        latency_histogram_record(&entry->histogram, us);
+    }
+}
+
+void app_watchdog_dump() {
+    if (!watchdog.enabled) {
+        return;
+    }
+    app_log_info("Watchdog", "Main loop since last dump: stalls=%u (threshold %u ms)", watchdog.stalls,
+                 watchdog.threshold_us / 1000);
+    log_histogram("iteration", &watchdog.iterations);
+    latency_histogram_reset(&watchdog.iterations);
+    for (int i = 0; i < APP_LOOP_PHASE_COUNT; i++) {
+        log_histogram(phase_names[i], &watchdog.phases[i]);
+        latency_histogram_reset(&watchdog.phases[i]);
+    }
+    for (int i = 0; i < watchdog.actions_count; i++) {
+        char name[32];
+        // Resolve with addr2line, or the symbol map of the binary
+        SDL_snprintf(name, sizeof(name), "action %p", *(void **) &watchdog.actions[i].action);
+        log_histogram(name, &watchdog.actions[i].histogram);
+    }
+    watchdog.actions_count = 0;
+    watchdog.stalls = 0;
+}
+
+static uint32_t elapsed_us(Uint64 begin, Uint64 end) {
+    return (uint32_t) ((end - begin) * 1000000 / watchdog.counter_frequency);
+}
+
+static void log_histogram(const char *name, const latency_histogram_t *histogram) {
+    latency_summary_t summary;
+    latency_histogram_summarize(histogram, &summary);
+    if (summary.count == 0) {
+        return;
+    }
+    app_log_info("Watchdog", "%s: count=%u, avg=%u us, p50=%u us, p95=%u us, p99=%u us, max=%u us", name,
+                 summary.count, summary.avg_us, summary.p50_us, summary.p95_us, summary.p99_us, summary.max_us);
+}
+
+static void log_stall(uint32_t total_us, const uint32_t exclusive_us[APP_LOOP_PHASE_COUNT]) {
+    Uint32 now = SDL_GetTicks();
+    if (watchdog.last_log_ticks != 0 && now - watchdog.last_log_ticks < APP_WATCHDOG_LOG_INTERVAL_MS) {
+        watchdog.stalls_suppressed++;
+        return;
+    }
+    watchdog.last_log_ticks = now;
+    app_log_warn("Watchdog", "Main loop stalled for %u ms: events=%u ms, actions=%u ms (slowest %p, %u ms), "
+                             "lvgl=%u ms, present=%u ms, %u stalls not logged before", total_us / 1000,
+                 exclusive_us[APP_LOOP_PHASE_EVENTS] / 1000, exclusive_us[APP_LOOP_PHASE_ACTIONS] / 1000,
+                 *(void **) &watchdog.slowest_action, watchdog.slowest_action_us / 1000,
+                 exclusive_us[APP_LOOP_PHASE_LVGL] / 1000, exclusive_us[APP_LOOP_PHASE_PRESENT] / 1000,
+                 watchdog.stalls_suppressed);
+    watchdog.stalls_suppressed = 0;
+}
+
+#ifdef SIGUSR1
+
+static void handle_dump_signal(int sig) {
+    (void) sig;
+    dump_requested = 1;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "app.h"
+
+/**
+ * Times each phase of the main loop, and logs a breakdown of iterations slower than a threshold. Durations are also
+ * kept in histograms, logged by app_watchdog_dump. Only called from main thread.
+ */
+typedef enum app_loop_phase_t {
+    /** Handling SDL events, except waiting for them */
+    APP_LOOP_PHASE_EVENTS,
+    /** Actions posted with app_run_on_main, while handling events */
+    APP_LOOP_PHASE_ACTIONS,
+    /** lv_task_handler */
+    APP_LOOP_PHASE_LVGL,
+    /** Presenting the UI, while in lv_task_handler */
+    APP_LOOP_PHASE_PRESENT,
+    APP_LOOP_PHASE_COUNT,
+} app_loop_phase_t;
+
+/**
+ * @param threshold_ms Log iterations taking longer than this. 0 disables the watchdog
+ */
+void app_watchdog_init(uint32_t threshold_ms);
+
+/**
+ * Dump histograms collected since the last dump.
+ */
+void app_watchdog_deinit();
+
+/**
+ * Called when the main loop wakes up.
+ */
+void app_watchdog_iteration_begin();
+
+/**
+ * Called before the main loop waits for events again.
+ */
+void app_watchdog_iteration_end();
+
+void app_watchdog_phase_begin(app_loop_phase_t phase);
+
+void app_watchdog_phase_end(app_loop_phase_t phase);
+
+/**
+ * Record an action run by the dispatcher.
+ * @param begin Performance counter when the action started
+ */
+void app_watchdog_record_action(app_run_action_fn action, uint64_t begin);
+
+/**
+ * Log histograms of every phase and action since the last dump, and start over. Also done on SIGUSR1.
+ */
+void app_watchdog_dump();
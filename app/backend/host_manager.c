@@ -137,19 +137,15 @@ bool host_manager_authorization_cancel(host_manager_t *manager) {
 static void client_host_discovered(IHS_Client *client, const IHS_HostInfo *host, void *context) {
     (void) client;
     host_manager_t *manager = context;
-    IHS_HostInfo *host_copy = SDL_calloc(1, sizeof(IHS_HostInfo));
-    *host_copy = *host;
-    app_run_on_main(manager->app, client_host_discovered_main, host_copy);
+    app_run_on_main_copy(manager->app, client_host_discovered_main, host, sizeof(IHS_HostInfo));
 }
 
 static void client_authorization_success(IHS_Client *client, const IHS_HostInfo *host, uint64_t steamId,
                                          void *context) {
     (void) client;
     host_manager_t *manager = context;
-    host_manager_authorization_result_t *result = SDL_calloc(1, sizeof(host_manager_authorization_result_t));
-    result->host = *host;
-    result->steam_id = steamId;
-    app_run_on_main(manager->app, client_authorization_success_main, result);
+    host_manager_authorization_result_t result = {.host = *host, .steam_id = steamId};
+    app_run_on_main_copy(manager->app, client_authorization_success_main, &result, sizeof(result));
 }
 
 static void client_authorization_failed(IHS_Client *client, const IHS_HostInfo *host, IHS_AuthorizationResult result,
@@ -157,22 +153,19 @@ static void client_authorization_failed(IHS_Client *client, const IHS_HostInfo *
     (void) client;
     host_manager_t *manager = context;
     app_log_error("Client", "Authorization failed: %u", result);
-    host_manager_enum_error_t *error = SDL_calloc(1, sizeof(host_manager_enum_error_t));
-    error->host = *host;
-    error->result = result;
-    app_run_on_main(manager->app, client_authorization_failed_main, error);
+    host_manager_enum_error_t error = {.host = *host, .result = result};
+    app_run_on_main_copy(manager->app, client_authorization_failed_main, &error, sizeof(error));
 }
 
 static void client_streaming_success(IHS_Client *client, const IHS_HostInfo *host, const IHS_SocketAddress *address,
                                      const uint8_t *sessionKey, size_t sessionKeyLen, void *context) {
     (void) client;
     host_manager_t *manager = context;
-    host_manager_streaming_result_t *result = SDL_calloc(1, sizeof(host_manager_streaming_result_t));
-    result->host = *host;
-    result->session.address = *address;
-    SDL_memcpy(result->session.sessionKey, sessionKey, sessionKeyLen);
-    result->session.sessionKeyLen = sessionKeyLen;
-    app_run_on_main(manager->app, client_streaming_success_main, result);
+    host_manager_streaming_result_t result = {.host = *host};
+    result.session.address = *address;
+    SDL_memcpy(result.session.sessionKey, sessionKey, sessionKeyLen);
+    result.session.sessionKeyLen = sessionKeyLen;
+    app_run_on_main_copy(manager->app, client_streaming_success_main, &result, sizeof(result));
 }
 
 static void client_streaming_failed(IHS_Client *client, const IHS_HostInfo *host, IHS_StreamingResult result,
@@ -180,10 +173,8 @@ static void client_streaming_failed(IHS_Client *client, const IHS_HostInfo *host
     (void) client;
     host_manager_t *manager = context;
     app_log_error("Client", "Failed to start streaming: %s", streaming_result_str(result));
-    host_manager_enum_error_t *error = SDL_calloc(1, sizeof(host_manager_enum_error_t));
-    error->host = *host;
-    error->result = result;
-    app_run_on_main(manager->app, client_streaming_failed_main, error);
+    host_manager_enum_error_t error = {.host = *host, .result = result};
+    app_run_on_main_copy(manager->app, client_streaming_failed_main, &error, sizeof(error));
 }
 
 static void client_host_discovered_main(app_t *app, void *data) {
@@ -219,7 +210,6 @@ static void client_host_discovered_main(app_t *app, void *data) {
     }
     assert(info != NULL);
     *info = *host;
-    SDL_free(host);
 
     listeners_list_notify(manager->listeners, host_manager_listener_t, hosts_changed, hosts, change_type,
                           change_index);
@@ -230,7 +220,6 @@ static void client_streaming_success_main(app_t *app, void *data) {
     host_manager_streaming_result_t *result = data;
 
     listeners_list_notify(manager->listeners, host_manager_listener_t, session_started, &result->host, &result->session);
-    SDL_free(result);
 }
 
 static void client_streaming_failed_main(app_t *app, void *data) {
@@ -239,7 +228,6 @@ static void client_streaming_failed_main(app_t *app, void *data) {
 
     listeners_list_notify(manager->listeners, host_manager_listener_t, session_start_failed, &error->host,
                           error->result);
-    SDL_free(error);
 }
 
 static void client_authorization_success_main(app_t *app, void *data) {
@@ -247,8 +235,6 @@ static void client_authorization_success_main(app_t *app, void *data) {
     host_manager_authorization_result_t *result = data;
     listeners_list_notify(manager->listeners, host_manager_listener_t, authorized, &result->host,
                           result->steam_id);
-    SDL_free(result);
-
 }
 
 static void client_authorization_failed_main(app_t *app, void *data) {
@@ -257,7 +243,6 @@ static void client_authorization_failed_main(app_t *app, void *data) {
 
     listeners_list_notify(manager->listeners, host_manager_listener_t, authorization_failed, &error->host,
                           error->result);
-    SDL_free(error);
 }
 
 static int compare_host_name(const void *a, const void *b) {
@@ -71,13 +71,11 @@ size_t input_manager_sdl_gamepad_count(const input_manager_t *manager) {
 }
 
 void input_manager_ignore_next_mouse_movement(input_manager_t *manager) {
-    manager->ignore_next_mouse_movement = true;
+    SDL_AtomicSet(&manager->ignore_next_mouse_movement, 1);
 }
 
 bool input_manager_get_and_reset_mouse_movement(input_manager_t *manager) {
-    bool ignore = manager->ignore_next_mouse_movement;
-    manager->ignore_next_mouse_movement = false;
-    return ignore;
+    return SDL_AtomicSet(&manager->ignore_next_mouse_movement, 0) != 0;
 }
 
 static void insert_controller(input_manager_t *manager, SDL_JoystickID id, SDL_GameController *controller) {
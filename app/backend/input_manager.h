@@ -13,7 +13,8 @@ typedef struct input_manager_t {
     opened_controller_t *controllers;
     IHS_HIDProvider *hid_provider;
     size_t controllers_size, controllers_cap;
-    bool ignore_next_mouse_movement;
+    /* Set by main thread, consumed by whichever thread sends mouse input */
+    SDL_atomic_t ignore_next_mouse_movement;
 } input_manager_t;
 
 input_manager_t *input_manager_create();
@@ -5,6 +5,67 @@
 #include "stream_manager_internal.h"
 #include "backend/input_manager.h"
 
+#include "ihslib/hid/sdl.h"
+
+#include "logging/app_logging.h"
+#include "util/mpsc_queue.h"
+
+/* Events posted but not sent yet. More are kept in the overflow list until the worker catches up */
+#define INPUT_WORKER_QUEUE_SIZE 256
+
+typedef struct input_worker_item_t {
+    SDL_Event event;
+    /* Window size when the event was queued, SDL_GetWindowSize can only be called from main thread */
+    int window_width, window_height;
+    /* Queued by the event watch when pumped, not by the main thread when dispatched */
+    bool pumped;
+    /* Release everything pressed on controllers instead of sending the event */
+    bool reset_controllers;
+} input_worker_item_t;
+
+typedef struct input_worker_overflow_t {
+    struct input_worker_overflow_t *next;
+    input_worker_item_t item;
+} input_worker_overflow_t;
+
+struct stream_input_worker_t {
+    stream_manager_t *manager;
+    mpsc_queue_t *queue;
+    SDL_SpinLock overflow_lock;
+    SDL_atomic_t overflow_count;
+    input_worker_overflow_t *overflow_head, *overflow_tail;
+    SDL_sem *sem;
+    SDL_Thread *thread;
+    SDL_atomic_t running;
+    /* Set by main thread while input goes to the session, not to the overlay. Read by the event watch */
+    SDL_atomic_t forwarding;
+    /* Last window size read on main thread, for events pumped by other threads */
+    SDL_atomic_t window_width, window_height;
+    SDL_atomic_t sent, overflowed;
+    /* Milliseconds from pump to send on the worker, and from pump to dispatch on main thread */
+    struct {
+        uint32_t count, max;
+        uint64_t total;
+    } send_delay, dispatch_delay;
+};
+
+static int SDLCALL input_event_watch(void *userdata, SDL_Event *event);
+
+static bool input_worker_routes(const SDL_Event *event);
+
+static void input_worker_post(stream_input_worker_t *worker, const input_worker_item_t *item);
+
+static int input_worker(void *context);
+
+static bool input_worker_drain_overflow(stream_input_worker_t *worker);
+
+static void input_worker_send(stream_input_worker_t *worker, const input_worker_item_t *item);
+
+static void input_delay_record(uint32_t *count, uint32_t *max, uint64_t *total, const SDL_Event *event);
+
+static void input_send_mouse_event(stream_manager_t *manager, const SDL_Event *event, int window_width,
+                                   int window_height);
+
 bool stream_input_handle_key_event(stream_manager_t *manager, const SDL_KeyboardEvent *event) {
 #ifdef SDL_WEBOS_SCANCODE_EXIT
     SDL_Keysym keysym = event->keysym;
@@ -25,6 +86,24 @@ bool stream_input_handle_key_event(stream_manager_t *manager, const SDL_Keyboard
 }
 
 bool stream_input_handle_mouse_event(stream_manager_t *manager, const SDL_Event *event) {
+    switch (event->type) {
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEWHEEL: {
+            int w = 0, h = 0;
+            if (event->type == SDL_MOUSEMOTION) {
+                SDL_GetWindowSize(manager->app->ui->window, &w, &h);
+            }
+            input_send_mouse_event(manager, event, w, h);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void input_send_mouse_event(stream_manager_t *manager, const SDL_Event *event, int window_width,
+                                   int window_height) {
     switch (event->type) {
         case SDL_MOUSEMOTION: {
             if (input_manager_get_and_reset_mouse_movement(manager->app->input_manager)) {
@@ -33,12 +112,10 @@ bool stream_input_handle_mouse_event(stream_manager_t *manager, const SDL_Event
             if (manager->app->settings->relmouse) {
                 IHS_SessionSendMouseMovement(manager->session, event->motion.xrel, event->motion.yrel);
             } else {
-                int w, h;
-                SDL_GetWindowSize(manager->app->ui->window, &w, &h);
-                IHS_SessionSendMousePosition(manager->session, (float) event->motion.x / (float) w,
-                                             (float) event->motion.y / (float) h);
+                IHS_SessionSendMousePosition(manager->session, (float) event->motion.x / (float) window_width,
+                                             (float) event->motion.y / (float) window_height);
             }
-            return true;
+            break;
         }
         case SDL_MOUSEBUTTONDOWN:
         case SDL_MOUSEBUTTONUP: {
@@ -67,7 +144,7 @@ bool stream_input_handle_mouse_event(stream_manager_t *manager, const SDL_Event
                     IHS_SessionSendMouseDown(manager->session, button);
                 }
             }
-            return true;
+            break;
         }
         case SDL_MOUSEWHEEL: {
             Sint32 x = event->wheel.x, y = event->wheel.y;
@@ -81,8 +158,257 @@ bool stream_input_handle_mouse_event(stream_manager_t *manager, const SDL_Event
             if (y != 0) {
                 IHS_SessionSendMouseWheel(manager->session, y > 0 ? IHS_MOUSE_WHEEL_UP : IHS_MOUSE_WHEEL_DOWN);
             }
+            break;
+        }
+    }
+}
+
+stream_input_worker_t *stream_input_worker_start(stream_manager_t *manager) {
+    app_assert_main_thread(manager->app);
+    stream_input_worker_t *worker = calloc(1, sizeof(stream_input_worker_t));
+    if (worker == NULL) {
+        return NULL;
+    }
+    worker->manager = manager;
+    worker->queue = mpsc_queue_create(INPUT_WORKER_QUEUE_SIZE, sizeof(input_worker_item_t));
+    worker->sem = SDL_CreateSemaphore(0);
+    if (worker->queue == NULL || worker->sem == NULL) {
+        app_log_warn("StreamInput", "Failed to create input queue");
+        goto fail;
+    }
+    SDL_AtomicSet(&worker->running, 1);
+    SDL_AtomicSet(&worker->forwarding, !manager->overlay_opened);
+    int window_width = 0, window_height = 0;
+    SDL_GetWindowSize(manager->app->ui->window, &window_width, &window_height);
+    SDL_AtomicSet(&worker->window_width, window_width);
+    SDL_AtomicSet(&worker->window_height, window_height);
+    worker->thread = SDL_CreateThread(input_worker, "stream_input", worker);
+    if (worker->thread == NULL) {
+        app_log_warn("StreamInput", "Failed to start input thread: %s", SDL_GetError());
+        goto fail;
+    }
+    // Called by whichever thread pumps events, which is the main thread
+    SDL_AddEventWatch(input_event_watch, worker);
+    app_log_info("StreamInput", "Input thread started");
+    return worker;
+    fail:
+    if (worker->sem != NULL) {
+        SDL_DestroySemaphore(worker->sem);
+    }
+    if (worker->queue != NULL) {
+        mpsc_queue_destroy(worker->queue);
+    }
+    free(worker);
+    return NULL;
+}
+
+void stream_input_worker_stop(stream_input_worker_t *worker) {
+    app_assert_main_thread(worker->manager->app);
+    // Waits for the watch if it's running, nothing is queued by it after this
+    SDL_DelEventWatch(input_event_watch, worker);
+    SDL_AtomicSet(&worker->running, 0);
+    SDL_SemPost(worker->sem);
+    SDL_WaitThread(worker->thread, NULL);
+    // Sent well before dispatch means input didn't wait for the main loop
+    app_log_info("StreamInput", "Input thread stopped. sent=%d, overflowed=%d, pump_to_send_avg=%ums, "
+                                "pump_to_send_max=%ums, pump_to_dispatch_avg=%ums, pump_to_dispatch_max=%ums",
+                 SDL_AtomicGet(&worker->sent), SDL_AtomicGet(&worker->overflowed),
+                 worker->send_delay.count > 0 ? (uint32_t) (worker->send_delay.total / worker->send_delay.count) : 0,
+                 worker->send_delay.max,
+                 worker->dispatch_delay.count > 0 ?
+                 (uint32_t) (worker->dispatch_delay.total / worker->dispatch_delay.count) : 0,
+                 worker->dispatch_delay.max);
+    SDL_DestroySemaphore(worker->sem);
+    mpsc_queue_destroy(worker->queue);
+    free(worker);
+}
+
+void stream_input_worker_post(stream_input_worker_t *worker, const SDL_Event *event) {
+    app_assert_main_thread(worker->manager->app);
+    input_worker_item_t item = {.event = *event};
+    if (event->type == SDL_MOUSEMOTION) {
+        SDL_GetWindowSize(worker->manager->app->ui->window, &item.window_width, &item.window_height);
+    }
+    input_worker_post(worker, &item);
+}
+
+bool stream_input_worker_dispatched(stream_input_worker_t *worker, const SDL_Event *event) {
+    app_assert_main_thread(worker->manager->app);
+    if (!input_worker_routes(event)) {
+        return false;
+    }
+    input_delay_record(&worker->dispatch_delay.count, &worker->dispatch_delay.max, &worker->dispatch_delay.total,
+                       event);
+    return true;
+}
+
+void stream_input_worker_set_forwarding(stream_input_worker_t *worker, bool forwarding) {
+    app_assert_main_thread(worker->manager->app);
+    SDL_AtomicSet(&worker->forwarding, forwarding);
+}
+
+void stream_input_worker_reset_controllers(stream_input_worker_t *worker) {
+    app_assert_main_thread(worker->manager->app);
+    input_worker_item_t item = {.reset_controllers = true};
+    input_worker_post(worker, &item);
+}
+
+/**
+ * Queue input for the worker as soon as it's pumped, so it's sent even while the main loop is busy. The event still
+ * goes to the main thread, which only handles overlay and navigation with it.
+ */
+static int SDLCALL input_event_watch(void *userdata, SDL_Event *event) {
+    stream_input_worker_t *worker = userdata;
+    if (!input_worker_routes(event) || !SDL_AtomicGet(&worker->forwarding)) {
+        return 1;
+    }
+    input_worker_item_t item = {.event = *event, .pumped = true};
+    if (event->type == SDL_MOUSEMOTION) {
+        if (SDL_ThreadID() == worker->manager->app->main_thread_id) {
+            SDL_GetWindowSize(worker->manager->app->ui->window, &item.window_width, &item.window_height);
+            SDL_AtomicSet(&worker->window_width, item.window_width);
+            SDL_AtomicSet(&worker->window_height, item.window_height);
+        } else {
+            item.window_width = SDL_AtomicGet(&worker->window_width);
+            item.window_height = SDL_AtomicGet(&worker->window_height);
+        }
+    }
+    input_worker_post(worker, &item);
+    return 1;
+}
+
+/**
+ * Input the event watch queues. Controller hotplug changes what the app has opened, so it's posted once dispatched.
+ */
+static bool input_worker_routes(const SDL_Event *event) {
+    switch (event->type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEWHEEL:
+        case SDL_CONTROLLERAXISMOTION:
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
             return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Queue the item, or append it to the overflow list if the queue is full or the list isn't empty yet, so input is
+ * never dropped or reordered.
+ */
+static void input_worker_post(stream_input_worker_t *worker, const input_worker_item_t *item) {
+    input_worker_item_t *queued = NULL;
+    if (SDL_AtomicGet(&worker->overflow_count) == 0) {
+        queued = mpsc_queue_write_begin(worker->queue);
+    }
+    if (queued != NULL) {
+        *queued = *item;
+        mpsc_queue_write_commit(worker->queue, queued);
+    } else {
+        input_worker_overflow_t *node = malloc(sizeof(input_worker_overflow_t));
+        if (node == NULL) {
+            app_log_error("StreamInput", "Failed to queue input");
+            return;
+        }
+        node->next = NULL;
+        node->item = *item;
+        SDL_AtomicLock(&worker->overflow_lock);
+        if (worker->overflow_tail != NULL) {
+            worker->overflow_tail->next = node;
+        } else {
+            worker->overflow_head = node;
+        }
+        worker->overflow_tail = node;
+        SDL_AtomicAdd(&worker->overflow_count, 1);
+        SDL_AtomicUnlock(&worker->overflow_lock);
+        if (SDL_AtomicAdd(&worker->overflowed, 1) == 0) {
+            app_log_warn("StreamInput", "Input thread is not keeping up");
         }
     }
-    return false;
-}
\ No newline at end of file
+    SDL_SemPost(worker->sem);
+}
+
+static int input_worker(void *context) {
+    stream_input_worker_t *worker = context;
+    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) != 0) {
+        app_log_warn("StreamInput", "Failed to raise input thread priority: %s", SDL_GetError());
+    }
+    while (SDL_SemWait(worker->sem) == 0) {
+        input_worker_item_t *item = mpsc_queue_read_begin(worker->queue);
+        if (item != NULL) {
+            input_worker_send(worker, item);
+            mpsc_queue_read_end(worker->queue);
+            SDL_AtomicAdd(&worker->sent, 1);
+            continue;
+        }
+        // Everything in the overflow list was posted after what was in the queue
+        if (input_worker_drain_overflow(worker)) {
+            continue;
+        }
+        if (!SDL_AtomicGet(&worker->running)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @return false if the overflow list was empty
+ */
+static bool input_worker_drain_overflow(stream_input_worker_t *worker) {
+    if (SDL_AtomicGet(&worker->overflow_count) == 0) {
+        return false;
+    }
+    SDL_AtomicLock(&worker->overflow_lock);
+    input_worker_overflow_t *node = worker->overflow_head;
+    worker->overflow_head = worker->overflow_tail = NULL;
+    SDL_AtomicSet(&worker->overflow_count, 0);
+    SDL_AtomicUnlock(&worker->overflow_lock);
+    while (node != NULL) {
+        input_worker_overflow_t *next = node->next;
+        input_worker_send(worker, &node->item);
+        SDL_AtomicAdd(&worker->sent, 1);
+        free(node);
+        node = next;
+    }
+    return true;
+}
+
+static void input_worker_send(stream_input_worker_t *worker, const input_worker_item_t *item) {
+    stream_manager_t *manager = worker->manager;
+    if (item->pumped) {
+        input_delay_record(&worker->send_delay.count, &worker->send_delay.max, &worker->send_delay.total,
+                           &item->event);
+    }
+    if (item->reset_controllers) {
+        IHS_HIDResetSDLGameControllers(manager->session);
+        return;
+    }
+    switch (item->event.type) {
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEWHEEL: {
+            input_send_mouse_event(manager, &item->event, item->window_width, item->window_height);
+            break;
+        }
+    }
+    IHS_HIDHandleSDLEvent(manager->session, &item->event);
+}
+
+/**
+ * Milliseconds since the event was pumped. Each set of counters is only updated by one thread.
+ */
+static void input_delay_record(uint32_t *count, uint32_t *max, uint64_t *total, const SDL_Event *event) {
+    uint32_t delay = SDL_GetTicks() - event->common.timestamp;
+    (*count)++;
+    *total += delay;
+    if (delay > *max) {
+        *max = delay;
+    }
+}
@@ -2,6 +2,47 @@
 
 #include "stream_manager.h"
 
+/**
+ * Sends keyboard, mouse and controller input to the session from a high priority thread. An event watch queues input
+ * as soon as it's pumped, so it doesn't wait for the main loop to dispatch it. Overlay and navigation are still
+ * handled by the main thread. While the worker runs, it's the only thread that sends input to the session.
+ */
+typedef struct stream_input_worker_t stream_input_worker_t;
+
 bool stream_input_handle_key_event(stream_manager_t *manager, const SDL_KeyboardEvent *event);
 
 bool stream_input_handle_mouse_event(stream_manager_t *manager, const SDL_Event *event);
+
+/**
+ * Must be called from main thread, while streaming.
+ * @return NULL if the thread failed to start, input should be sent from main thread then
+ */
+stream_input_worker_t *stream_input_worker_start(stream_manager_t *manager);
+
+/**
+ * Input already queued is sent before the thread exits. Must be called from main thread.
+ */
+void stream_input_worker_stop(stream_input_worker_t *worker);
+
+/**
+ * Send an event the worker doesn't queue by itself to the session, after everything queued before. Must be called
+ * from main thread.
+ */
+void stream_input_worker_post(stream_input_worker_t *worker, const SDL_Event *event);
+
+/**
+ * Must be called from main thread when dispatching an event.
+ * @return true if the worker queued the event when it was pumped, or skipped it because input wasn't forwarded then.
+ *         Main thread must not send it.
+ */
+bool stream_input_worker_dispatched(stream_input_worker_t *worker, const SDL_Event *event);
+
+/**
+ * Forward pumped input to the session or not, as when the overlay is opened. Must be called from main thread.
+ */
+void stream_input_worker_set_forwarding(stream_input_worker_t *worker, bool forwarding);
+
+/**
+ * Release everything pressed on controllers, after input posted before. Must be called from main thread.
+ */
+void stream_input_worker_reset_controllers(stream_input_worker_t *worker);
@@ -38,6 +38,8 @@ static void session_show_cursor_main(app_t *app, void *context);
 
 static void destroy_session_main(app_t *app, void *context);
 
+static void stop_on_error_main(app_t *app, void *context);
+
 static void controller_back_pressed(stream_manager_t *manager);
 
 static void controller_back_released(stream_manager_t *manager);
@@ -50,7 +52,11 @@ static void back_timer_finish_main(app_t *app, void *context);
 
 static void grab_mouse(stream_manager_t *manager, bool grab);
 
+static void stop_input_worker(stream_manager_t *manager);
+
 #define BACK_COUNTER_MAX 100
+/* Session thread waits this long for the main thread to handle connection changes, before notifying it later */
+#define SESSION_SYNC_TIMEOUT_MS 1000
 
 typedef struct event_context_t {
     stream_manager_t *manager;
@@ -150,6 +156,10 @@ void stream_manager_stop_active(stream_manager_t *manager) {
     IHS_SessionDisconnect(manager->session);
 }
 
+void stream_manager_stop_on_error(stream_manager_t *manager) {
+    app_run_on_main(manager->app, stop_on_error_main, manager);
+}
+
 bool stream_manager_intercept_event(const stream_manager_t *manager, const SDL_Event *event) {
     if (manager->state != STREAM_MANAGER_STATE_STREAMING) {
         // Ignore events when idle
@@ -184,6 +194,8 @@ void stream_manager_handle_event(stream_manager_t *manager, const SDL_Event *eve
                 return;
         }
     }
+    // Input worker queued session input when it was pumped, only overlay and navigation are handled here
+    bool routed = manager->input_worker != NULL && stream_input_worker_dispatched(manager->input_worker, event);
     switch (event->type) {
         case SDL_KEYDOWN:
         case SDL_KEYUP: {
@@ -195,7 +207,9 @@ void stream_manager_handle_event(stream_manager_t *manager, const SDL_Event *eve
         case SDL_MOUSEBUTTONDOWN:
         case SDL_MOUSEBUTTONUP:
         case SDL_MOUSEWHEEL: {
-            stream_input_handle_mouse_event(manager, event);
+            if (manager->input_worker == NULL) {
+                stream_input_handle_mouse_event(manager, event);
+            }
             break;
         }
         case SDL_CONTROLLERBUTTONDOWN: {
@@ -211,7 +225,14 @@ void stream_manager_handle_event(stream_manager_t *manager, const SDL_Event *eve
             break;
         }
     }
-    IHS_HIDHandleSDLEvent(manager->session, event);
+    if (routed) {
+        return;
+    }
+    if (manager->input_worker != NULL) {
+        stream_input_worker_post(manager->input_worker, event);
+    } else {
+        IHS_HIDHandleSDLEvent(manager->session, event);
+    }
 }
 
 void stream_manager_set_viewport_size(stream_manager_t *manager, int width, int height) {
@@ -242,6 +263,9 @@ bool stream_manager_set_overlay_opened(stream_manager_t *manager, bool opened) {
         return false;
     }
     manager->overlay_opened = opened;
+    if (manager->input_worker != NULL) {
+        stream_input_worker_set_forwarding(manager->input_worker, !opened);
+    }
     stream_media_set_overlay_shown(manager->media, opened);
     if (opened) {
         app_post_event(manager->app, APP_UI_REQUEST_OVERLAY, NULL, NULL);
@@ -293,7 +317,10 @@ static void session_connected(IHS_Session *session, void *context) {
             .manager = manager,
             .arg1 = (void *) IHS_SessionGetInfo(session),
     };
-    app_run_on_main_sync(manager->app, session_connected_main, &ec);
+    if (!app_run_on_main_sync_timeout(manager->app, session_connected_main, &ec, SESSION_SYNC_TIMEOUT_MS)) {
+        app_log_warn("StreamManager", "Main thread is not responding, will notify connection later");
+        app_run_on_main_copy(manager->app, session_connected_main, &ec, sizeof(ec));
+    }
     IHS_SessionHIDNotifyDeviceChange(session);
 }
 
@@ -313,7 +340,10 @@ static void session_disconnected(IHS_Session *session, void *context) {
             .arg1 = (void *) IHS_SessionGetInfo(session),
             .value1 = requested
     };
-    app_run_on_main_sync(manager->app, session_disconnected_main, &ec);
+    if (!app_run_on_main_sync_timeout(manager->app, session_disconnected_main, &ec, SESSION_SYNC_TIMEOUT_MS)) {
+        app_log_warn("StreamManager", "Main thread is not responding, will notify disconnection later");
+        app_run_on_main_copy(manager->app, session_disconnected_main, &ec, sizeof(ec));
+    }
 }
 
 static void session_show_cursor(IHS_Session *session, float x, float y, void *context) {
@@ -329,24 +359,28 @@ static void session_show_cursor(IHS_Session *session, float x, float y, void *co
     float scale = SDL_min((float) manager->viewport_width / manager->capture_width,
                           (float) manager->viewport_height / manager->capture_height);
     float dst_width = (float) manager->capture_width * scale, dst_height = (float) manager->capture_height * scale;
-    SDL_Point *point = calloc(1, sizeof(SDL_Point));
-    point->x = (int) (((float) manager->viewport_width - dst_width) / 2.0f + dst_width * x);
-    point->y = (int) (((float) manager->viewport_height - dst_height) / 2.0f + dst_height * y);
-    app_run_on_main(manager->app, session_show_cursor_main, point);
+    SDL_Point point = {
+            .x = (int) (((float) manager->viewport_width - dst_width) / 2.0f + dst_width * x),
+            .y = (int) (((float) manager->viewport_height - dst_height) / 2.0f + dst_height * y),
+    };
+    app_run_on_main_copy(manager->app, session_show_cursor_main, &point, sizeof(point));
 }
 
 static void session_connected_main(app_t *app, void *context) {
-    (void) app;
     event_context_t *ec = context;
     stream_manager_t *manager = ec->manager;
     listeners_list_notify(manager->listeners, stream_manager_listener_t, connected, (const IHS_SessionInfo *) ec->arg1);
     grab_mouse(manager, true);
+    if (app->settings->input_thread && manager->state == STREAM_MANAGER_STATE_STREAMING) {
+        manager->input_worker = stream_input_worker_start(manager);
+    }
 }
 
 static void session_disconnected_main(app_t *app, void *context) {
     (void) app;
     event_context_t *ec = context;
     stream_manager_t *manager = ec->manager;
+    stop_input_worker(manager);
     grab_mouse(manager, false);
     listeners_list_notify(manager->listeners, stream_manager_listener_t, disconnected,
                           (const IHS_SessionInfo *) ec->arg1, ec->value1);
@@ -357,12 +391,22 @@ static void session_show_cursor_main(app_t *app, void *context) {
     SDL_Point *point = context;
     input_manager_ignore_next_mouse_movement(manager->app->input_manager);
 //    SDL_WarpMouseInWindow(app->ui->window, point->x, point->y);
-    free(context);
+}
+
+static void stop_on_error_main(app_t *app, void *context) {
+    (void) app;
+    stream_manager_t *manager = context;
+    if (manager->state != STREAM_MANAGER_STATE_STREAMING) {
+        return;
+    }
+    app_log_info("StreamManager", "Disconnecting after stream error");
+    IHS_SessionDisconnect(manager->session);
 }
 
 static void destroy_session_main(app_t *app, void *context) {
     (void) app;
     IHS_Session *session = context;
+    stop_input_worker(app->stream_manager);
     IHS_SessionThreadedJoin(session);
     IHS_SessionDestroy(session);
     stream_media_destroy(app->stream_manager->media);
@@ -399,6 +443,13 @@ static void grab_mouse(stream_manager_t *manager, bool grab) {
 #endif
 }
 
+static void stop_input_worker(stream_manager_t *manager) {
+    if (manager->input_worker == NULL) {
+        return;
+    }
+    stream_input_worker_stop(manager->input_worker);
+    manager->input_worker = NULL;
+}
 
 static Uint32 back_timer_callback(Uint32 duration, void *param) {
     (void) duration;
@@ -410,7 +461,6 @@ static Uint32 back_timer_callback(Uint32 duration, void *param) {
     if (manager->back_counter >= BACK_COUNTER_MAX) {
         manager->back_timer = 0;
         manager->back_counter = 0;
-        IHS_HIDResetSDLGameControllers(manager->session);
         app_log_info("Streaming", "Requesting overlay");
         app_run_on_main(manager->app, back_timer_finish_main, manager);
         return 0;
@@ -429,6 +479,12 @@ static void back_timer_progress_main(app_t *app, void *context) {
 static void back_timer_finish_main(app_t *app, void *context) {
     (void) app;
     stream_manager_t *manager = (stream_manager_t *) context;
+    // Reset here instead of the timer thread, so only one thread sends input to the session
+    if (manager->input_worker != NULL) {
+        stream_input_worker_reset_controllers(manager->input_worker);
+    } else if (manager->state == STREAM_MANAGER_STATE_STREAMING) {
+        IHS_HIDResetSDLGameControllers(manager->session);
+    }
     stream_manager_set_overlay_opened(manager, true);
     listeners_list_notify(manager->listeners, stream_manager_listener_t, overlay_progress_finished, true);
 }
\ No newline at end of file
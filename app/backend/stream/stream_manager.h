@@ -34,6 +34,12 @@ IHS_Session *stream_manager_active_session(const stream_manager_t *manager);
 
 void stream_manager_stop_active(stream_manager_t *manager);
 
+/**
+ * Disconnect the active session because it can't continue. Listeners are notified as for a disconnection that wasn't
+ * requested. Can be called from any thread.
+ */
+void stream_manager_stop_on_error(stream_manager_t *manager);
+
 /**
  * Check if an event should only be dispatched to stream manager. This method call should not change any state
  * @return true if the event should only be processed by this manager
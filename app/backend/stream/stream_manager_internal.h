@@ -2,6 +2,7 @@
 
 #include "stream_manager.h"
 #include "stream_media.h"
+#include "stream_input.h"
 
 #include "util/array_list.h"
 
@@ -20,6 +21,8 @@ struct stream_manager_t {
 
     stream_media_session_t *media;
     IHS_Session *session;
+    /* Sends input while streaming, NULL if input is sent from main thread */
+    stream_input_worker_t *input_worker;
     SDL_TimerID back_timer;
     int back_counter;
     bool overlay_opened;
@@ -1,28 +1,202 @@
+#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include "stream_media.h"
 
 #include "ss4s.h"
-#include "stream_manager.h"
+#include "stream_manager_internal.h"
+#include "stream_recorder.h"
 #include "app.h"
 #include "logging/app_logging.h"
+#include "util/frame_ring.h"
 #include "util/video/sps/include/sps_util.h"
 
 #include <opus_multistream.h>
 #include <SDL2/SDL.h>
 
+#define SPS_CACHE_CAPACITY 512
+/* Assumed until the SPS tells the frame rate */
+#define DEFAULT_FRAME_INTERVAL_US 16667
+/* Keyframe is requested again if none arrived after this long */
+#define KEYFRAME_REQUEST_INTERVAL_MS 1000
+/* Audio packets arriving at least this many packet durations after the previous one may follow lost packets. Shorter
+ * gaps are taken as jitter */
+#define AUDIO_LOSS_MIN_GAP_FRAMES 3
+/* Packets after a gap are held until the next one arrives, unless larger than this */
+#define AUDIO_LOSS_HELD_MAX_SIZE 1500
+/* Longer gaps are a pause of the stream, and aren't concealed */
+#define AUDIO_CONCEAL_MAX_FRAMES 40
+/* Smoothing of the audio queue depth, in packets */
+#define AUDIO_JITTER_SMOOTHING 16
+/* Audio queue depth this close to the target isn't corrected */
+#define AUDIO_JITTER_WINDOW_US 5000
+/* Packets are dropped while the audio queue is this many times over its target */
+#define AUDIO_JITTER_MAX_FACTOR 3
+/* Up to 1/64 of each packet is dropped or repeated to bring the audio queue back to its target */
+#define AUDIO_DRIFT_CORRECTION_DIVISOR 64
+/* Smallest audio queue depth kept when the playout buffer is enabled */
+#define AUDIO_JITTER_MIN_TARGET_US (2 * AUDIO_JITTER_WINDOW_US)
+/* Audio is never delayed more than this to match video */
+#define AV_SYNC_MAX_DELAY_US 500000
+/* Smoothing of A/V delay measurements, in frames or packets */
+#define AV_SYNC_SMOOTHING 16
+/* Packets the audio worker can queue, 160ms of audio */
+#define AUDIO_WORKER_QUEUE_SIZE 32
+
 struct stream_media_session_t {
     stream_manager_t *manager;
     SDL_mutex *lock;
     SS4S_Player *player;
 
     SS4S_VideoInfo video_info;
+    /* Player is opened in video_start. Only accessed by the thread feeding the decoder afterwards */
+    bool video_opened;
+    /* First SPS of the stream was applied to video_info. If it told other parameters than the session, the player is
+     * reopened with them before the next frame is fed */
+    bool video_configured, video_reopen;
     OpusMSDecoder *opus_decoder;
     size_t pcm_unit_size;
     int16_t *pcm_buffer;
 
     int pcm_buffer_size;
+    /* Decodes and feeds audio off the receive thread. Packets are queued by the receive thread only */
+    struct {
+        bool enabled;
+        bool high_priority;
+        frame_ring_t *ring;
+        SDL_Thread *thread;
+        SDL_sem *sem;
+        SDL_atomic_t running;
+    } audio_worker;
+    /* Packet loss concealment, only accessed by the thread decoding audio */
+    struct {
+        bool enabled;
+        int samples_per_frame;
+        /* Duration of a packet, in performance counter ticks */
+        Uint64 frame_ticks;
+        Uint64 last_arrival;
+        /* Packet that arrived after a gap. Decoded once the next packet tells whether packets were lost or late */
+        unsigned char held[AUDIO_LOSS_HELD_MAX_SIZE];
+        int held_size, held_missing;
+        Uint64 held_arrival;
+        /* Frames synthesized by the decoder, frames rebuilt from FEC data of the following packet, and gaps that
+         * turned out to be late packets */
+        uint32_t concealed, recovered, late;
+    } audio_loss;
+    /* Playout buffer, only accessed by the thread decoding audio. The decoder consumes audio in real time, so its
+     * queue depth is estimated from the audio fed since playout started */
+    struct {
+        /* Feed audio as it arrives if disabled */
+        bool enabled;
+        /* Queue depth to keep, before delay added by A/V sync */
+        int target_us;
+        int frequency;
+        Uint64 clock_start;
+        uint64_t fed_samples;
+        int64_t depth_avg_us;
+        /* Fed to fill the queue up to target when playout starts */
+        int16_t *silence;
+        int silence_samples;
+        uint32_t underruns, dropped_packets;
+        uint64_t dropped_samples, inserted_samples;
+    } audio_jitter;
+    /* Audio and video have no common timestamps from the host, so the delay of each is measured from arrival */
+    struct {
+        /* Match audio delay to the measured video delay, by growing the audio playout buffer */
+        bool auto_delay;
+        /* Added to the audio playout buffer */
+        int audio_delay_us;
+        /* Decoding and display time of video after it was fed, which can't be measured */
+        int video_display_us;
+        /* Smoothed time from receiving a video frame until it was fed. Written by the thread feeding video */
+        SDL_atomic_t video_delay_us;
+        /* Only accessed by the thread decoding audio */
+        int64_t audio_processing_us;
+        int64_t offset_avg_us, offset_min_us, offset_max_us;
+        uint32_t measurements;
+        /* How much later video is shown than audio, in milliseconds. Readable from any thread */
+        SDL_atomic_t offset_ms;
+        SDL_atomic_t offset_valid;
+    } av_sync;
+    /* Decoded packets are collected in pcm_buffer and fed together. Only accessed by the thread decoding audio */
+    struct {
+        /* Samples per channel to collect before feeding */
+        int samples;
+        int pending_samples;
+        Uint32 start_ticks;
+        uint32_t feed_calls;
+        Uint64 feed_time;
+    } audio_batch;
     int viewport_width, viewport_height;
     int overlay_height;
+
+    struct {
+        bool enabled;
+        int queue_size;
+        frame_ring_t *ring;
+        SDL_Thread *thread;
+        SDL_sem *sem;
+        SDL_atomic_t running;
+        /* Set by the feeder when decoder asks for a keyframe, reported back on next submit */
+        SDL_atomic_t keyframe_requested;
+        /* Only accessed by the producer. Frames are dropped until next keyframe, after queue overflowed or fell too
+         * far behind */
+        bool wait_keyframe;
+        /* Only accessed by the producer. Counter of the reason frames are dropped until next keyframe */
+        SDL_atomic_t *wait_reason;
+        /* Only accessed by the producer */
+        sps_slice_state_t slice_state;
+        int latency_budget_ms;
+        /* Set from SPS frame rate, to convert queue occupancy to latency */
+        SDL_atomic_t frame_interval_us;
+        struct {
+            SDL_atomic_t non_reference, latency, overflow;
+        } drops;
+    } feeder;
+
+    /* Last parsed SPS, only accessed by the thread feeding the decoder */
+    struct {
+        unsigned char data[SPS_CACHE_CAPACITY];
+        size_t size;
+        uint32_t hits, misses;
+        /* Low latency version of the cached SPS, empty if it's the same as the original */
+        unsigned char rewritten[SPS_UTIL_REWRITE_MAX_SIZE];
+        size_t rewritten_size;
+    } sps_cache;
+    struct {
+        bool enabled;
+        /* Keyframe with the SPS replaced */
+        unsigned char *frame;
+        size_t frame_capacity;
+        uint32_t rewrites, replaced;
+    } sps_rewrite;
+    /* Only accessed by the receive thread */
+    struct {
+        /* Mask of SPS_NAL_TYPE_BIT for the stream codec, 0 to feed frames untouched */
+        uint64_t drop_types;
+        uint64_t bytes_saved;
+        uint32_t frames_filtered;
+    } nal_filter;
+    /* Reference frame tracking, only accessed by the thread feeding the decoder */
+    struct {
+        bool enabled;
+        sps_slice_state_t slice_state;
+        sps_frame_order_t order;
+        /* When the missing reference frame was found, and when a keyframe was last requested for it */
+        Uint32 gap_ticks, request_ticks;
+        uint32_t gaps, recoveries, dropped;
+        uint32_t recovery_total_ms, recovery_max_ms;
+    } frame_order;
+    /* Recorded by the thread feeding the decoder, the spin lock allows reading them from any thread */
+    struct {
+        SDL_SpinLock lock;
+        latency_histogram_t stages[STREAM_MEDIA_LATENCY_STAGE_COUNT];
+        Uint64 counter_frequency;
+    } latency;
+    /* Records what the session submits, NULL if not recording */
+    stream_recorder_t *recorder;
+    /* Holds the SPS RBSP when it contains emulation prevention bytes */
+    sps_rbsp_buffer_t rbsp_scratch;
 };
 
 static int audio_start(IHS_Session *session, const IHS_StreamAudioConfig *config, void *context);
@@ -31,6 +205,35 @@ static void audio_stop(IHS_Session *session, void *context);
 
 static int audio_submit(IHS_Session *session, IHS_Buffer *data, void *context);
 
+static int audio_decode(stream_media_session_t *media_session, const unsigned char *packet, int size,
+                        Uint64 received);
+
+static int audio_decode_packet(stream_media_session_t *media_session, const unsigned char *packet, int size,
+                               int missing, Uint64 received);
+
+static int audio_conceal_loss(stream_media_session_t *media_session, const unsigned char *packet, int size,
+                              int offset, int missing);
+
+static bool audio_packet_has_lbrr(const unsigned char *packet, int size);
+
+static int audio_feed(stream_media_session_t *media_session, int samples, Uint64 received);
+
+static int audio_feed_player(stream_media_session_t *media_session, const int16_t *pcm, int samples);
+
+static int audio_jitter_adjust(stream_media_session_t *media_session, int samples);
+
+static int audio_jitter_target(stream_media_session_t *media_session);
+
+static void av_sync_measure_audio(stream_media_session_t *media_session, Uint64 received);
+
+static void av_sync_measure_video(stream_media_session_t *media_session, Uint64 received, Uint64 fed);
+
+static bool audio_worker_start(stream_media_session_t *media_session);
+
+static void audio_worker_stop(stream_media_session_t *media_session);
+
+static int audio_worker(void *context);
+
 static int video_start(IHS_Session *session, const IHS_StreamVideoConfig *config, void *context);
 
 static void video_stop(IHS_Session *session, void *context);
@@ -39,12 +242,56 @@ static int video_submit(IHS_Session *session, IHS_Buffer *data, IHS_StreamVideoF
 
 static int video_set_capture_size(IHS_Session *session, int width, int height, void *context);
 
+static int video_feed(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                      SS4S_VideoFeedFlags flags, Uint64 received);
+
+static bool video_reopen(stream_media_session_t *media_session);
+
+static bool video_check_sps(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                            const unsigned char **sps, size_t *sps_size);
+
+static bool video_parse_sps(stream_media_session_t *media_session, const unsigned char *sps, size_t sps_size,
+                            sps_info_t *info);
+
+static void video_rewrite_sps(stream_media_session_t *media_session, const unsigned char *sps, size_t sps_size);
+
+static uint64_t video_nal_filter_types(SS4S_VideoCodec codec, const app_settings_t *settings);
+
+static bool video_check_frame_order(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                                    bool keyframe, bool *request_keyframe);
+
+static const unsigned char *video_replace_sps(stream_media_session_t *media_session, const unsigned char *data,
+                                              size_t *size, const unsigned char *sps, size_t sps_size);
+
+static bool video_feeder_start(stream_media_session_t *media_session);
+
+static void video_feeder_stop(stream_media_session_t *media_session);
+
+static int video_feeder_submit(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                               SS4S_VideoFeedFlags flags, Uint64 received);
+
+static int video_feeder_worker(void *context);
+
+static void video_latency_record(stream_media_session_t *media_session, stream_media_latency_stage_t stage,
+                                 Uint64 begin, Uint64 end);
+
+static void video_latency_reset(stream_media_session_t *media_session);
+
+static sps_frame_type_t video_classify_frame(stream_media_session_t *media_session, const unsigned char *data,
+                                             size_t size);
+
+static void video_feeder_drop(stream_media_session_t *media_session, SDL_atomic_t *reason);
+
 static const IHS_StreamAudioCallbacks audio_callbacks = {
         .start = audio_start,
         .stop = audio_stop,
         .submit = audio_submit,
 };
 
+static const char *const latency_stage_names[STREAM_MEDIA_LATENCY_STAGE_COUNT] = {
+        "queue", "sps", "sps_lock", "feed", "total",
+};
+
 static const IHS_StreamVideoCallbacks video_callbacks = {
         .start = video_start,
         .stop = video_stop,
@@ -57,12 +304,37 @@ stream_media_session_t *stream_media_create(stream_manager_t *manager) {
     media_session->manager = manager;
     media_session->lock = SDL_CreateMutex();
     media_session->player = SS4S_PlayerOpen();
+    const app_settings_t *settings = manager->app->settings;
+    media_session->feeder.enabled = settings->video_feeder_thread;
+    media_session->feeder.queue_size = settings->video_feeder_queue_size;
+    media_session->feeder.latency_budget_ms = settings->video_latency_budget_ms;
+    media_session->sps_rewrite.enabled = settings->video_low_latency_sps;
+    media_session->frame_order.enabled = settings->video_gap_recovery;
+    media_session->audio_worker.enabled = settings->audio_decoder_thread;
+    media_session->audio_worker.high_priority = settings->audio_decoder_thread_high_priority;
+    media_session->audio_loss.enabled = settings->audio_loss_concealment;
+    media_session->audio_jitter.target_us = settings->audio_target_latency_ms * 1000;
+    media_session->av_sync.auto_delay = settings->av_sync_auto;
+    media_session->av_sync.audio_delay_us = settings->audio_delay_ms * 1000;
+    media_session->av_sync.video_display_us = settings->video_display_latency_ms * 1000;
+    media_session->audio_jitter.enabled = settings->audio_target_latency_ms > 0 || settings->audio_delay_ms > 0 ||
+                                          settings->av_sync_auto;
+    media_session->latency.counter_frequency = SDL_GetPerformanceFrequency();
+    if (settings->record_path != NULL) {
+        media_session->recorder = stream_recorder_create(settings->record_path,
+                                                         (uint64_t) settings->record_max_mb * 1024 * 1024);
+    }
     return media_session;
 }
 
 void stream_media_destroy(stream_media_session_t *media_session) {
     SS4S_PlayerClose(media_session->player);
     SDL_DestroyMutex(media_session->lock);
+    sps_util_rbsp_buffer_free(&media_session->rbsp_scratch);
+    if (media_session->recorder != NULL) {
+        stream_recorder_destroy(media_session->recorder);
+    }
+    free(media_session->sps_rewrite.frame);
     free(media_session);
 }
 
@@ -111,6 +383,48 @@ bool stream_media_supports_hevc(stream_media_session_t *media_session) {
     return SS4S_GetVideoCapabilities() & SS4S_VIDEO_CAP_CODEC_H265;
 }
 
+bool stream_media_get_video_queue_stats(stream_media_session_t *media_session, frame_ring_stats_t *stats) {
+    // Lock keeps the feeder from being stopped and the ring freed meanwhile
+    SDL_LockMutex(media_session->lock);
+    frame_ring_t *ring = media_session->feeder.ring;
+    if (ring != NULL) {
+        frame_ring_get_stats(ring, stats);
+    }
+    SDL_UnlockMutex(media_session->lock);
+    return ring != NULL;
+}
+
+bool stream_media_get_video_drop_stats(stream_media_session_t *media_session, stream_media_drop_stats_t *stats) {
+    SDL_LockMutex(media_session->lock);
+    bool running = media_session->feeder.ring != NULL;
+    if (running) {
+        stats->non_reference = SDL_AtomicGet(&media_session->feeder.drops.non_reference);
+        stats->latency = SDL_AtomicGet(&media_session->feeder.drops.latency);
+        stats->overflow = SDL_AtomicGet(&media_session->feeder.drops.overflow);
+    }
+    SDL_UnlockMutex(media_session->lock);
+    return running;
+}
+
+const char *stream_media_latency_stage_name(stream_media_latency_stage_t stage) {
+    return latency_stage_names[stage];
+}
+
+void stream_media_get_video_latency(stream_media_session_t *media_session, stream_media_latency_stage_t stage,
+                                    latency_summary_t *summary) {
+    SDL_AtomicLock(&media_session->latency.lock);
+    latency_histogram_summarize(&media_session->latency.stages[stage], summary);
+    SDL_AtomicUnlock(&media_session->latency.lock);
+}
+
+bool stream_media_get_av_offset(stream_media_session_t *media_session, int *offset_ms) {
+    if (!SDL_AtomicGet(&media_session->av_sync.offset_valid)) {
+        return false;
+    }
+    *offset_ms = SDL_AtomicGet(&media_session->av_sync.offset_ms);
+    return true;
+}
+
 const IHS_StreamAudioCallbacks *stream_media_audio_callbacks() {
     return &audio_callbacks;
 }
@@ -127,12 +441,54 @@ static int audio_start(IHS_Session *session, const IHS_StreamAudioConfig *config
         return -1;
     }
     stream_media_session_t *media_session = (stream_media_session_t *) context;
+    if (media_session->recorder != NULL) {
+        stream_recorder_write_config(media_session->recorder, STREAM_RECORD_AUDIO_START, config->codec,
+                                     config->channels, config->frequency);
+    }
     SDL_LockMutex(media_session->lock);
     int rc;
     unsigned char mapping[2] = {0, 1};
     const int samples_per_frame = 240;
     media_session->pcm_buffer_size = samples_per_frame * 64;
     media_session->pcm_unit_size = config->channels * sizeof(int16_t);
+    media_session->audio_loss.samples_per_frame = samples_per_frame;
+    media_session->audio_loss.frame_ticks = SDL_GetPerformanceFrequency() * samples_per_frame / config->frequency;
+    media_session->audio_loss.last_arrival = 0;
+    media_session->audio_loss.held_size = 0;
+    media_session->audio_loss.concealed = 0;
+    media_session->audio_loss.recovered = 0;
+    media_session->audio_loss.late = 0;
+    media_session->audio_batch.samples = media_session->manager->app->settings->audio_feed_batch * samples_per_frame;
+    media_session->audio_batch.pending_samples = 0;
+    media_session->audio_batch.start_ticks = SDL_GetTicks();
+    media_session->audio_batch.feed_calls = 0;
+    media_session->audio_batch.feed_time = 0;
+    media_session->av_sync.audio_processing_us = 0;
+    media_session->av_sync.measurements = 0;
+    SDL_AtomicSet(&media_session->av_sync.offset_valid, 0);
+    if (media_session->audio_jitter.enabled) {
+        // Largest target the playout buffer can have
+        int max_target_us = media_session->audio_jitter.target_us + media_session->av_sync.audio_delay_us;
+        if (media_session->av_sync.auto_delay) {
+            max_target_us += AV_SYNC_MAX_DELAY_US;
+        }
+        if (max_target_us < AUDIO_JITTER_MIN_TARGET_US) {
+            max_target_us = AUDIO_JITTER_MIN_TARGET_US;
+        }
+        media_session->audio_jitter.frequency = (int) config->frequency;
+        media_session->audio_jitter.clock_start = 0;
+        media_session->audio_jitter.silence_samples = (int) ((int64_t) max_target_us * config->frequency / 1000000);
+        media_session->audio_jitter.silence = calloc(media_session->pcm_unit_size,
+                                                     media_session->audio_jitter.silence_samples);
+        if (media_session->audio_jitter.silence == NULL) {
+            app_log_warn("Media", "Failed to allocate audio playout buffer, playing audio as it arrives");
+            media_session->audio_jitter.enabled = false;
+        }
+        media_session->audio_jitter.underruns = 0;
+        media_session->audio_jitter.dropped_packets = 0;
+        media_session->audio_jitter.dropped_samples = 0;
+        media_session->audio_jitter.inserted_samples = 0;
+    }
 
     media_session->opus_decoder = opus_multistream_decoder_create(config->frequency, config->channels,
                                                                   1, 1, mapping, &rc);
@@ -141,43 +497,365 @@ static int audio_start(IHS_Session *session, const IHS_StreamAudioConfig *config
             .codec = SS4S_AUDIO_PCM_S16LE,
             .numOfChannels = (int) config->channels,
             .sampleRate = (int) config->frequency,
-            .samplesPerFrame = samples_per_frame,
+            .samplesPerFrame = media_session->audio_batch.samples,
     };
     SDL_UnlockMutex(media_session->lock);
-    return SS4S_PlayerAudioOpen(media_session->player, &info);
+    int ret = SS4S_PlayerAudioOpen(media_session->player, &info);
+    if (ret == 0 && media_session->audio_worker.enabled && !audio_worker_start(media_session)) {
+        app_log_warn("Media", "Failed to start audio decoder thread, decoding on receive thread");
+    }
+    return ret;
 }
 
 static void audio_stop(IHS_Session *session, void *context) {
     (void) session;
     stream_media_session_t *media_session = (stream_media_session_t *) context;
+    if (media_session->recorder != NULL) {
+        stream_recorder_write(media_session->recorder, STREAM_RECORD_AUDIO_STOP, 0, NULL, 0);
+    }
+    audio_worker_stop(media_session);
     SS4S_PlayerAudioClose(media_session->player);
     opus_multistream_decoder_destroy(media_session->opus_decoder);
     free(media_session->pcm_buffer);
+    Uint32 audio_duration_ms = SDL_GetTicks() - media_session->audio_batch.start_ticks;
+    if (media_session->audio_batch.feed_calls > 0 && audio_duration_ms > 0) {
+        app_log_info("Media", "Audio feed: calls=%u, calls_per_sec=%u, avg=%uus", media_session->audio_batch.feed_calls,
+                     (unsigned) ((uint64_t) media_session->audio_batch.feed_calls * 1000 / audio_duration_ms),
+                     (unsigned) (media_session->audio_batch.feed_time * 1000000 /
+                                 media_session->latency.counter_frequency / media_session->audio_batch.feed_calls));
+    }
+    if (media_session->audio_loss.enabled) {
+        app_log_info("Media", "Audio loss: concealed=%u, recovered=%u, late=%u", media_session->audio_loss.concealed,
+                     media_session->audio_loss.recovered, media_session->audio_loss.late);
+    }
+    if (media_session->av_sync.measurements > 0) {
+        app_log_info("Media", "A/V offset: avg=%dms, min=%dms, max=%dms, video_delay=%dms",
+                     (int) (media_session->av_sync.offset_avg_us / 1000),
+                     (int) (media_session->av_sync.offset_min_us / 1000),
+                     (int) (media_session->av_sync.offset_max_us / 1000),
+                     (SDL_AtomicGet(&media_session->av_sync.video_delay_us) + media_session->av_sync.video_display_us) /
+                     1000);
+    }
+    if (media_session->audio_jitter.enabled) {
+        app_log_info("Media", "Audio playout: underruns=%u, dropped_packets=%u, dropped_samples=%llu, "
+                              "inserted_samples=%llu", media_session->audio_jitter.underruns,
+                     media_session->audio_jitter.dropped_packets,
+                     (unsigned long long) media_session->audio_jitter.dropped_samples,
+                     (unsigned long long) media_session->audio_jitter.inserted_samples);
+        free(media_session->audio_jitter.silence);
+        media_session->audio_jitter.silence = NULL;
+    }
 }
 
 static int audio_submit(IHS_Session *session, IHS_Buffer *data, void *context) {
     (void) session;
     stream_media_session_t *media_session = (stream_media_session_t *) context;
-    int decode_len = opus_multistream_decode(media_session->opus_decoder, data->data + data->offset, data->size,
-                                             media_session->pcm_buffer, media_session->pcm_buffer_size, 0);
-    return SS4S_PlayerAudioFeed(media_session->player, (const unsigned char *) media_session->pcm_buffer,
-                                media_session->pcm_unit_size * decode_len);
+    if (media_session->recorder != NULL) {
+        stream_recorder_write(media_session->recorder, STREAM_RECORD_AUDIO_PACKET, 0, data->data + data->offset,
+                              data->size);
+    }
+    Uint64 received = SDL_GetPerformanceCounter();
+    if (media_session->audio_worker.ring == NULL) {
+        return audio_decode(media_session, data->data + data->offset, (int) data->size, received);
+    }
+    frame_ring_slot_t *slot = frame_ring_write_begin(media_session->audio_worker.ring, data->size);
+    if (slot == NULL) {
+        frame_ring_mark_dropped(media_session->audio_worker.ring);
+        return 0;
+    }
+    memcpy(slot->data, data->data + data->offset, data->size);
+    slot->size = data->size;
+    slot->timestamp = received;
+    frame_ring_write_commit(media_session->audio_worker.ring);
+    SDL_SemPost(media_session->audio_worker.sem);
+    return 0;
+}
+
+/**
+ * Decode a packet and feed it, once enough samples are collected for a batch. The session doesn't tell packet
+ * sequence numbers, so with loss concealment a packet arriving after a gap is held until the next one. If that one
+ * follows back to back, the packets were only late. Otherwise the frames missing in the gap are concealed.
+ * @param received When the packet arrived, to detect lost packets
+ */
+static int audio_decode(stream_media_session_t *media_session, const unsigned char *packet, int size,
+                        Uint64 received) {
+    if (!media_session->audio_loss.enabled) {
+        return audio_decode_packet(media_session, packet, size, 0, received);
+    }
+    int held_ret = 0;
+    if (media_session->audio_loss.held_size > 0) {
+        bool late = received - media_session->audio_loss.held_arrival < media_session->audio_loss.frame_ticks / 2;
+        if (late) {
+            media_session->audio_loss.late++;
+        }
+        held_ret = audio_decode_packet(media_session, media_session->audio_loss.held,
+                                       media_session->audio_loss.held_size,
+                                       late ? 0 : media_session->audio_loss.held_missing,
+                                       media_session->audio_loss.held_arrival);
+        media_session->audio_loss.held_size = 0;
+    }
+    Uint64 last = media_session->audio_loss.last_arrival;
+    media_session->audio_loss.last_arrival = received;
+    if (last != 0 && size <= AUDIO_LOSS_HELD_MAX_SIZE) {
+        Uint64 gap_frames = (received - last) / media_session->audio_loss.frame_ticks;
+        if (gap_frames >= AUDIO_LOSS_MIN_GAP_FRAMES && gap_frames <= AUDIO_CONCEAL_MAX_FRAMES) {
+            memcpy(media_session->audio_loss.held, packet, size);
+            media_session->audio_loss.held_size = size;
+            media_session->audio_loss.held_missing = (int) gap_frames - 1;
+            media_session->audio_loss.held_arrival = received;
+            return held_ret;
+        }
+    }
+    int ret = audio_decode_packet(media_session, packet, size, 0, received);
+    return ret != 0 ? ret : held_ret;
+}
+
+/**
+ * @param missing Frames lost right before this packet, to conceal first
+ */
+static int audio_decode_packet(stream_media_session_t *media_session, const unsigned char *packet, int size,
+                               int missing, Uint64 received) {
+    int pending = media_session->audio_batch.pending_samples;
+    if (missing > 0) {
+        pending += audio_conceal_loss(media_session, packet, size, pending, missing);
+    }
+    int channels = (int) (media_session->pcm_unit_size / sizeof(int16_t));
+    int decode_len = opus_multistream_decode(media_session->opus_decoder, packet, size,
+                                             media_session->pcm_buffer + pending * channels,
+                                             media_session->pcm_buffer_size - pending, 0);
+    if (decode_len > 0) {
+        pending += decode_len;
+    }
+    if (pending < media_session->audio_batch.samples) {
+        media_session->audio_batch.pending_samples = pending;
+        return 0;
+    }
+    media_session->audio_batch.pending_samples = 0;
+    return audio_feed(media_session, pending, received);
+}
+
+/**
+ * Feed decoded samples at the start of pcm_buffer, through the playout buffer if enabled.
+ * @param received When the last packet of the samples arrived
+ */
+static int audio_feed(stream_media_session_t *media_session, int samples, Uint64 received) {
+    if (media_session->audio_jitter.enabled) {
+        samples = audio_jitter_adjust(media_session, samples);
+    }
+    if (samples <= 0) {
+        return 0;
+    }
+    int ret = audio_feed_player(media_session, media_session->pcm_buffer, samples);
+    av_sync_measure_audio(media_session, received);
+    return ret;
+}
+
+static int audio_feed_player(stream_media_session_t *media_session, const int16_t *pcm, int samples) {
+    Uint64 begin = SDL_GetPerformanceCounter();
+    int ret = SS4S_PlayerAudioFeed(media_session->player, (const unsigned char *) pcm,
+                                   media_session->pcm_unit_size * samples);
+    media_session->audio_batch.feed_time += SDL_GetPerformanceCounter() - begin;
+    media_session->audio_batch.feed_calls++;
+    return ret;
+}
+
+/**
+ * Keep the decoder queue near its target depth. The queue is filled with silence when playout starts or the queue ran
+ * dry, so it can absorb jitter. Drift between host and local clocks is corrected by dropping or repeating a few
+ * samples of each packet, and packets are dropped when far over target, e.g. after a burst.
+ * @return Samples per channel to feed, pcm_buffer may have been extended
+ */
+static int audio_jitter_adjust(stream_media_session_t *media_session, int samples) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    int frequency = media_session->audio_jitter.frequency, target_us = audio_jitter_target(media_session);
+    int64_t depth_us = 0;
+    if (media_session->audio_jitter.clock_start != 0) {
+        int64_t elapsed_us = (int64_t) ((now - media_session->audio_jitter.clock_start) * 1000000 /
+                                        media_session->latency.counter_frequency);
+        depth_us = (int64_t) (media_session->audio_jitter.fed_samples * 1000000 / frequency) - elapsed_us;
+    }
+    if (media_session->audio_jitter.clock_start == 0 || depth_us < 0) {
+        if (media_session->audio_jitter.clock_start != 0) {
+            media_session->audio_jitter.underruns++;
+        }
+        int silence_samples = (int) ((int64_t) target_us * frequency / 1000000);
+        audio_feed_player(media_session, media_session->audio_jitter.silence, silence_samples);
+        media_session->audio_jitter.clock_start = now;
+        media_session->audio_jitter.fed_samples = silence_samples;
+        media_session->audio_jitter.depth_avg_us = target_us;
+        depth_us = target_us;
+    }
+    media_session->audio_jitter.depth_avg_us += (depth_us - media_session->audio_jitter.depth_avg_us) /
+                                                AUDIO_JITTER_SMOOTHING;
+    if (depth_us > (int64_t) target_us * AUDIO_JITTER_MAX_FACTOR) {
+        media_session->audio_jitter.dropped_packets++;
+        return 0;
+    }
+    int correction = samples / AUDIO_DRIFT_CORRECTION_DIVISOR;
+    if (media_session->audio_jitter.depth_avg_us > target_us + AUDIO_JITTER_WINDOW_US) {
+        // Shorten the packet
+        samples -= correction;
+        media_session->audio_jitter.dropped_samples += correction;
+    } else if (media_session->audio_jitter.depth_avg_us < target_us - AUDIO_JITTER_WINDOW_US &&
+               samples > 0 && samples + correction <= media_session->pcm_buffer_size) {
+        // Extend the packet by repeating its last sample
+        int channels = (int) (media_session->pcm_unit_size / sizeof(int16_t));
+        const int16_t *last = media_session->pcm_buffer + (samples - 1) * channels;
+        for (int i = 0; i < correction; i++) {
+            memcpy(media_session->pcm_buffer + (samples + i) * channels, last, media_session->pcm_unit_size);
+        }
+        samples += correction;
+        media_session->audio_jitter.inserted_samples += correction;
+    }
+    media_session->audio_jitter.fed_samples += samples;
+    return samples;
+}
+
+/**
+ * With automatic A/V sync, audio is queued long enough to be played when video of the same time is shown.
+ */
+static int audio_jitter_target(stream_media_session_t *media_session) {
+    int target_us = media_session->audio_jitter.target_us + media_session->av_sync.audio_delay_us;
+    int video_delay_us = SDL_AtomicGet(&media_session->av_sync.video_delay_us);
+    if (media_session->av_sync.auto_delay && video_delay_us > 0) {
+        int video_lag_us = video_delay_us + media_session->av_sync.video_display_us -
+                           (int) media_session->av_sync.audio_processing_us;
+        if (video_lag_us > AV_SYNC_MAX_DELAY_US) {
+            video_lag_us = AV_SYNC_MAX_DELAY_US;
+        }
+        if (video_lag_us > target_us) {
+            target_us = video_lag_us;
+        }
+    }
+    return target_us > AUDIO_JITTER_MIN_TARGET_US ? target_us : AUDIO_JITTER_MIN_TARGET_US;
+}
+
+/**
+ * Called after audio was fed. Audio delay is the processing time plus what is queued ahead in the decoder.
+ */
+static void av_sync_measure_audio(stream_media_session_t *media_session, Uint64 received) {
+    int64_t processing_us = (int64_t) ((SDL_GetPerformanceCounter() - received) * 1000000 /
+                                       media_session->latency.counter_frequency);
+    if (media_session->av_sync.audio_processing_us == 0) {
+        media_session->av_sync.audio_processing_us = processing_us;
+    } else {
+        media_session->av_sync.audio_processing_us += (processing_us - media_session->av_sync.audio_processing_us) /
+                                                      AV_SYNC_SMOOTHING;
+    }
+    int video_delay_us = SDL_AtomicGet(&media_session->av_sync.video_delay_us);
+    if (video_delay_us == 0) {
+        return;
+    }
+    int64_t audio_delay_us = media_session->av_sync.audio_processing_us;
+    if (media_session->audio_jitter.enabled) {
+        audio_delay_us += media_session->audio_jitter.depth_avg_us;
+    }
+    int64_t offset_us = video_delay_us + media_session->av_sync.video_display_us - audio_delay_us;
+    if (media_session->av_sync.measurements == 0) {
+        media_session->av_sync.offset_avg_us = offset_us;
+        media_session->av_sync.offset_min_us = offset_us;
+        media_session->av_sync.offset_max_us = offset_us;
+    } else {
+        media_session->av_sync.offset_avg_us += (offset_us - media_session->av_sync.offset_avg_us) /
+                                                AV_SYNC_SMOOTHING;
+        if (offset_us < media_session->av_sync.offset_min_us) {
+            media_session->av_sync.offset_min_us = offset_us;
+        } else if (offset_us > media_session->av_sync.offset_max_us) {
+            media_session->av_sync.offset_max_us = offset_us;
+        }
+    }
+    media_session->av_sync.measurements++;
+    SDL_AtomicSet(&media_session->av_sync.offset_ms, (int) (media_session->av_sync.offset_avg_us / 1000));
+    SDL_AtomicSet(&media_session->av_sync.offset_valid, 1);
+}
+
+/**
+ * Called by the thread feeding video, after a frame was fed.
+ */
+static void av_sync_measure_video(stream_media_session_t *media_session, Uint64 received, Uint64 fed) {
+    int delay_us = (int) ((fed - received) * 1000000 / media_session->latency.counter_frequency);
+    int avg_us = SDL_AtomicGet(&media_session->av_sync.video_delay_us);
+    if (avg_us == 0) {
+        avg_us = delay_us > 0 ? delay_us : 1;
+    } else {
+        avg_us += (delay_us - avg_us) / AV_SYNC_SMOOTHING;
+    }
+    SDL_AtomicSet(&media_session->av_sync.video_delay_us, avg_us);
+}
+
+/**
+ * Conceal frames lost before this packet. The last one is rebuilt from the FEC data of this packet if it has any,
+ * the others are synthesized by the decoder.
+ * @param offset Samples per channel already in pcm_buffer
+ * @return Samples per channel written to pcm_buffer after offset
+ */
+static int audio_conceal_loss(stream_media_session_t *media_session, const unsigned char *packet, int size,
+                              int offset, int missing) {
+    int channels = (int) (media_session->pcm_unit_size / sizeof(int16_t));
+    int samples_per_frame = media_session->audio_loss.samples_per_frame;
+    bool fec = audio_packet_has_lbrr(packet, size);
+    int written = 0;
+    for (int i = 0; i < missing; i++) {
+        bool recover = fec && i == missing - 1;
+        int len = opus_multistream_decode(media_session->opus_decoder, recover ? packet : NULL, recover ? size : 0,
+                                          media_session->pcm_buffer + (offset + written) * channels,
+                                          samples_per_frame, recover);
+        if (len <= 0) {
+            break;
+        }
+        written += len;
+        if (recover) {
+            media_session->audio_loss.recovered++;
+        } else {
+            media_session->audio_loss.concealed++;
+        }
+    }
+    return written;
+}
+
+/**
+ * Check if a single stream Opus packet carries FEC (LBRR) data of the previous frame, like opus_packet_has_lbrr of
+ * libopus 1.5. Only SILK and hybrid frames can, and the flag is in the first bits of the first SILK frame.
+ */
+static bool audio_packet_has_lbrr(const unsigned char *packet, int size) {
+    if (size < 1 || (packet[0] >> 3) >= 16) {
+        // CELT only
+        return false;
+    }
+    const unsigned char *frames[48];
+    opus_int16 sizes[48];
+    if (opus_packet_parse(packet, size, NULL, frames, sizes, NULL) <= 0 || sizes[0] == 0) {
+        return false;
+    }
+    int frame_samples = opus_packet_get_samples_per_frame(packet, 48000);
+    int silk_frames = frame_samples > 960 ? frame_samples / 960 : 1;
+    if ((frames[0][0] >> (7 - silk_frames)) & 1) {
+        return true;
+    }
+    return opus_packet_get_nb_channels(packet) == 2 && (frames[0][0] >> (6 - 2 * silk_frames)) & 1;
 }
 
 static int video_start(IHS_Session *session, const IHS_StreamVideoConfig *config, void *context) {
     (void) session;
     SS4S_VideoCodec codec;
+    stream_media_session_t *media_session = (stream_media_session_t *) context;
+    if (media_session->recorder != NULL) {
+        stream_recorder_write_config(media_session->recorder, STREAM_RECORD_VIDEO_START, config->codec,
+                                     config->width, config->height);
+    }
     switch (config->codec) {
         case IHS_StreamVideoCodecH264:
             codec = SS4S_VIDEO_H264;
             break;
         case IHS_StreamVideoCodecHEVC:
+            if (!stream_media_supports_hevc(media_session)) {
+                return -1;
+            }
             codec = SS4S_VIDEO_H265;
             break;
         default:
             return -1;
     }
-    stream_media_session_t *media_session = (stream_media_session_t *) context;
     SDL_LockMutex(media_session->lock);
     app_log_info("Media", "Video start. codec=%u, width=%u, height=%u", config->codec, config->width, config->height);
     SS4S_VideoInfo info = {
@@ -187,13 +865,75 @@ static int video_start(IHS_Session *session, const IHS_StreamVideoConfig *config
     };
     media_session->video_info = info;
     SDL_UnlockMutex(media_session->lock);
-    return SS4S_PlayerVideoOpen(media_session->player, &info);
+    media_session->sps_cache.size = 0;
+    media_session->sps_cache.hits = 0;
+    media_session->sps_cache.misses = 0;
+    media_session->sps_rewrite.rewrites = 0;
+    media_session->sps_rewrite.replaced = 0;
+    media_session->video_opened = false;
+    media_session->video_configured = false;
+    media_session->video_reopen = false;
+    media_session->nal_filter.drop_types = video_nal_filter_types(codec, media_session->manager->app->settings);
+    media_session->nal_filter.bytes_saved = 0;
+    media_session->nal_filter.frames_filtered = 0;
+    memset(&media_session->frame_order.slice_state, 0, sizeof(sps_slice_state_t));
+    memset(&media_session->frame_order.order, 0, sizeof(sps_frame_order_t));
+    media_session->frame_order.gap_ticks = 0;
+    media_session->frame_order.gaps = 0;
+    media_session->frame_order.recoveries = 0;
+    media_session->frame_order.dropped = 0;
+    media_session->frame_order.recovery_total_ms = 0;
+    media_session->frame_order.recovery_max_ms = 0;
+    video_latency_reset(media_session);
+    SDL_AtomicSet(&media_session->av_sync.video_delay_us, 0);
+    int ret = SS4S_PlayerVideoOpen(media_session->player, &info);
+    if (ret != 0) {
+        app_log_error("Media", "Failed to open video player");
+        return ret;
+    }
+    media_session->video_opened = true;
+    if (media_session->feeder.enabled && !video_feeder_start(media_session)) {
+        app_log_warn("Media", "Failed to start video feeder thread, feeding from receive thread");
+    }
+    return 0;
 }
 
 static void video_stop(IHS_Session *session, void *context) {
     (void) session;
     stream_media_session_t *media_session = (stream_media_session_t *) context;
-    SS4S_PlayerVideoClose(media_session->player);
+    if (media_session->recorder != NULL) {
+        stream_recorder_write(media_session->recorder, STREAM_RECORD_VIDEO_STOP, 0, NULL, 0);
+    }
+    video_feeder_stop(media_session);
+    app_log_info("Media", "Video stop. sps_cache_hits=%u, sps_cache_misses=%u, sps_rewrites=%u, sps_replaced=%u",
+                 media_session->sps_cache.hits, media_session->sps_cache.misses, media_session->sps_rewrite.rewrites,
+                 media_session->sps_rewrite.replaced);
+    if (media_session->nal_filter.drop_types != 0) {
+        app_log_info("Media", "NAL filter saved %llu bytes in %u frames",
+                     (unsigned long long) media_session->nal_filter.bytes_saved,
+                     media_session->nal_filter.frames_filtered);
+    }
+    for (int i = 0; i < STREAM_MEDIA_LATENCY_STAGE_COUNT; i++) {
+        latency_summary_t summary;
+        stream_media_get_video_latency(media_session, i, &summary);
+        if (summary.count == 0) {
+            continue;
+        }
+        app_log_info("Media", "Video latency %s: count=%u, p50=%uus, p95=%uus, p99=%uus, max=%uus",
+                     stream_media_latency_stage_name(i), summary.count, summary.p50_us, summary.p95_us,
+                     summary.p99_us, summary.max_us);
+    }
+    if (media_session->frame_order.enabled) {
+        uint32_t recoveries = media_session->frame_order.recoveries;
+        app_log_info("Media", "Frame gaps=%u, recoveries=%u, dropped=%u, recovery_avg=%ums, recovery_max=%ums",
+                     media_session->frame_order.gaps, recoveries, media_session->frame_order.dropped,
+                     recoveries > 0 ? media_session->frame_order.recovery_total_ms / recoveries : 0,
+                     media_session->frame_order.recovery_max_ms);
+    }
+    if (media_session->video_opened) {
+        SS4S_PlayerVideoClose(media_session->player);
+        media_session->video_opened = false;
+    }
 }
 
 static int video_submit(IHS_Session *session, IHS_Buffer *data, IHS_StreamVideoFrameFlag flags, void *context) {
@@ -201,41 +941,347 @@ static int video_submit(IHS_Session *session, IHS_Buffer *data, IHS_StreamVideoF
     stream_media_session_t *media_session = (stream_media_session_t *) context;
     SS4S_VideoFeedFlags sflgs = 0;
     if (flags & IHS_StreamVideoFrameKeyFrame) {
-        SDL_LockMutex(media_session->lock);
         sflgs = SS4S_VIDEO_FEED_DATA_KEYFRAME;
-        sps_dimension_t dimension = {0, 0};
-        bool dimension_parsed = false;
-        switch (media_session->video_info.codec) {
-            case SS4S_VIDEO_H264: {
-                dimension_parsed = sps_util_parse_dimension_h264(IHS_BufferPointer(data), data->size, &dimension);
-                break;
+    }
+    Uint64 received = SDL_GetPerformanceCounter();
+    unsigned char *frame = IHS_BufferPointer(data);
+    size_t size = data->size;
+    if (media_session->recorder != NULL) {
+        // Recorded before filtering, exactly as received
+        stream_recorder_write(media_session->recorder, STREAM_RECORD_VIDEO_FRAME,
+                              sflgs & SS4S_VIDEO_FEED_DATA_KEYFRAME ? STREAM_RECORD_FLAG_KEYFRAME : 0, frame, size);
+    }
+    uint64_t drop_types = media_session->nal_filter.drop_types;
+    if (drop_types != 0) {
+        // Buffer is owned by the session until this callback returns, so it's compacted in place
+        size_t filtered_size = media_session->video_info.codec == SS4S_VIDEO_H265 ?
+                               sps_util_nal_filter_hevc(frame, size, drop_types) :
+                               sps_util_nal_filter_h264(frame, size, drop_types);
+        if (filtered_size < size) {
+            media_session->nal_filter.bytes_saved += size - filtered_size;
+            media_session->nal_filter.frames_filtered++;
+            size = filtered_size;
+        }
+    }
+    if (media_session->feeder.ring != NULL) {
+        return video_feeder_submit(media_session, frame, size, sflgs, received);
+    }
+    return video_feed(media_session, frame, size, sflgs, received);
+}
+
+/**
+ * @param received Performance counter when the frame was submitted by the session
+ */
+static int video_feed(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                      SS4S_VideoFeedFlags flags, Uint64 received) {
+    if (flags & SS4S_VIDEO_FEED_DATA_KEYFRAME) {
+        Uint64 sps_begin = SDL_GetPerformanceCounter();
+        const unsigned char *sps;
+        size_t sps_size;
+        if (video_check_sps(media_session, data, size, &sps, &sps_size) &&
+            media_session->sps_cache.rewritten_size > 0) {
+            data = video_replace_sps(media_session, data, &size, sps, sps_size);
+        }
+        video_latency_record(media_session, STREAM_MEDIA_LATENCY_SPS, sps_begin, SDL_GetPerformanceCounter());
+    }
+    bool request_keyframe = false;
+    if (media_session->frame_order.enabled &&
+        !video_check_frame_order(media_session, data, size, flags & SS4S_VIDEO_FEED_DATA_KEYFRAME,
+                                 &request_keyframe)) {
+        return request_keyframe ? SS4S_VIDEO_FEED_REQUEST_KEYFRAME : SS4S_VIDEO_FEED_OK;
+    }
+    if (media_session->video_reopen) {
+        media_session->video_reopen = false;
+        video_reopen(media_session);
+    }
+    if (!media_session->video_opened) {
+        // Session is being stopped
+        return SS4S_VIDEO_FEED_ERROR;
+    }
+    Uint64 feed_begin = SDL_GetPerformanceCounter();
+    int ret = SS4S_PlayerVideoFeed(media_session->player, data, size, flags);
+    Uint64 feed_end = SDL_GetPerformanceCounter();
+    video_latency_record(media_session, STREAM_MEDIA_LATENCY_FEED, feed_begin, feed_end);
+    video_latency_record(media_session, STREAM_MEDIA_LATENCY_TOTAL, received, feed_end);
+    av_sync_measure_video(media_session, received, feed_end);
+    return ret;
+}
+
+/**
+ * Reopen the player with the parameters of the first SPS. The session is stopped if it can't be opened again.
+ */
+static bool video_reopen(stream_media_session_t *media_session) {
+    const SS4S_VideoInfo *info = &media_session->video_info;
+    app_log_info("Media", "Reopening video player for SPS parameters. width=%d, height=%d, fps=%d/%d", info->width,
+                 info->height, info->frameRateNumerator, info->frameRateDenominator);
+    SS4S_PlayerVideoClose(media_session->player);
+    if (SS4S_PlayerVideoOpen(media_session->player, info) != 0) {
+        app_log_error("Media", "Failed to reopen video player");
+        media_session->video_opened = false;
+        stream_manager_stop_on_error(media_session->manager);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Parse SPS of a keyframe, unless the SPS is byte-identical to the last successfully parsed one.
+ * @return true if the SPS is found and now in cache
+ */
+static bool video_check_sps(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                            const unsigned char **sps_out, size_t *sps_size_out) {
+    const unsigned char *sps = NULL;
+    size_t sps_size = 0;
+    bool sps_found = false;
+    // Codec is only changed in video_start, before any frame is fed
+    switch (media_session->video_info.codec) {
+        case SS4S_VIDEO_H264: {
+            sps_found = sps_util_find_sps_h264(data, size, &sps, &sps_size);
+            break;
+        }
+        case SS4S_VIDEO_H265: {
+            sps_found = sps_util_find_sps_hevc(data, size, &sps, &sps_size);
+            break;
+        }
+        default: {
+            app_log_fatal("Media", "Unexpected video codec %s!!",
+                          SS4S_VideoCodecName(media_session->video_info.codec));
+            abort();
+        }
+    }
+    if (sps_found && sps_size == media_session->sps_cache.size &&
+        memcmp(sps, media_session->sps_cache.data, sps_size) == 0) {
+        media_session->sps_cache.hits++;
+        *sps_out = sps;
+        *sps_size_out = sps_size;
+        return true;
+    }
+    media_session->sps_cache.misses++;
+
+    sps_info_t info;
+    bool info_parsed = sps_found && video_parse_sps(media_session, sps, sps_size, &info);
+    if (!info_parsed) {
+        app_log_warn("Media", "Can't parse NAL Unit.");
+        app_log_hexdump(APP_LOG_LEVEL_WARN, "Media", data, size);
+    } else {
+        app_log_info("Media", "SPS: profile=%u, level=%u, chroma_format=%u, bit_depth=%u, reorder=%d, dpb=%d, "
+                              "fps=%u/%u, colour=%u/%u/%u, full_range=%d", info.profile_idc, info.level_idc,
+                     info.chroma_format_idc, info.bit_depth_luma, info.max_num_reorder_frames,
+                     info.max_dec_frame_buffering, info.frame_rate_num, info.frame_rate_den, info.colour_primaries,
+                     info.transfer_characteristics, info.matrix_coefficients, info.full_range);
+    }
+
+    Uint64 lock_begin = SDL_GetPerformanceCounter();
+    SDL_LockMutex(media_session->lock);
+    if (info_parsed && !media_session->video_configured) {
+        // Player was opened with what the session announced, SPS tells the exact parameters
+        SS4S_VideoInfo *video_info = &media_session->video_info;
+        bool changed = info.dimension.width != video_info->width || info.dimension.height != video_info->height;
+        video_info->width = info.dimension.width;
+        video_info->height = info.dimension.height;
+        if (info.frame_rate_den > 0) {
+            changed |= video_info->frameRateNumerator != (int) info.frame_rate_num ||
+                       video_info->frameRateDenominator != (int) info.frame_rate_den;
+            video_info->frameRateNumerator = (int) info.frame_rate_num;
+            video_info->frameRateDenominator = (int) info.frame_rate_den;
+        }
+        media_session->video_configured = true;
+        media_session->video_reopen = changed;
+    } else if (info_parsed && (info.dimension.width != media_session->video_info.width ||
+                               info.dimension.height != media_session->video_info.height)) {
+        app_log_info("Media", "Size change detected by NAL header. (%d*%d)=>(%d*%d)",
+                     media_session->video_info.width, media_session->video_info.height, info.dimension.width,
+                     info.dimension.height);
+        media_session->video_info.width = info.dimension.width;
+        media_session->video_info.height = info.dimension.height;
+        SS4S_PlayerVideoSizeChanged(media_session->player, info.dimension.width, info.dimension.height);
+    }
+    SDL_UnlockMutex(media_session->lock);
+    video_latency_record(media_session, STREAM_MEDIA_LATENCY_SPS_LOCK, lock_begin, SDL_GetPerformanceCounter());
+    if (info_parsed && info.frame_rate_num > 0) {
+        SDL_AtomicSet(&media_session->feeder.frame_interval_us,
+                      (int) ((uint64_t) info.frame_rate_den * 1000000 / info.frame_rate_num));
+    }
+    if (info_parsed) {
+        sps_util_slice_state_set_sps(&media_session->frame_order.slice_state, &info);
+        // Slices refer to these by index, and gaps are only reported when a picture of their set is missing
+        if (media_session->video_info.codec == SS4S_VIDEO_H265 &&
+            !sps_util_slice_state_set_ref_pic_sets_hevc(&media_session->frame_order.slice_state, sps, sps_size,
+                                                        &media_session->rbsp_scratch)) {
+            app_log_warn("Media", "Can't read reference picture sets, frame gaps won't be detected");
+        }
+    }
+
+    media_session->sps_cache.rewritten_size = 0;
+    if (!info_parsed || sps_size > sizeof(media_session->sps_cache.data)) {
+        media_session->sps_cache.size = 0;
+        return false;
+    }
+    memcpy(media_session->sps_cache.data, sps, sps_size);
+    media_session->sps_cache.size = sps_size;
+    if (media_session->sps_rewrite.enabled) {
+        video_rewrite_sps(media_session, sps, sps_size);
+    }
+    *sps_out = sps;
+    *sps_size_out = sps_size;
+    return true;
+}
+
+static bool video_parse_sps(stream_media_session_t *media_session, const unsigned char *sps, size_t sps_size,
+                            sps_info_t *info) {
+    switch (media_session->video_info.codec) {
+        case SS4S_VIDEO_H264:
+            return sps_util_parse_sps_info_h264(sps, sps_size, &media_session->rbsp_scratch, info);
+        case SS4S_VIDEO_H265:
+            return sps_util_parse_sps_info_hevc(sps, sps_size, &media_session->rbsp_scratch, info);
+        default:
+            return false;
+    }
+}
+
+static uint64_t video_nal_filter_types(SS4S_VideoCodec codec, const app_settings_t *settings) {
+    uint64_t types = 0;
+    switch (codec) {
+        case SS4S_VIDEO_H264:
+            if (settings->video_strip_sei) {
+                types |= SPS_NAL_TYPE_BIT(SPS_NAL_H264_SEI);
             }
-            case SS4S_VIDEO_H265: {
-                dimension_parsed = sps_util_parse_dimension_hevc(IHS_BufferPointer(data), data->size, &dimension);
-                break;
+            if (settings->video_strip_filler) {
+                types |= SPS_NAL_TYPE_BIT(SPS_NAL_H264_FILLER);
+            }
+            if (settings->video_strip_aud) {
+                types |= SPS_NAL_TYPE_BIT(SPS_NAL_H264_AUD);
+            }
+            break;
+        case SS4S_VIDEO_H265:
+            if (settings->video_strip_sei) {
+                types |= SPS_NAL_TYPE_BIT(SPS_NAL_HEVC_PREFIX_SEI) | SPS_NAL_TYPE_BIT(SPS_NAL_HEVC_SUFFIX_SEI);
+            }
+            if (settings->video_strip_filler) {
+                types |= SPS_NAL_TYPE_BIT(SPS_NAL_HEVC_FILLER);
             }
-            default: {
-                app_log_fatal("Media", "Unexpected video codec %s!!",
-                              SS4S_VideoCodecName(media_session->video_info.codec));
-                abort();
+            if (settings->video_strip_aud) {
+                types |= SPS_NAL_TYPE_BIT(SPS_NAL_HEVC_AUD);
             }
+            break;
+        default:
+            break;
+    }
+    return types;
+}
+
+/**
+ * Follow frame order of reference frames. Once one is missing, every frame until next IDR would be decoded from a
+ * corrupted reference, so they're not fed, and a keyframe is requested from the host.
+ * @return false if the frame must not be fed
+ */
+static bool video_check_frame_order(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                                    bool keyframe, bool *request_keyframe) {
+    sps_slice_state_t *state = &media_session->frame_order.slice_state;
+    sps_frame_order_t *order = &media_session->frame_order.order;
+    sps_frame_header_t header;
+    bool in_order;
+    switch (media_session->video_info.codec) {
+        case SS4S_VIDEO_H264:
+            if (!sps_util_parse_frame_header_h264(data, size, state, &header)) {
+                return true;
+            }
+            in_order = sps_util_frame_order_check_h264(order, state, &header);
+            break;
+        case SS4S_VIDEO_H265:
+            if (!sps_util_parse_frame_header_hevc(data, size, state, &header)) {
+                return true;
+            }
+            in_order = sps_util_frame_order_check_hevc(order, state, &header);
+            break;
+        default:
+            return true;
+    }
+    Uint32 now = SDL_GetTicks();
+    if (!in_order) {
+        media_session->frame_order.dropped++;
+        if (media_session->frame_order.gap_ticks == 0) {
+            app_log_warn("Media", "Reference frame missing before %s frame %u, dropping until next keyframe",
+                         sps_util_frame_type_name(header.type), header.order);
+            media_session->frame_order.gaps++;
+            // 0 means no gap
+            media_session->frame_order.gap_ticks = now != 0 ? now : 1;
+            media_session->frame_order.request_ticks = now;
+            *request_keyframe = true;
+        } else if (SDL_TICKS_PASSED(now, media_session->frame_order.request_ticks + KEYFRAME_REQUEST_INTERVAL_MS)) {
+            media_session->frame_order.request_ticks = now;
+            *request_keyframe = true;
         }
-        if (!dimension_parsed) {
-            app_log_warn("Media", "Can't parse NAL Unit.");
-            app_log_hexdump(APP_LOG_LEVEL_WARN, "Media", IHS_BufferPointer(data), data->size);
+        return false;
+    }
+    if (media_session->frame_order.gap_ticks != 0 && (keyframe || header.type == SPS_FRAME_IDR)) {
+        uint32_t recovery_ms = now - media_session->frame_order.gap_ticks;
+        app_log_info("Media", "Recovered from missing reference frame in %ums", recovery_ms);
+        media_session->frame_order.gap_ticks = 0;
+        media_session->frame_order.recoveries++;
+        media_session->frame_order.recovery_total_ms += recovery_ms;
+        if (recovery_ms > media_session->frame_order.recovery_max_ms) {
+            media_session->frame_order.recovery_max_ms = recovery_ms;
         }
-        if (dimension_parsed && (dimension.width != media_session->video_info.width ||
-                                 dimension.height != media_session->video_info.height)) {
-            app_log_info("Media", "Size change detected by NAL header. (%d*%d)=>(%d*%d)",
-                         media_session->video_info.width, media_session->video_info.height, dimension.width,
-                         dimension.height);
-            media_session->video_info.width = dimension.width;
-            media_session->video_info.height = dimension.height;
-            SS4S_PlayerVideoSizeChanged(media_session->player, dimension.width, dimension.height);
+    }
+    return true;
+}
+
+/**
+ * Store the low latency version of a newly cached SPS, so it's rewritten only once.
+ */
+static void video_rewrite_sps(stream_media_session_t *media_session, const unsigned char *sps, size_t sps_size) {
+    unsigned char *rewritten = media_session->sps_cache.rewritten;
+    size_t rewritten_size = 0;
+    bool ok;
+    switch (media_session->video_info.codec) {
+        case SS4S_VIDEO_H264:
+            ok = sps_util_rewrite_sps_low_latency_h264(sps, sps_size, &media_session->rbsp_scratch, rewritten,
+                                                       SPS_UTIL_REWRITE_MAX_SIZE, &rewritten_size);
+            break;
+        case SS4S_VIDEO_H265:
+            ok = sps_util_rewrite_sps_low_latency_hevc(sps, sps_size, &media_session->rbsp_scratch, rewritten,
+                                                       SPS_UTIL_REWRITE_MAX_SIZE, &rewritten_size);
+            break;
+        default:
+            ok = false;
+            break;
+    }
+    if (!ok) {
+        app_log_warn("Media", "Failed to rewrite SPS, feeding it unchanged");
+        return;
+    }
+    media_session->sps_rewrite.rewrites++;
+    if (rewritten_size == sps_size && memcmp(rewritten, sps, sps_size) == 0) {
+        // Stream is already low latency
+        return;
+    }
+    media_session->sps_cache.rewritten_size = rewritten_size;
+}
+
+/**
+ * @return Copy of the frame with the SPS replaced by its rewritten version, or the frame itself if out of memory
+ */
+static const unsigned char *video_replace_sps(stream_media_session_t *media_session, const unsigned char *data,
+                                              size_t *size, const unsigned char *sps, size_t sps_size) {
+    size_t rewritten_size = media_session->sps_cache.rewritten_size;
+    size_t frame_size = *size - sps_size + rewritten_size;
+    if (media_session->sps_rewrite.frame_capacity < frame_size) {
+        unsigned char *frame = realloc(media_session->sps_rewrite.frame, frame_size);
+        if (frame == NULL) {
+            return data;
         }
-        SDL_UnlockMutex(media_session->lock);
+        media_session->sps_rewrite.frame = frame;
+        media_session->sps_rewrite.frame_capacity = frame_size;
     }
-    return SS4S_PlayerVideoFeed(media_session->player, data->data + data->offset, data->size, sflgs);
+    unsigned char *frame = media_session->sps_rewrite.frame;
+    size_t prefix_size = sps - data, suffix_size = *size - prefix_size - sps_size;
+    memcpy(frame, data, prefix_size);
+    memcpy(frame + prefix_size, media_session->sps_cache.rewritten, rewritten_size);
+    memcpy(frame + prefix_size + rewritten_size, sps + sps_size, suffix_size);
+    media_session->sps_rewrite.replaced++;
+    *size = frame_size;
+    return frame;
 }
 
 static int video_set_capture_size(IHS_Session *session, int width, int height, void *context) {
@@ -243,4 +1289,242 @@ static int video_set_capture_size(IHS_Session *session, int width, int height, v
     stream_media_session_t *media_session = (stream_media_session_t *) context;
     stream_manager_set_capture_size(media_session->manager, width, height);
     return 0;
-}
\ No newline at end of file
+}
+
+static bool audio_worker_start(stream_media_session_t *media_session) {
+    assert(media_session->audio_worker.ring == NULL);
+    /* Opus packets of 5ms are a few hundred bytes at most */
+    frame_ring_t *ring = frame_ring_create(AUDIO_WORKER_QUEUE_SIZE, 1500);
+    if (ring == NULL) {
+        return false;
+    }
+    media_session->audio_worker.sem = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&media_session->audio_worker.running, 1);
+    media_session->audio_worker.ring = ring;
+    media_session->audio_worker.thread = SDL_CreateThread(audio_worker, "audio_decoder", media_session);
+    if (media_session->audio_worker.thread == NULL) {
+        media_session->audio_worker.ring = NULL;
+        frame_ring_destroy(ring);
+        SDL_DestroySemaphore(media_session->audio_worker.sem);
+        media_session->audio_worker.sem = NULL;
+        return false;
+    }
+    app_log_info("Media", "Audio decoder thread started. high_priority=%d", media_session->audio_worker.high_priority);
+    return true;
+}
+
+/**
+ * Packets already queued are decoded and fed before the thread exits.
+ */
+static void audio_worker_stop(stream_media_session_t *media_session) {
+    frame_ring_t *ring = media_session->audio_worker.ring;
+    if (ring == NULL) {
+        return;
+    }
+    SDL_AtomicSet(&media_session->audio_worker.running, 0);
+    SDL_SemPost(media_session->audio_worker.sem);
+    SDL_WaitThread(media_session->audio_worker.thread, NULL);
+    media_session->audio_worker.thread = NULL;
+
+    frame_ring_stats_t stats;
+    frame_ring_get_stats(ring, &stats);
+    app_log_info("Media", "Audio decoder thread stopped. pushed=%u, dropped=%u, high_watermark=%d/%d",
+                 stats.pushed, stats.dropped, stats.high_watermark, stats.capacity);
+
+    media_session->audio_worker.ring = NULL;
+    frame_ring_destroy(ring);
+    SDL_DestroySemaphore(media_session->audio_worker.sem);
+    media_session->audio_worker.sem = NULL;
+}
+
+static int audio_worker(void *context) {
+    stream_media_session_t *media_session = context;
+    frame_ring_t *ring = media_session->audio_worker.ring;
+    if (media_session->audio_worker.high_priority && SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) != 0) {
+        app_log_warn("Media", "Failed to raise audio decoder thread priority: %s", SDL_GetError());
+    }
+    while (SDL_SemWait(media_session->audio_worker.sem) == 0) {
+        frame_ring_slot_t *slot = frame_ring_read_begin(ring);
+        if (slot == NULL) {
+            if (!SDL_AtomicGet(&media_session->audio_worker.running)) {
+                break;
+            }
+            continue;
+        }
+        audio_decode(media_session, slot->data, (int) slot->size, slot->timestamp);
+        frame_ring_read_end(ring);
+    }
+    return 0;
+}
+
+static bool video_feeder_start(stream_media_session_t *media_session) {
+    assert(media_session->feeder.ring == NULL);
+    /* Initial slot size fits a typical 1080p P-frame, keyframes grow the slot on demand */
+    frame_ring_t *ring = frame_ring_create(media_session->feeder.queue_size, 256 * 1024);
+    if (ring == NULL) {
+        return false;
+    }
+    media_session->feeder.sem = SDL_CreateSemaphore(0);
+    media_session->feeder.wait_keyframe = false;
+    media_session->feeder.wait_reason = NULL;
+    memset(&media_session->feeder.slice_state, 0, sizeof(sps_slice_state_t));
+    SDL_AtomicSet(&media_session->feeder.frame_interval_us, DEFAULT_FRAME_INTERVAL_US);
+    SDL_AtomicSet(&media_session->feeder.drops.non_reference, 0);
+    SDL_AtomicSet(&media_session->feeder.drops.latency, 0);
+    SDL_AtomicSet(&media_session->feeder.drops.overflow, 0);
+    SDL_AtomicSet(&media_session->feeder.keyframe_requested, 0);
+    SDL_AtomicSet(&media_session->feeder.running, 1);
+    // Only the receive thread changes it, the lock is for the stats getters on other threads
+    SDL_LockMutex(media_session->lock);
+    media_session->feeder.ring = ring;
+    SDL_UnlockMutex(media_session->lock);
+    media_session->feeder.thread = SDL_CreateThread(video_feeder_worker, "video_feeder", media_session);
+    if (media_session->feeder.thread == NULL) {
+        SDL_LockMutex(media_session->lock);
+        media_session->feeder.ring = NULL;
+        SDL_UnlockMutex(media_session->lock);
+        frame_ring_destroy(ring);
+        SDL_DestroySemaphore(media_session->feeder.sem);
+        media_session->feeder.sem = NULL;
+        return false;
+    }
+    app_log_info("Media", "Video feeder thread started. queue_size=%d, latency_budget=%dms",
+                 media_session->feeder.queue_size, media_session->feeder.latency_budget_ms);
+    return true;
+}
+
+static void video_feeder_stop(stream_media_session_t *media_session) {
+    frame_ring_t *ring = media_session->feeder.ring;
+    if (ring == NULL) {
+        return;
+    }
+    SDL_AtomicSet(&media_session->feeder.running, 0);
+    SDL_SemPost(media_session->feeder.sem);
+    SDL_WaitThread(media_session->feeder.thread, NULL);
+    media_session->feeder.thread = NULL;
+
+    frame_ring_stats_t stats;
+    frame_ring_get_stats(ring, &stats);
+    app_log_info("Media", "Video feeder stopped. pushed=%u, dropped=%u (non_reference=%d, latency=%d, overflow=%d), "
+                          "high_watermark=%d/%d", stats.pushed, stats.dropped,
+                 SDL_AtomicGet(&media_session->feeder.drops.non_reference),
+                 SDL_AtomicGet(&media_session->feeder.drops.latency),
+                 SDL_AtomicGet(&media_session->feeder.drops.overflow), stats.high_watermark, stats.capacity);
+
+    SDL_LockMutex(media_session->lock);
+    media_session->feeder.ring = NULL;
+    SDL_UnlockMutex(media_session->lock);
+    frame_ring_destroy(ring);
+    SDL_DestroySemaphore(media_session->feeder.sem);
+    media_session->feeder.sem = NULL;
+}
+
+/**
+ * Called on the receive thread. Queued frames are converted to latency using the stream frame rate. Over the latency
+ * budget, non-reference frames are dropped, as no other frame depends on them. Over twice the budget, or when the
+ * queue is full, the frame is dropped and so is every following frame until next keyframe, as they would reference a
+ * frame the decoder never saw. A keyframe is requested from the host.
+ */
+static int video_feeder_submit(stream_media_session_t *media_session, const unsigned char *data, size_t size,
+                               SS4S_VideoFeedFlags flags, Uint64 received) {
+    frame_ring_t *ring = media_session->feeder.ring;
+    bool keyframe = flags & SS4S_VIDEO_FEED_DATA_KEYFRAME;
+    // Classify every frame, so PPS changes are always seen
+    sps_frame_type_t type = video_classify_frame(media_session, data, size);
+    if (media_session->feeder.wait_keyframe && !keyframe) {
+        video_feeder_drop(media_session, media_session->feeder.wait_reason);
+        return SS4S_VIDEO_FEED_OK;
+    }
+    int budget_ms = media_session->feeder.latency_budget_ms;
+    if (budget_ms > 0 && !keyframe) {
+        int latency_ms = (int) ((int64_t) frame_ring_occupancy(ring) *
+                                SDL_AtomicGet(&media_session->feeder.frame_interval_us) / 1000);
+        if (latency_ms > budget_ms * 2 && type != SPS_FRAME_IDR) {
+            app_log_warn("Media", "Video feeder %dms behind, dropping until next keyframe", latency_ms);
+            media_session->feeder.wait_keyframe = true;
+            media_session->feeder.wait_reason = &media_session->feeder.drops.latency;
+            video_feeder_drop(media_session, media_session->feeder.wait_reason);
+            return SS4S_VIDEO_FEED_REQUEST_KEYFRAME;
+        }
+        if (latency_ms > budget_ms && type == SPS_FRAME_NON_REF) {
+            video_feeder_drop(media_session, &media_session->feeder.drops.non_reference);
+            return SS4S_VIDEO_FEED_OK;
+        }
+    }
+    frame_ring_slot_t *slot = frame_ring_write_begin(ring, size);
+    if (slot == NULL) {
+        if (!media_session->feeder.wait_keyframe) {
+            app_log_warn("Media", "Video feeder queue full, dropping until next keyframe");
+        }
+        media_session->feeder.wait_keyframe = true;
+        media_session->feeder.wait_reason = &media_session->feeder.drops.overflow;
+        video_feeder_drop(media_session, media_session->feeder.wait_reason);
+        return SS4S_VIDEO_FEED_REQUEST_KEYFRAME;
+    }
+    memcpy(slot->data, data, size);
+    slot->size = size;
+    slot->flags = flags;
+    slot->timestamp = received;
+    frame_ring_write_commit(ring);
+    media_session->feeder.wait_keyframe = false;
+    SDL_SemPost(media_session->feeder.sem);
+    if (SDL_AtomicSet(&media_session->feeder.keyframe_requested, 0)) {
+        return SS4S_VIDEO_FEED_REQUEST_KEYFRAME;
+    }
+    return SS4S_VIDEO_FEED_OK;
+}
+
+static int video_feeder_worker(void *context) {
+    stream_media_session_t *media_session = context;
+    frame_ring_t *ring = media_session->feeder.ring;
+    while (SDL_SemWait(media_session->feeder.sem) == 0) {
+        frame_ring_slot_t *slot = frame_ring_read_begin(ring);
+        if (slot == NULL) {
+            if (!SDL_AtomicGet(&media_session->feeder.running)) {
+                break;
+            }
+            continue;
+        }
+        video_latency_record(media_session, STREAM_MEDIA_LATENCY_QUEUE, slot->timestamp,
+                             SDL_GetPerformanceCounter());
+        int ret = video_feed(media_session, slot->data, slot->size, slot->flags, slot->timestamp);
+        frame_ring_read_end(ring);
+        if (ret == SS4S_VIDEO_FEED_REQUEST_KEYFRAME) {
+            SDL_AtomicSet(&media_session->feeder.keyframe_requested, 1);
+        }
+    }
+    return 0;
+}
+
+static sps_frame_type_t video_classify_frame(stream_media_session_t *media_session, const unsigned char *data,
+                                             size_t size) {
+    switch (media_session->video_info.codec) {
+        case SS4S_VIDEO_H264:
+            return sps_util_classify_frame_h264(data, size);
+        case SS4S_VIDEO_H265:
+            return sps_util_classify_frame_hevc(data, size, &media_session->feeder.slice_state);
+        default:
+            return SPS_FRAME_UNKNOWN;
+    }
+}
+
+static void video_feeder_drop(stream_media_session_t *media_session, SDL_atomic_t *reason) {
+    frame_ring_mark_dropped(media_session->feeder.ring);
+    SDL_AtomicAdd(reason, 1);
+}
+
+static void video_latency_record(stream_media_session_t *media_session, stream_media_latency_stage_t stage,
+                                 Uint64 begin, Uint64 end) {
+    Uint64 us = (end - begin) * 1000000 / media_session->latency.counter_frequency;
+    SDL_AtomicLock(&media_session->latency.lock);
+    latency_histogram_record(&media_session->latency.stages[stage], us < UINT32_MAX ? (uint32_t) us : UINT32_MAX);
+    SDL_AtomicUnlock(&media_session->latency.lock);
+}
+
+static void video_latency_reset(stream_media_session_t *media_session) {
+    SDL_AtomicLock(&media_session->latency.lock);
+    for (int i = 0; i < STREAM_MEDIA_LATENCY_STAGE_COUNT; i++) {
+        latency_histogram_reset(&media_session->latency.stages[i]);
+    }
+    SDL_AtomicUnlock(&media_session->latency.lock);
+}
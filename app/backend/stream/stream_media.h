@@ -2,6 +2,9 @@
 
 #include "ihslib.h"
 
+#include "util/frame_ring.h"
+#include "util/latency_histogram.h"
+
 typedef struct stream_media_session_t stream_media_session_t;
 typedef struct stream_manager_t stream_manager_t;
 
@@ -16,6 +19,65 @@ void stream_media_set_overlay_height(stream_media_session_t *media_session, int
 void stream_media_set_overlay_shown(stream_media_session_t *media_session, bool overlay);
 bool stream_media_supports_hevc(stream_media_session_t *media_session);
 
+/**
+ * Can be called from any thread.
+ * @return false if video is not fed by the feeder thread
+ */
+bool stream_media_get_video_queue_stats(stream_media_session_t *media_session, frame_ring_stats_t *stats);
+
+/**
+ * Frames dropped by the video feeder, by reason
+ */
+typedef struct stream_media_drop_stats_t {
+    /** Non-reference frames dropped while the queue was over latency budget */
+    uint32_t non_reference;
+    /** Dropped until next keyframe, as the queue was far over latency budget */
+    uint32_t latency;
+    /** Dropped until next keyframe, as the queue was full */
+    uint32_t overflow;
+} stream_media_drop_stats_t;
+
+/**
+ * Can be called from any thread.
+ * @return false if video is not fed by the feeder thread
+ */
+bool stream_media_get_video_drop_stats(stream_media_session_t *media_session, stream_media_drop_stats_t *stats);
+
+/**
+ * Stages of the video pipeline, each with its own latency histogram
+ */
+typedef enum stream_media_latency_stage_t {
+    /** From video_submit until the feeder thread takes the frame. Not recorded without feeder thread */
+    STREAM_MEDIA_LATENCY_QUEUE,
+    /** SPS lookup, parsing and rewrite of keyframes */
+    STREAM_MEDIA_LATENCY_SPS,
+    /** Time the keyframe SPS path holds the session lock */
+    STREAM_MEDIA_LATENCY_SPS_LOCK,
+    /** SS4S_PlayerVideoFeed call */
+    STREAM_MEDIA_LATENCY_FEED,
+    /** From video_submit until SS4S_PlayerVideoFeed returns */
+    STREAM_MEDIA_LATENCY_TOTAL,
+    STREAM_MEDIA_LATENCY_STAGE_COUNT,
+} stream_media_latency_stage_t;
+
+/**
+ * @return Short name of the stage, for logs
+ */
+const char *stream_media_latency_stage_name(stream_media_latency_stage_t stage);
+
+/**
+ * Latency of a video pipeline stage, since video started. Can be called from any thread.
+ */
+void stream_media_get_video_latency(stream_media_session_t *media_session, stream_media_latency_stage_t stage,
+                                    latency_summary_t *summary);
+
+/**
+ * Smoothed difference between video and audio latency. Can be called from any thread.
+ * @param offset_ms Positive if audio is played ahead of the matching video
+ * @return false if nothing was measured yet
+ */
+bool stream_media_get_av_offset(stream_media_session_t *media_session, int *offset_ms);
+
 const IHS_StreamAudioCallbacks *stream_media_audio_callbacks();
 
 const IHS_StreamVideoCallbacks *stream_media_video_callbacks();
\ No newline at end of file
@@ -0,0 +1,391 @@
+/* Recordings may be larger than 2 GiB, also on 32-bit targets. Must come before any system header */
+#define _FILE_OFFSET_BITS 64
+
+#include "stream_recorder.h"
+
+#include "logging/app_logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+/* Each buffer fits a few 4K keyframes to start with */
+#define RECORDER_BUFFER_SIZE (4 * 1024 * 1024)
+/* Buffers grow up to this size, for larger records or while the writer thread is busy. Records are dropped beyond */
+#define RECORDER_BUFFER_MAX_SIZE (64 * 1024 * 1024)
+/* Payload of STREAM_RECORD_DROPPED */
+#define RECORDER_DROPPED_SIZE 12
+/* Records are written at least this often, even if the buffer isn't full */
+#define RECORDER_FLUSH_INTERVAL_MS 1000
+
+typedef struct recorder_buffer_t {
+    unsigned char *data;
+    size_t size, capacity;
+    /* Producers copying into space they reserved. The buffer can't be written or moved until they're done */
+    int copying;
+} recorder_buffer_t;
+
+typedef struct recorder_index_entry_t {
+    uint64_t timestamp_us;
+    uint64_t offset;
+} recorder_index_entry_t;
+
+struct stream_recorder_t {
+    FILE *file;
+    char *index_path;
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    /* Records are appended to the active buffer, while the writer thread writes the pending one */
+    recorder_buffer_t buffers[2];
+    recorder_buffer_t *active, *pending;
+    bool stopping;
+    Uint64 start_counter, counter_frequency;
+    uint64_t max_size;
+    /* Size of the recording once every buffered record is written */
+    uint64_t recorded_size;
+    struct {
+        recorder_index_entry_t *entries;
+        size_t count, capacity;
+    } index;
+    uint32_t records, dropped;
+    /* Dropped since the last STREAM_RECORD_DROPPED record */
+    uint32_t unreported_records;
+    uint64_t unreported_size;
+    bool full;
+};
+
+static unsigned char *recorder_reserve(stream_recorder_t *recorder, size_t size, recorder_buffer_t **buffer);
+
+static void recorder_release(stream_recorder_t *recorder, recorder_buffer_t *buffer);
+
+static bool recorder_buffer_grow(recorder_buffer_t *buffer, size_t size);
+
+static void recorder_write_header(unsigned char *out, stream_record_type_t type, uint8_t flags, size_t size,
+                                  uint64_t timestamp_us);
+
+static unsigned char *recorder_write_dropped(stream_recorder_t *recorder, unsigned char *out, uint64_t timestamp_us);
+
+static bool recorder_index_reserve(stream_recorder_t *recorder);
+
+static uint64_t recorder_timestamp_us(const stream_recorder_t *recorder);
+
+static int recorder_worker(void *context);
+
+static void recorder_free(stream_recorder_t *recorder);
+
+static void recorder_write_index(stream_recorder_t *recorder);
+
+static void write_le16(unsigned char *out, uint16_t value);
+
+static void write_le32(unsigned char *out, uint32_t value);
+
+static void write_le64(unsigned char *out, uint64_t value);
+
+stream_recorder_t *stream_recorder_create(const char *path, uint64_t max_size) {
+    stream_recorder_t *recorder = calloc(1, sizeof(stream_recorder_t));
+    if (recorder == NULL) {
+        return NULL;
+    }
+    size_t path_len = strlen(path);
+    recorder->index_path = malloc(path_len + sizeof(".idx"));
+    for (int i = 0; i < 2; i++) {
+        recorder->buffers[i].data = malloc(RECORDER_BUFFER_SIZE);
+        recorder->buffers[i].capacity = RECORDER_BUFFER_SIZE;
+    }
+    if (recorder->index_path == NULL || recorder->buffers[0].data == NULL || recorder->buffers[1].data == NULL) {
+        app_log_error("Recorder", "Failed to allocate recording buffers");
+        recorder_free(recorder);
+        return NULL;
+    }
+    memcpy(recorder->index_path, path, path_len);
+    memcpy(recorder->index_path + path_len, ".idx", sizeof(".idx"));
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL) {
+        app_log_error("Recorder", "Failed to create %s", path);
+        recorder_free(recorder);
+        return NULL;
+    }
+    recorder->active = &recorder->buffers[0];
+    recorder->max_size = max_size;
+    recorder->lock = SDL_CreateMutex();
+    recorder->cond = SDL_CreateCond();
+    recorder->counter_frequency = SDL_GetPerformanceFrequency();
+    recorder->start_counter = SDL_GetPerformanceCounter();
+
+    memcpy(recorder->active->data, STREAM_RECORD_MAGIC, STREAM_RECORD_MAGIC_SIZE);
+    recorder->active->size = STREAM_RECORD_MAGIC_SIZE;
+    recorder->recorded_size = STREAM_RECORD_MAGIC_SIZE;
+
+    recorder->thread = SDL_CreateThread(recorder_worker, "recorder", recorder);
+    if (recorder->thread == NULL) {
+        recorder->stopping = true;
+        stream_recorder_destroy(recorder);
+        return NULL;
+    }
+    app_log_info("Recorder", "Recording to %s, max_size=%llu", path, (unsigned long long) max_size);
+    return recorder;
+}
+
+void stream_recorder_destroy(stream_recorder_t *recorder) {
+    SDL_LockMutex(recorder->lock);
+    if (recorder->unreported_records > 0) {
+        recorder_buffer_t *buffer;
+        unsigned char *out = recorder_reserve(recorder, STREAM_RECORD_HEADER_SIZE + RECORDER_DROPPED_SIZE, &buffer);
+        if (out != NULL) {
+            recorder_write_dropped(recorder, out, recorder_timestamp_us(recorder));
+            buffer->copying--;
+        }
+    }
+    recorder->stopping = true;
+    SDL_CondSignal(recorder->cond);
+    SDL_UnlockMutex(recorder->lock);
+    if (recorder->thread != NULL) {
+        SDL_WaitThread(recorder->thread, NULL);
+    }
+    fclose(recorder->file);
+    recorder_write_index(recorder);
+    app_log_info("Recorder", "Recording stopped. records=%u, dropped=%u, keyframes=%zu, size=%llu",
+                 recorder->records, recorder->dropped, recorder->index.count,
+                 (unsigned long long) recorder->recorded_size);
+    SDL_DestroyCond(recorder->cond);
+    SDL_DestroyMutex(recorder->lock);
+    recorder_free(recorder);
+}
+
+bool stream_recorder_write(stream_recorder_t *recorder, stream_record_type_t type, uint8_t flags, const void *data,
+                           size_t size) {
+    uint64_t timestamp_us = recorder_timestamp_us(recorder);
+    bool keyframe = type == STREAM_RECORD_VIDEO_FRAME && (flags & STREAM_RECORD_FLAG_KEYFRAME);
+    SDL_LockMutex(recorder->lock);
+    // Replay reports dropped records where they were dropped
+    size_t dropped_size = recorder->unreported_records > 0 ? STREAM_RECORD_HEADER_SIZE + RECORDER_DROPPED_SIZE : 0;
+    uint64_t offset = recorder->recorded_size + dropped_size;
+    recorder_buffer_t *buffer = NULL;
+    unsigned char *out = NULL;
+    if (!keyframe || recorder_index_reserve(recorder)) {
+        out = recorder_reserve(recorder, dropped_size + STREAM_RECORD_HEADER_SIZE + size, &buffer);
+    }
+    if (out == NULL) {
+        if (!recorder->full) {
+            recorder->dropped++;
+            recorder->unreported_records++;
+            recorder->unreported_size += size;
+        }
+        SDL_UnlockMutex(recorder->lock);
+        return false;
+    }
+    if (dropped_size > 0) {
+        out = recorder_write_dropped(recorder, out, timestamp_us);
+    }
+    if (keyframe) {
+        recorder_index_entry_t *entry = &recorder->index.entries[recorder->index.count++];
+        entry->timestamp_us = timestamp_us;
+        entry->offset = offset;
+    }
+    recorder_write_header(out, type, flags, size, timestamp_us);
+    recorder->records++;
+    SDL_UnlockMutex(recorder->lock);
+    // Space is reserved, so the payload is copied without blocking other producers or the writer thread
+    if (size > 0) {
+        memcpy(out + STREAM_RECORD_HEADER_SIZE, data, size);
+    }
+    recorder_release(recorder, buffer);
+    return true;
+}
+
+bool stream_recorder_write_config(stream_recorder_t *recorder, stream_record_type_t type, uint32_t a, uint32_t b,
+                                  uint32_t c) {
+    unsigned char payload[12];
+    write_le32(payload, a);
+    write_le32(payload + 4, b);
+    write_le32(payload + 8, c);
+    return stream_recorder_write(recorder, type, 0, payload, sizeof(payload));
+}
+
+/**
+ * Called with the lock held. Never waits for the writer thread: while it's busy with the other buffer, or if the record
+ * is larger than the buffer, the active buffer grows instead.
+ * @return Where to write size bytes, NULL if the record has to be dropped. Release buffer once written
+ */
+static unsigned char *recorder_reserve(stream_recorder_t *recorder, size_t size, recorder_buffer_t **buffer) {
+    if (recorder->recorded_size + size > recorder->max_size) {
+        if (!recorder->full) {
+            app_log_warn("Recorder", "Recording reached its size limit");
+            recorder->full = true;
+        }
+        return NULL;
+    }
+    recorder_buffer_t *active = recorder->active;
+    if (active->size + size > active->capacity && recorder->pending == NULL && active->size > 0) {
+        recorder->pending = active;
+        recorder->active = active == &recorder->buffers[0] ? &recorder->buffers[1] : &recorder->buffers[0];
+        active = recorder->active;
+        SDL_CondSignal(recorder->cond);
+    }
+    if (active->size + size > active->capacity && !recorder_buffer_grow(active, active->size + size)) {
+        return NULL;
+    }
+    unsigned char *out = active->data + active->size;
+    active->size += size;
+    active->copying++;
+    recorder->recorded_size += size;
+    *buffer = active;
+    return out;
+}
+
+/**
+ * Called without the lock, once the reserved space is written.
+ */
+static void recorder_release(stream_recorder_t *recorder, recorder_buffer_t *buffer) {
+    SDL_LockMutex(recorder->lock);
+    buffer->copying--;
+    if (buffer->copying == 0 && buffer == recorder->pending) {
+        // Writer thread waits for this buffer
+        SDL_CondSignal(recorder->cond);
+    }
+    SDL_UnlockMutex(recorder->lock);
+}
+
+/**
+ * Called with the lock held. Producers still copying write to the current allocation, so it can't move then.
+ */
+static bool recorder_buffer_grow(recorder_buffer_t *buffer, size_t size) {
+    if (buffer->copying > 0 || size > RECORDER_BUFFER_MAX_SIZE) {
+        return false;
+    }
+    size_t capacity = buffer->capacity;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    if (capacity > RECORDER_BUFFER_MAX_SIZE) {
+        capacity = RECORDER_BUFFER_MAX_SIZE;
+    }
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static void recorder_write_header(unsigned char *out, stream_record_type_t type, uint8_t flags, size_t size,
+                                  uint64_t timestamp_us) {
+    out[0] = (uint8_t) type;
+    out[1] = flags;
+    write_le16(out + 2, 0);
+    write_le32(out + 4, (uint32_t) size);
+    write_le64(out + 8, timestamp_us);
+}
+
+/**
+ * Write a STREAM_RECORD_DROPPED record, for records dropped since the last one.
+ * @return Where the next record goes
+ */
+static unsigned char *recorder_write_dropped(stream_recorder_t *recorder, unsigned char *out, uint64_t timestamp_us) {
+    recorder_write_header(out, STREAM_RECORD_DROPPED, 0, RECORDER_DROPPED_SIZE, timestamp_us);
+    write_le32(out + STREAM_RECORD_HEADER_SIZE, recorder->unreported_records);
+    write_le64(out + STREAM_RECORD_HEADER_SIZE + 4, recorder->unreported_size);
+    recorder->unreported_records = 0;
+    recorder->unreported_size = 0;
+    return out + STREAM_RECORD_HEADER_SIZE + RECORDER_DROPPED_SIZE;
+}
+
+/**
+ * Make room in the index for the keyframe about to be appended.
+ */
+static bool recorder_index_reserve(stream_recorder_t *recorder) {
+    if (recorder->index.count == recorder->index.capacity) {
+        size_t capacity = recorder->index.capacity > 0 ? recorder->index.capacity * 2 : 256;
+        recorder_index_entry_t *entries = realloc(recorder->index.entries, capacity * sizeof(recorder_index_entry_t));
+        if (entries == NULL) {
+            return false;
+        }
+        recorder->index.entries = entries;
+        recorder->index.capacity = capacity;
+    }
+    return true;
+}
+
+static uint64_t recorder_timestamp_us(const stream_recorder_t *recorder) {
+    return (SDL_GetPerformanceCounter() - recorder->start_counter) * 1000000 / recorder->counter_frequency;
+}
+
+/**
+ * Write buffers handed over by producers, or the active one once stopping or when nothing was written for a while.
+ */
+static int recorder_worker(void *context) {
+    stream_recorder_t *recorder = context;
+    SDL_LockMutex(recorder->lock);
+    bool flush = false;
+    for (;;) {
+        if (recorder->pending == NULL && (recorder->stopping || flush) && recorder->active->size > 0) {
+            recorder->pending = recorder->active;
+            recorder->active = recorder->active == &recorder->buffers[0] ? &recorder->buffers[1]
+                                                                         : &recorder->buffers[0];
+        }
+        flush = false;
+        recorder_buffer_t *buffer = recorder->pending;
+        if (buffer != NULL && buffer->copying == 0) {
+            SDL_UnlockMutex(recorder->lock);
+            if (fwrite(buffer->data, 1, buffer->size, recorder->file) != buffer->size) {
+                app_log_error("Recorder", "Failed to write recording");
+            }
+            fflush(recorder->file);
+            SDL_LockMutex(recorder->lock);
+            buffer->size = 0;
+            recorder->pending = NULL;
+            continue;
+        }
+        if (buffer == NULL && recorder->stopping) {
+            break;
+        }
+        // Wait for a buffer, or for producers still copying into the pending one
+        flush = SDL_CondWaitTimeout(recorder->cond, recorder->lock, RECORDER_FLUSH_INTERVAL_MS) ==
+                SDL_MUTEX_TIMEDOUT;
+    }
+    SDL_UnlockMutex(recorder->lock);
+    return 0;
+}
+
+static void recorder_write_index(stream_recorder_t *recorder) {
+    FILE *file = fopen(recorder->index_path, "wb");
+    if (file == NULL) {
+        app_log_error("Recorder", "Failed to create %s", recorder->index_path);
+        return;
+    }
+    fwrite(STREAM_RECORD_INDEX_MAGIC, 1, STREAM_RECORD_MAGIC_SIZE, file);
+    for (size_t i = 0; i < recorder->index.count; i++) {
+        unsigned char entry[16];
+        write_le64(entry, recorder->index.entries[i].timestamp_us);
+        write_le64(entry + 8, recorder->index.entries[i].offset);
+        fwrite(entry, 1, sizeof(entry), file);
+    }
+    fclose(file);
+}
+
+static void recorder_free(stream_recorder_t *recorder) {
+    for (int i = 0; i < 2; i++) {
+        free(recorder->buffers[i].data);
+    }
+    free(recorder->index.entries);
+    free(recorder->index_path);
+    free(recorder);
+}
+
+static void write_le16(unsigned char *out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void write_le32(unsigned char *out, uint32_t value) {
+    write_le16(out, value & 0xFFFF);
+    write_le16(out + 2, value >> 16);
+}
+
+static void write_le64(unsigned char *out, uint64_t value) {
+    write_le32(out, value & 0xFFFFFFFF);
+    write_le32(out + 4, value >> 32);
+}
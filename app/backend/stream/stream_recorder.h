@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Records everything the session passes to stream_media, so a stream can be replayed offline.
+ *
+ * The recording starts with STREAM_RECORD_MAGIC, followed by records. Each record is a STREAM_RECORD_HEADER_SIZE
+ * bytes header, then its payload. All numbers are little endian:
+ *
+ *     uint8_t type;           stream_record_type_t
+ *     uint8_t flags;          STREAM_RECORD_FLAG_KEYFRAME for video frames
+ *     uint16_t reserved;
+ *     uint32_t size;          Size of the payload
+ *     uint64_t timestamp_us;  Monotonic, since recording started
+ *
+ * Start records carry the stream configuration as uint32_t values, video frames and audio packets carry the data as
+ * received. STREAM_RECORD_DROPPED precedes the first record written after some were dropped. A seek index is written
+ * next to the recording, with ".idx" appended to its name. It starts with STREAM_RECORD_INDEX_MAGIC, followed by one
+ * uint64_t timestamp_us and uint64_t record offset per video keyframe.
+ */
+#define STREAM_RECORD_MAGIC "IHSREC01"
+#define STREAM_RECORD_INDEX_MAGIC "IHSIDX01"
+#define STREAM_RECORD_MAGIC_SIZE 8
+#define STREAM_RECORD_HEADER_SIZE 16
+
+#define STREAM_RECORD_FLAG_KEYFRAME 1
+
+typedef enum stream_record_type_t {
+    /** codec, width, height */
+    STREAM_RECORD_VIDEO_START = 1,
+    STREAM_RECORD_VIDEO_FRAME = 2,
+    STREAM_RECORD_VIDEO_STOP = 3,
+    /** codec, channels, frequency */
+    STREAM_RECORD_AUDIO_START = 4,
+    STREAM_RECORD_AUDIO_PACKET = 5,
+    STREAM_RECORD_AUDIO_STOP = 6,
+    /** uint32_t records, uint64_t size of their payloads */
+    STREAM_RECORD_DROPPED = 7,
+} stream_record_type_t;
+
+typedef struct stream_recorder_t stream_recorder_t;
+
+/**
+ * Start a recording. Records are written to disk by a background thread. Buffers grow while it's busy, and records
+ * are dropped instead of waiting once they can't grow any further.
+ * @param max_size Recording stops once it reaches this size
+ * @return NULL if the file can't be created, or memory can't be allocated
+ */
+stream_recorder_t *stream_recorder_create(const char *path, uint64_t max_size);
+
+/**
+ * Write pending records and the seek index, and close the recording.
+ */
+void stream_recorder_destroy(stream_recorder_t *recorder);
+
+/**
+ * Append a record. Only copies the data, without holding the recorder lock, can be called from any thread.
+ * @return false if the record was dropped
+ */
+bool stream_recorder_write(stream_recorder_t *recorder, stream_record_type_t type, uint8_t flags, const void *data,
+                           size_t size);
+
+/**
+ * Append a start record, with the stream configuration.
+ */
+bool stream_recorder_write_config(stream_recorder_t *recorder, stream_record_type_t type, uint32_t a, uint32_t b,
+                                  uint32_t c);
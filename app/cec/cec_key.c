@@ -22,16 +22,13 @@ void cec_support_cb_key(void *cbparam, const cec_keypress *keypress) {
     if (key == 0) {
         return;
     }
-    key_event_t *data = malloc(sizeof(key_event_t));
-    data->key = key;
-    data->pressed = keypress->duration == 0;
-    app_run_on_main(support->app, cb_key_main, data);
+    key_event_t data = {.key = key, .pressed = keypress->duration == 0};
+    app_run_on_main_copy(support->app, cb_key_main, &data, sizeof(data));
 }
 
 static void cb_key_main(app_t *app, void *data) {
     key_event_t *ev = data;
     app_indev_keypad_inject_key(app->ui->indev.keypad, ev->key, ev->pressed);
-    free(data);
 }
 
 static lv_key_t key_from_cec(cec_user_control_code code) {
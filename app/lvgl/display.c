@@ -1,4 +1,5 @@
 #include "display.h"
+#include "app_watchdog.h"
 
 #include <src/draw/sdl/lv_draw_sdl.h>
 
@@ -62,6 +63,7 @@ static void flush_cb(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t
     }
 
     if (lv_disp_flush_is_last(disp_drv)) {
+        app_watchdog_phase_begin(APP_LOOP_PHASE_PRESENT);
         lv_draw_sdl_drv_param_t *param = disp_drv->user_data;
         SDL_Renderer *renderer = param->renderer;
         SDL_Texture *texture = disp_drv->draw_buf->buf1;
@@ -72,6 +74,7 @@ static void flush_cb(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
         SDL_SetRenderTarget(renderer, texture);
+        app_watchdog_phase_end(APP_LOOP_PHASE_PRESENT);
     }
     lv_disp_flush_ready(disp_drv);
 }
\ No newline at end of file
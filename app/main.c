@@ -2,6 +2,7 @@
 #include <lvgl.h>
 
 #include "app.h"
+#include "app_watchdog.h"
 #include "config.h"
 
 #include "ui/app_ui.h"
@@ -18,13 +19,36 @@
 #include "logging/app_logging.h"
 #include "util/os_info.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
 #if IHSPLAY_FEATURE_LIBCEC
 
 #include "cec/cec_support.h"
 
 #endif
 
-static void process_events();
+/* Upper bound of waiting for events, when LVGL has no timer due */
+#define MAIN_LOOP_MAX_WAIT_MS 500
+/* Main loop statistics are logged this often */
+#define MAIN_LOOP_STATS_INTERVAL_MS 10000
+
+typedef struct main_loop_stats_t {
+    Uint32 start_ticks;
+    double start_cpu_ms;
+    uint32_t wakeups;
+} main_loop_stats_t;
+
+static void process_events(uint32_t timeout_ms);
+
+static void handle_event(const SDL_Event *event);
+
+static void main_loop_stats_update(main_loop_stats_t *stats);
+
+static double process_cpu_ms();
 
 static void logging_init();
 
@@ -96,11 +120,19 @@ int main(int argc, char *argv[]) {
     cec_support_ctx_t *cec = cec_support_create(app);
 #endif
 
+    app_watchdog_init(settings.watchdog_threshold_ms);
+    main_loop_stats_t loop_stats = {.start_ticks = SDL_GetTicks(), .start_cpu_ms = process_cpu_ms()};
+    uint32_t next_delay = 0;
     while (app->running) {
-        process_events();
-        uint32_t next_delay = lv_task_handler();
-        SDL_Delay(stream_manager_is_active(app->stream_manager) ? 1 : next_delay);
+        // Sleeps until the next LVGL timer is due, but wakes up immediately for input or posted actions
+        process_events(next_delay < MAIN_LOOP_MAX_WAIT_MS ? next_delay : MAIN_LOOP_MAX_WAIT_MS);
+        app_watchdog_phase_begin(APP_LOOP_PHASE_LVGL);
+        next_delay = lv_task_handler();
+        app_watchdog_phase_end(APP_LOOP_PHASE_LVGL);
+        app_watchdog_iteration_end();
+        main_loop_stats_update(&loop_stats);
     }
+    app_watchdog_deinit();
 
 #if IHSPLAY_FEATURE_LIBCEC
     cec_support_destroy(cec);
@@ -123,50 +155,100 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
-static void process_events() {
+static void process_events(uint32_t timeout_ms) {
     SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-            case SDL_KEYUP:
-            case SDL_KEYDOWN:
-            case SDL_MOUSEMOTION:
-            case SDL_MOUSEBUTTONDOWN:
-            case SDL_MOUSEBUTTONUP:
-            case SDL_CONTROLLERAXISMOTION:
-            case SDL_CONTROLLERBUTTONDOWN:
-            case SDL_CONTROLLERBUTTONUP:
-            case SDL_CONTROLLERDEVICEADDED:
-            case SDL_CONTROLLERDEVICEREMOVED: {
-                bool intercept_by_stream = stream_manager_intercept_event(app->stream_manager, &event);
-                if (!intercept_by_stream) {
-                    app_sdl_input_event(app, &event);
-                }
-                stream_manager_handle_event(app->stream_manager, &event);
-                break;
-            }
-            case SDL_QUIT: {
-                app_quit(app);
-                break;
-            }
-            case APP_RUN_ON_MAIN: {
-                void (*action)(app_t *, void *) = event.user.data1;
-                void *data = event.user.data2;
-                action(app, data);
-                break;
+    bool has_event = SDL_WaitEventTimeout(&event, (int) timeout_ms);
+    app_watchdog_iteration_begin();
+    if (!has_event) {
+        return;
+    }
+    app_watchdog_phase_begin(APP_LOOP_PHASE_EVENTS);
+    do {
+        handle_event(&event);
+    } while (SDL_PollEvent(&event));
+    app_watchdog_phase_end(APP_LOOP_PHASE_EVENTS);
+}
+
+static void handle_event(const SDL_Event *event) {
+    switch (event->type) {
+        case SDL_KEYUP:
+        case SDL_KEYDOWN:
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_CONTROLLERAXISMOTION:
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+        case SDL_CONTROLLERDEVICEADDED:
+        case SDL_CONTROLLERDEVICEREMOVED: {
+            bool intercept_by_stream = stream_manager_intercept_event(app->stream_manager, event);
+            if (!intercept_by_stream) {
+                app_sdl_input_event(app, event);
             }
-            default: {
-                if (event.type > APP_UI_EVENT_BEGIN && event.type < APP_UI_EVENT_LAST) {
-                    app_ui_event_data_t data = {.data1 = event.user.data1, .data2 = event.user.data2};
-                    if (!app_ui_dispatch_event(app->ui, event.type, &data)) {
-                        app_log_debug("UI", "Unhandled UI event 0x%x", event.type);
-                    }
+            stream_manager_handle_event(app->stream_manager, event);
+            break;
+        }
+        case SDL_QUIT: {
+            app_quit(app);
+            break;
+        }
+        case APP_RUN_ON_MAIN: {
+            app_dispatch_run(app);
+            break;
+        }
+        default: {
+            if (event->type > APP_UI_EVENT_BEGIN && event->type < APP_UI_EVENT_LAST) {
+                app_ui_event_data_t data = {.data1 = event->user.data1, .data2 = event->user.data2};
+                if (!app_ui_dispatch_event(app->ui, event->type, &data)) {
+                    app_log_debug("UI", "Unhandled UI event 0x%x", event->type);
                 }
-                break;
             }
+            break;
         }
     }
 }
 
+/**
+ * Log how often the main loop wakes up, and CPU usage of the whole process.
+ */
+static void main_loop_stats_update(main_loop_stats_t *stats) {
+    stats->wakeups++;
+    Uint32 elapsed_ms = SDL_GetTicks() - stats->start_ticks;
+    if (elapsed_ms < MAIN_LOOP_STATS_INTERVAL_MS) {
+        return;
+    }
+    double now = process_cpu_ms();
+    double cpu_ms = now - stats->start_cpu_ms;
+    app_log_debug("APP", "Main loop: %.1f wakeups/s, cpu %.1f%%", stats->wakeups * 1000.0 / elapsed_ms,
+                  cpu_ms * 100.0 / elapsed_ms);
+    stats->start_ticks += elapsed_ms;
+    stats->start_cpu_ms = now;
+    stats->wakeups = 0;
+}
+
+/**
+ * CPU time used by all threads of the process. clock() can't be used, as it's wall time on Windows.
+ */
+static double process_cpu_ms() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER kernel_time = {.LowPart = kernel.dwLowDateTime, .HighPart = kernel.dwHighDateTime};
+    ULARGE_INTEGER user_time = {.LowPart = user.dwLowDateTime, .HighPart = user.dwHighDateTime};
+    // In 100ns units
+    return (double) (kernel_time.QuadPart + user_time.QuadPart) / 10000.0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return (double) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (double) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+#endif
+}
+
 static void logging_init() {
     app_logging_init();
     lv_log_register_print_cb(app_lv_log);
@@ -13,7 +13,45 @@ typedef struct app_settings_t {
     /** The pointer references to modules */
     const char *video_driver;
     array_list_t *modules;
+    /** Section of the SS4S module to use for both audio and video, instead of picking by weight. NULL if unset */
+    const char *module_override;
     uint64_t selected_client_id;
+    /** Feed video decoder from a dedicated thread, instead of the network receive thread */
+    bool video_feeder_thread;
+    /** Number of frames the video feeder can queue before dropping */
+    int video_feeder_queue_size;
+    /** Rewrite SPS of keyframes, so the decoder outputs each frame without waiting for its picture buffer to fill */
+    bool video_low_latency_sps;
+    /** Video queued longer than this is dropped, non-reference frames first. 0 to only drop when the queue is full */
+    int video_latency_budget_ms;
+    /** Stop feeding video when a reference frame is lost, and request a keyframe instead of decoding garbage */
+    bool video_gap_recovery;
+    /** NAL units removed from video frames before feeding, as decoders don't need them. SEI may carry HDR metadata */
+    bool video_strip_sei, video_strip_filler, video_strip_aud;
+    /** Decode and feed audio on a dedicated thread, instead of the network receive thread */
+    bool audio_decoder_thread;
+    /** Raise scheduling priority of the audio decoder thread */
+    bool audio_decoder_thread_high_priority;
+    /** Conceal lost audio packets with FEC data of the next packet, or by synthesizing them */
+    bool audio_loss_concealment;
+    /** Audio queued ahead of playback to absorb network jitter, 0 to feed audio as it arrives */
+    int audio_target_latency_ms;
+    /** Decoded audio packets fed to the decoder in one call. More saves per call overhead, but adds latency */
+    int audio_feed_batch;
+    /** Delay audio by this much, to correct lip sync */
+    int audio_delay_ms;
+    /** Delay audio to match the measured video latency */
+    bool av_sync_auto;
+    /** Time the display takes to show a decoded frame, which can't be measured. Used for A/V sync */
+    int video_display_latency_ms;
+    /** Send input to the host from a high priority thread while streaming, instead of the main loop */
+    bool input_thread;
+    /** Log main loop iterations taking longer than this, 0 to disable the watchdog */
+    int watchdog_threshold_ms;
+    /** Record everything received from the host to this file, NULL to disable. Overwritten by each session */
+    const char *record_path;
+    /** Recording stops once it reaches this size */
+    int record_max_mb;
 } app_settings_t;
 
 void app_settings_init(app_settings_t *settings, const os_info_t *os_info);
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <stdlib.h>
+#include <SDL.h>
 
 #include "app_settings.h"
 
@@ -7,15 +9,49 @@
 #include "util/array_list.h"
 #include "util/os_info.h"
 
+/* Benchmark sink from tools/ss4s-null. Weights don't keep it last, so it's only used when selected explicitly */
+#define NULL_MODULE_SECTION "null"
+
+static bool env_bool(const char *name, bool def);
+
+static int env_int(const char *name, int def, int min, int max);
+
 void app_settings_init(app_settings_t *settings, const os_info_t *os_info) {
     memset(settings, 0, sizeof(app_settings_t));
     settings->modules = modules_load(os_info);
     settings->relmouse = true;
+    settings->video_feeder_thread = env_bool("IHSPLAY_VIDEO_FEEDER", false);
+    settings->video_feeder_queue_size = env_int("IHSPLAY_VIDEO_FEEDER_QUEUE", 8, 2, 64);
+    settings->video_low_latency_sps = env_bool("IHSPLAY_VIDEO_SPS_REWRITE", false);
+    settings->video_latency_budget_ms = env_int("IHSPLAY_VIDEO_LATENCY_BUDGET", 50, 0, 1000);
+    settings->video_gap_recovery = env_bool("IHSPLAY_VIDEO_GAP_RECOVERY", false);
+    settings->video_strip_sei = env_bool("IHSPLAY_VIDEO_STRIP_SEI", false);
+    settings->video_strip_filler = env_bool("IHSPLAY_VIDEO_STRIP_FILLER", true);
+    settings->video_strip_aud = env_bool("IHSPLAY_VIDEO_STRIP_AUD", false);
+    settings->audio_decoder_thread = env_bool("IHSPLAY_AUDIO_DECODER_THREAD", false);
+    settings->audio_decoder_thread_high_priority = env_bool("IHSPLAY_AUDIO_DECODER_HIGH_PRIORITY", true);
+    settings->audio_loss_concealment = env_bool("IHSPLAY_AUDIO_CONCEALMENT", false);
+    settings->audio_target_latency_ms = env_int("IHSPLAY_AUDIO_LATENCY", 0, 0, 500);
+    settings->audio_feed_batch = env_int("IHSPLAY_AUDIO_FEED_BATCH", 1, 1, 16);
+    settings->audio_delay_ms = env_int("IHSPLAY_AUDIO_DELAY", 0, 0, 500);
+    settings->av_sync_auto = env_bool("IHSPLAY_AV_SYNC_AUTO", false);
+    settings->video_display_latency_ms = env_int("IHSPLAY_VIDEO_DISPLAY_LATENCY", 0, 0, 500);
+    settings->input_thread = env_bool("IHSPLAY_INPUT_THREAD", false);
+    settings->watchdog_threshold_ms = env_int("IHSPLAY_WATCHDOG_THRESHOLD", 50, 0, 10000);
+    settings->record_path = SDL_getenv("IHSPLAY_RECORD");
+    settings->record_max_mb = env_int("IHSPLAY_RECORD_MAX_MB", 1024, 1, 65536);
+    settings->module_override = SDL_getenv("IHSPLAY_SS4S_MODULE");
 
     // TODO: check if lib available, and handle conflicts
     const module_info_t *first_video_module = NULL, *first_audio_module = NULL;
     for (int i = 0, j = array_list_size(settings->modules); i < j; ++i) {
         const module_info_t *info = array_list_get(settings->modules, i);
+        if (settings->module_override != NULL && strcmp(info->section, settings->module_override) != 0) {
+            continue;
+        }
+        if (settings->module_override == NULL && strcmp(info->section, NULL_MODULE_SECTION) == 0) {
+            continue;
+        }
         if (info->has_video && first_video_module == NULL) {
             first_video_module = info;
             if (info->has_audio) {
@@ -43,3 +79,29 @@ void app_settings_init(app_settings_t *settings, const os_info_t *os_info) {
 void app_settings_deinit(app_settings_t *settings) {
     modules_destroy(settings->modules);
 }
+
+static bool env_bool(const char *name, bool def) {
+    const char *v = SDL_getenv(name);
+    if (v == NULL) {
+        return def;
+    }
+    return strcmp(v, "1") == 0 || strcmp(v, "true") == 0;
+}
+
+static int env_int(const char *name, int def, int min, int max) {
+    const char *v = SDL_getenv(name);
+    if (v == NULL) {
+        return def;
+    }
+    char *end = NULL;
+    long value = strtol(v, &end, 10);
+    if (end == v) {
+        return def;
+    }
+    if (value < min) {
+        return min;
+    } else if (value > max) {
+        return max;
+    }
+    return (int) value;
+}
@@ -79,6 +79,15 @@ void app_ui_resized(app_ui_t *ui, int width, int height) {
 
 void app_ui_set_ignore_keys(app_ui_t *ui, bool ignore) {
     app_indev_keypad_set_ignore(ui->indev.keypad, ignore);
+    // The stream takes all input meanwhile. Without polling input devices, main loop can sleep until next frame
+    lv_indev_t *indevs[] = {ui->indev.keypad, ui->indev.mouse};
+    for (int i = 0; i < 2; i++) {
+        if (ignore) {
+            lv_timer_pause(indevs[i]->driver->read_timer);
+        } else {
+            lv_timer_resume(indevs[i]->driver->read_timer);
+        }
+    }
 }
 
 lv_fragment_t *app_ui_create_fragment(app_ui_t *ui, const lv_fragment_class_t *cls, void *args) {
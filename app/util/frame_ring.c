@@ -0,0 +1,117 @@
+#include "frame_ring.h"
+
+#include <stdlib.h>
+
+struct frame_ring_t {
+    frame_ring_slot_t *slots;
+    int capacity;
+    /* Free running counters. Head is only written by the producer, tail is only written by the consumer */
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t high_watermark;
+    SDL_atomic_t pushed;
+    SDL_atomic_t dropped;
+};
+
+static inline int ring_occupancy(int head, int tail);
+
+frame_ring_t *frame_ring_create(int capacity, size_t slot_size) {
+    if (capacity <= 0) {
+        return NULL;
+    }
+    /* Round up to power of 2, so slot index stays continuous when the counters wrap around */
+    int pot = 1;
+    while (pot < capacity) {
+        pot <<= 1;
+    }
+    capacity = pot;
+    frame_ring_t *ring = calloc(1, sizeof(frame_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->slots = calloc(capacity, sizeof(frame_ring_slot_t));
+    if (ring->slots == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->capacity = capacity;
+    for (int i = 0; i < capacity; i++) {
+        frame_ring_slot_t *slot = &ring->slots[i];
+        slot->data = malloc(slot_size);
+        if (slot->data == NULL) {
+            frame_ring_destroy(ring);
+            return NULL;
+        }
+        slot->capacity = slot_size;
+    }
+    return ring;
+}
+
+void frame_ring_destroy(frame_ring_t *ring) {
+    for (int i = 0; i < ring->capacity; i++) {
+        free(ring->slots[i].data);
+    }
+    free(ring->slots);
+    free(ring);
+}
+
+frame_ring_slot_t *frame_ring_write_begin(frame_ring_t *ring, size_t size) {
+    int head = SDL_AtomicGet(&ring->head), tail = SDL_AtomicGet(&ring->tail);
+    if (ring_occupancy(head, tail) >= ring->capacity) {
+        return NULL;
+    }
+    frame_ring_slot_t *slot = &ring->slots[(unsigned int) head & (ring->capacity - 1)];
+    if (slot->capacity < size) {
+        unsigned char *data = realloc(slot->data, size);
+        if (data == NULL) {
+            return NULL;
+        }
+        slot->data = data;
+        slot->capacity = size;
+    }
+    slot->size = 0;
+    slot->flags = 0;
+    return slot;
+}
+
+void frame_ring_write_commit(frame_ring_t *ring) {
+    int head = (int) ((unsigned int) SDL_AtomicGet(&ring->head) + 1);
+    SDL_AtomicSet(&ring->head, head);
+    SDL_AtomicAdd(&ring->pushed, 1);
+    int occupancy = ring_occupancy(head, SDL_AtomicGet(&ring->tail));
+    if (occupancy > SDL_AtomicGet(&ring->high_watermark)) {
+        SDL_AtomicSet(&ring->high_watermark, occupancy);
+    }
+}
+
+void frame_ring_mark_dropped(frame_ring_t *ring) {
+    SDL_AtomicAdd(&ring->dropped, 1);
+}
+
+frame_ring_slot_t *frame_ring_read_begin(frame_ring_t *ring) {
+    int head = SDL_AtomicGet(&ring->head), tail = SDL_AtomicGet(&ring->tail);
+    if (head == tail) {
+        return NULL;
+    }
+    return &ring->slots[(unsigned int) tail & (ring->capacity - 1)];
+}
+
+void frame_ring_read_end(frame_ring_t *ring) {
+    SDL_AtomicSet(&ring->tail, (int) ((unsigned int) SDL_AtomicGet(&ring->tail) + 1));
+}
+
+int frame_ring_occupancy(frame_ring_t *ring) {
+    return ring_occupancy(SDL_AtomicGet(&ring->head), SDL_AtomicGet(&ring->tail));
+}
+
+void frame_ring_get_stats(frame_ring_t *ring, frame_ring_stats_t *stats) {
+    stats->occupancy = frame_ring_occupancy(ring);
+    stats->capacity = ring->capacity;
+    stats->high_watermark = SDL_AtomicGet(&ring->high_watermark);
+    stats->pushed = (uint32_t) SDL_AtomicGet(&ring->pushed);
+    stats->dropped = (uint32_t) SDL_AtomicGet(&ring->dropped);
+}
+
+static inline int ring_occupancy(int head, int tail) {
+    return (int) ((unsigned int) head - (unsigned int) tail);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <SDL.h>
+
+/**
+ * Lock-free single-producer/single-consumer queue of byte buffers.
+ *
+ * Slots are allocated once, and only grow when a frame larger than the slot capacity is written. The producer owns
+ * the slot returned by frame_ring_write_begin until frame_ring_write_commit, the consumer owns the slot returned by
+ * frame_ring_read_begin until frame_ring_read_end.
+ */
+typedef struct frame_ring_slot_t {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    uint32_t flags;
+    /** Set by the producer, typically when the frame was received */
+    uint64_t timestamp;
+} frame_ring_slot_t;
+
+typedef struct frame_ring_stats_t {
+    /** Number of frames currently queued */
+    int occupancy;
+    int capacity;
+    /** Highest occupancy seen since creation */
+    int high_watermark;
+    uint32_t pushed;
+    uint32_t dropped;
+} frame_ring_stats_t;
+
+typedef struct frame_ring_t frame_ring_t;
+
+/**
+ * @param capacity Number of slots, rounded up to power of 2
+ * @param slot_size Initial storage size of each slot
+ * @return NULL if capacity is invalid or allocation failed
+ */
+frame_ring_t *frame_ring_create(int capacity, size_t slot_size);
+
+void frame_ring_destroy(frame_ring_t *ring);
+
+/**
+ * Producer side. Reserve next free slot with at least `size` bytes of storage.
+ * @return NULL if the ring is full, or growing the slot failed
+ */
+frame_ring_slot_t *frame_ring_write_begin(frame_ring_t *ring, size_t size);
+
+void frame_ring_write_commit(frame_ring_t *ring);
+
+/**
+ * Producer side. Record a frame that was discarded instead of being queued.
+ */
+void frame_ring_mark_dropped(frame_ring_t *ring);
+
+/**
+ * Consumer side.
+ * @return Oldest queued slot, or NULL if the ring is empty
+ */
+frame_ring_slot_t *frame_ring_read_begin(frame_ring_t *ring);
+
+void frame_ring_read_end(frame_ring_t *ring);
+
+int frame_ring_occupancy(frame_ring_t *ring);
+
+void frame_ring_get_stats(frame_ring_t *ring, frame_ring_stats_t *stats);
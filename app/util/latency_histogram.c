@@ -0,0 +1,74 @@
+#include "latency_histogram.h"
+
+#include <string.h>
+
+/* Values below this have a bucket each */
+#define LINEAR_LIMIT 4
+
+static int bucket_index(uint32_t us);
+
+static uint32_t bucket_upper_bound(int index);
+
+static uint32_t percentile(const latency_histogram_t *histogram, uint32_t permille);
+
+void latency_histogram_reset(latency_histogram_t *histogram) {
+    memset(histogram, 0, sizeof(latency_histogram_t));
+}
+
+void latency_histogram_record(latency_histogram_t *histogram, uint32_t us) {
+    histogram->buckets[bucket_index(us)]++;
+    histogram->count++;
+    histogram->total_us += us;
+    if (us > histogram->max_us) {
+        histogram->max_us = us;
+    }
+}
+
+void latency_histogram_summarize(const latency_histogram_t *histogram, latency_summary_t *summary) {
+    summary->count = histogram->count;
+    summary->max_us = histogram->max_us;
+    if (histogram->count == 0) {
+        summary->p50_us = summary->p95_us = summary->p99_us = summary->avg_us = 0;
+        return;
+    }
+    summary->avg_us = (uint32_t) (histogram->total_us / histogram->count);
+    summary->p50_us = percentile(histogram, 500);
+    summary->p95_us = percentile(histogram, 950);
+    summary->p99_us = percentile(histogram, 990);
+}
+
+/**
+ * Above LINEAR_LIMIT, the 2 bits after the most significant one select one of 4 buckets in its power of 2.
+ */
+static int bucket_index(uint32_t us) {
+    if (us < LINEAR_LIMIT) {
+        return (int) us;
+    }
+    int msb = 31 - __builtin_clz(us);
+    int index = (msb - 1) * 4 + (int) ((us >> (msb - 2)) & 3);
+    return index < LATENCY_HISTOGRAM_BUCKETS ? index : LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+static uint32_t bucket_upper_bound(int index) {
+    if (index < LINEAR_LIMIT) {
+        return (uint32_t) index;
+    }
+    int msb = index / 4 + 1, sub = index % 4;
+    uint64_t bound = ((uint64_t) (4 + sub + 1) << (msb - 2)) - 1;
+    return bound < UINT32_MAX ? (uint32_t) bound : UINT32_MAX;
+}
+
+static uint32_t percentile(const latency_histogram_t *histogram, uint32_t permille) {
+    // Rank of the sample, rounded up
+    uint64_t rank = ((uint64_t) histogram->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint32_t bound = bucket_upper_bound(i);
+            // Never report more than what was actually recorded
+            return bound < histogram->max_us ? bound : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Fixed-bucket histogram of durations in microseconds. Buckets grow exponentially, with 4 buckets per power of 2, so
+ * percentiles are within 25% of the recorded value over the whole range. Recording is not thread safe.
+ */
+#define LATENCY_HISTOGRAM_BUCKETS 96
+
+typedef struct latency_histogram_t {
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+} latency_histogram_t;
+
+typedef struct latency_summary_t {
+    uint32_t count;
+    /** Upper bound of the bucket each percentile falls in */
+    uint32_t p50_us, p95_us, p99_us;
+    uint32_t max_us;
+    uint32_t avg_us;
+} latency_summary_t;
+
+void latency_histogram_reset(latency_histogram_t *histogram);
+
+void latency_histogram_record(latency_histogram_t *histogram, uint32_t us);
+
+void latency_histogram_summarize(const latency_histogram_t *histogram, latency_summary_t *summary);
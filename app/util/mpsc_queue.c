@@ -0,0 +1,111 @@
+#include "mpsc_queue.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Slots are padded to this, so producers writing neighbouring slots don't share a cache line */
+#define MPSC_SLOT_ALIGN 64
+
+/**
+ * Sequence of a slot tells its state, relative to the position it is used for. It equals the position when free,
+ * position + 1 when committed, and becomes position + capacity once read, for the next round.
+ */
+typedef struct mpsc_slot_header_t {
+    SDL_atomic_t sequence;
+} mpsc_slot_header_t;
+
+struct mpsc_queue_t {
+    unsigned char *storage;
+    unsigned char *slots;
+    size_t slot_stride;
+    size_t element_offset;
+    int capacity;
+    /* Free running counters. Head is claimed by producers, tail is only accessed by the consumer */
+    SDL_atomic_t head;
+    int tail;
+};
+
+static inline mpsc_slot_header_t *slot_at(const mpsc_queue_t *queue, unsigned int position);
+
+static inline int sequence_diff(int sequence, unsigned int position);
+
+mpsc_queue_t *mpsc_queue_create(int capacity, size_t element_size) {
+    if (capacity <= 0) {
+        return NULL;
+    }
+    /* Round up to power of 2, so slot index stays continuous when the counters wrap around */
+    int pot = 1;
+    while (pot < capacity) {
+        pot <<= 1;
+    }
+    mpsc_queue_t *queue = calloc(1, sizeof(mpsc_queue_t));
+    queue->capacity = pot;
+    queue->element_offset = (sizeof(mpsc_slot_header_t) + sizeof(max_align_t) - 1) / sizeof(max_align_t) *
+                            sizeof(max_align_t);
+    queue->slot_stride = (queue->element_offset + element_size + MPSC_SLOT_ALIGN - 1) / MPSC_SLOT_ALIGN *
+                         MPSC_SLOT_ALIGN;
+    queue->storage = calloc(1, queue->slot_stride * pot + MPSC_SLOT_ALIGN);
+    if (queue->storage == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->slots = (unsigned char *) (((uintptr_t) queue->storage + MPSC_SLOT_ALIGN - 1) &
+                                      ~(uintptr_t) (MPSC_SLOT_ALIGN - 1));
+    for (int i = 0; i < pot; i++) {
+        SDL_AtomicSet(&slot_at(queue, i)->sequence, i);
+    }
+    return queue;
+}
+
+void mpsc_queue_destroy(mpsc_queue_t *queue) {
+    free(queue->storage);
+    free(queue);
+}
+
+void *mpsc_queue_write_begin(mpsc_queue_t *queue) {
+    int head = SDL_AtomicGet(&queue->head);
+    for (;;) {
+        mpsc_slot_header_t *slot = slot_at(queue, head);
+        int diff = sequence_diff(SDL_AtomicGet(&slot->sequence), head);
+        if (diff == 0) {
+            if (SDL_AtomicCAS(&queue->head, head, (int) ((unsigned int) head + 1))) {
+                return (unsigned char *) slot + queue->element_offset;
+            }
+        } else if (diff < 0) {
+            // Slot still holds an element from the previous round
+            return NULL;
+        }
+        head = SDL_AtomicGet(&queue->head);
+    }
+}
+
+void mpsc_queue_write_commit(mpsc_queue_t *queue, void *element) {
+    mpsc_slot_header_t *slot = (mpsc_slot_header_t *) ((unsigned char *) element - queue->element_offset);
+    // Only the producer owning the slot can change its sequence now
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&slot->sequence, (int) ((unsigned int) SDL_AtomicGet(&slot->sequence) + 1));
+}
+
+void *mpsc_queue_read_begin(mpsc_queue_t *queue) {
+    mpsc_slot_header_t *slot = slot_at(queue, queue->tail);
+    if (sequence_diff(SDL_AtomicGet(&slot->sequence), (unsigned int) queue->tail + 1) != 0) {
+        return NULL;
+    }
+    SDL_MemoryBarrierAcquire();
+    return (unsigned char *) slot + queue->element_offset;
+}
+
+void mpsc_queue_read_end(mpsc_queue_t *queue) {
+    mpsc_slot_header_t *slot = slot_at(queue, queue->tail);
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&slot->sequence, (int) ((unsigned int) queue->tail + queue->capacity));
+    queue->tail = (int) ((unsigned int) queue->tail + 1);
+}
+
+static inline mpsc_slot_header_t *slot_at(const mpsc_queue_t *queue, unsigned int position) {
+    return (mpsc_slot_header_t *) (queue->slots + (position & (queue->capacity - 1)) * queue->slot_stride);
+}
+
+static inline int sequence_diff(int sequence, unsigned int position) {
+    return (int) ((unsigned int) sequence - position);
+}
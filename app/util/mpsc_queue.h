@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <SDL.h>
+
+/**
+ * Bounded lock-free multi-producer/single-consumer queue of fixed size elements.
+ *
+ * Element storage is allocated once at creation. Any thread can write, producers claim a slot with a single CAS and
+ * never wait for each other. The producer owns the element returned by mpsc_queue_write_begin until
+ * mpsc_queue_write_commit, the consumer owns the element returned by mpsc_queue_read_begin until mpsc_queue_read_end.
+ */
+typedef struct mpsc_queue_t mpsc_queue_t;
+
+/**
+ * @param capacity Number of elements, rounded up to power of 2
+ * @param element_size Size of each element. Elements are aligned for any type
+ */
+mpsc_queue_t *mpsc_queue_create(int capacity, size_t element_size);
+
+void mpsc_queue_destroy(mpsc_queue_t *queue);
+
+/**
+ * Producer side, can be called from any thread.
+ * @return Storage of the claimed element, or NULL if the queue is full
+ */
+void *mpsc_queue_write_begin(mpsc_queue_t *queue);
+
+/**
+ * Producer side. Make the element returned by mpsc_queue_write_begin visible to the consumer.
+ */
+void mpsc_queue_write_commit(mpsc_queue_t *queue, void *element);
+
+/**
+ * Consumer side.
+ * @return Oldest element, or NULL if the queue is empty, or its producer hasn't committed it yet
+ */
+void *mpsc_queue_read_begin(mpsc_queue_t *queue);
+
+void mpsc_queue_read_end(mpsc_queue_t *queue);
@@ -1,81 +1,77 @@
-
 #include "bitstream.h"
 
+/* Longest Exp-Golomb prefix accepted, so the decoded value fits in 32 bits */
+#define UEG_MAX_LEADING_ZEROES 31
+
+static void bitstream_refill(bitstream_t *buf);
+
+static inline uint32_t bitstream_consume(bitstream_t *buf, uint32_t size);
 
 void bitstream_init(bitstream_t *buf, const unsigned char *data, size_t size) {
     buf->data = data;
     buf->data_size = size;
-    buf->offset = 0;
-    buf->consecutive_zeroes = 0;
+    buf->pos = 0;
+    buf->cache = 0;
+    buf->cache_bits = 0;
 }
 
 bool bitstream_read_bits(bitstream_t *buf, uint32_t size, uint32_t *value) {
     if (size > 32) return false;
-    uint32_t result = 0;
-    for (uint32_t i = 0; i < size; i++) {
-        if ((buf->offset + i) % 8 == 0) {
-            uint32_t byte_index = (buf->offset + i) / 8;
-            if (byte_index >= buf->data_size) {
-                return false;
-            }
-            unsigned char b = buf->data[byte_index];
-            if (b == 0) {
-                buf->consecutive_zeroes++;
-            } else if (b == 0x03 && buf->consecutive_zeroes == 2) {
-                if (++byte_index >= buf->data_size) {
-                    return false;
-                }
-                buf->offset += 8;
-                buf->consecutive_zeroes = buf->data[byte_index] == 0;
-            } else {
-                buf->consecutive_zeroes = 0;
-            }
-        }
-        uint32_t cur_offset = buf->offset + i;
-        uint32_t byte_index = cur_offset / 8;
-        if (byte_index >= buf->data_size) {
+    if (buf->cache_bits < size) {
+        bitstream_refill(buf);
+        if (buf->cache_bits < size) {
             return false;
         }
-        uint8_t bit_offset = 7 - cur_offset % 8;
-        result |= (buf->data[byte_index] >> bit_offset & 0x1) << (size - i - 1);
     }
-    buf->offset += size;
-    *value = result;
+    *value = bitstream_consume(buf, size);
     return true;
 }
 
-
 bool bitstream_skip_bits(bitstream_t *buf, uint32_t size) {
-    uint32_t tmp;
-    for (int i = 0; i < size; i += 16) {
-        if (!bitstream_read_bits(buf, size - i < 16 ? size - i : 16, &tmp)) return false;
+    while (size > buf->cache_bits) {
+        size -= buf->cache_bits;
+        buf->cache = 0;
+        buf->cache_bits = 0;
+        bitstream_refill(buf);
+        if (buf->cache_bits == 0) {
+            return false;
+        }
     }
+    bitstream_consume(buf, size);
     return true;
 }
 
 bool bitstream_read_ueg(bitstream_t *buf, uint32_t *value) {
-    uint32_t bitcount = 0;
-    uint32_t tmp;
-
-    for (;;) {
-        if (!bitstream_read_bits(buf, 1, &tmp)) return false;
-        if (tmp == 0) {
-            bitcount++;
-        } else {
-            // bitOffset--;
-            break;
-        }
+    if (buf->cache_bits < 64 - 7) {
+        bitstream_refill(buf);
     }
-
-    // bitOffset --;
-    uint32_t result = 0;
-    if (bitcount) {
-        if (!bitstream_read_bits(buf, bitcount, &tmp)) {
-            return false;
-        }
-        result = (uint32_t) ((1 << bitcount) - 1 + tmp);
+    uint32_t leading_zeroes;
+    if (buf->cache != 0) {
+        leading_zeroes = __builtin_clzll(buf->cache);
+    } else {
+        // Prefix longer than the cache, or no more data
+        leading_zeroes = buf->cache_bits;
+    }
+    if (leading_zeroes > UEG_MAX_LEADING_ZEROES) {
+        return false;
+    }
+    uint32_t code_size = leading_zeroes * 2 + 1;
+    if (code_size <= buf->cache_bits) {
+        // Whole code word is in cache: prefix zeroes, marker bit and suffix read as a single number
+        *value = (uint32_t) ((buf->cache >> (64 - code_size)) - 1);
+        bitstream_consume(buf, code_size);
+        return true;
+    }
+    // Only happens near the end of data
+    if (leading_zeroes + 1 > buf->cache_bits) {
+        return false;
+    }
+    bitstream_consume(buf, leading_zeroes + 1);
+    uint32_t suffix;
+    if (!bitstream_read_bits(buf, leading_zeroes, &suffix)) {
+        return false;
     }
-    *value = result;
+    *value = (uint32_t) ((1ULL << leading_zeroes) - 1 + suffix);
     return true;
 }
 
@@ -85,9 +81,9 @@ bool bitstream_read_eg(bitstream_t *buf, int32_t *value) {
         return false;
     }
     if (tmp & 0x01) {
-        *value = (int32_t) (tmp + 1) / 2;
+        *value = (int32_t) ((tmp >> 1) + 1);
     } else {
-        *value = (int32_t) -(tmp / 2);
+        *value = -(int32_t) (tmp >> 1);
     }
     return true;
 }
@@ -104,3 +100,23 @@ bool bitstream_skip_scaling_list(bitstream_t *buf, uint8_t count) {
     }
     return true;
 }
+
+/**
+ * Load whole bytes until the cache is full.
+ */
+static void bitstream_refill(bitstream_t *buf) {
+    while (buf->cache_bits <= 56 && buf->pos < buf->data_size) {
+        buf->cache |= (uint64_t) buf->data[buf->pos++] << (56 - buf->cache_bits);
+        buf->cache_bits += 8;
+    }
+}
+
+static inline uint32_t bitstream_consume(bitstream_t *buf, uint32_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    uint32_t value = (uint32_t) (buf->cache >> (64 - size));
+    buf->cache = size < 64 ? buf->cache << size : 0;
+    buf->cache_bits -= size;
+    return value;
+}
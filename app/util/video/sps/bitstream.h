@@ -7,14 +7,27 @@
 typedef struct bitstream_t {
     const unsigned char *data;
     size_t data_size;
-    uint32_t offset;
-    uint32_t consecutive_zeroes;
+    /** Index of the next byte to load into cache */
+    size_t pos;
+    /** Unread bits, aligned to the most significant bit */
+    uint64_t cache;
+    uint32_t cache_bits;
 } bitstream_t;
 
+/**
+ * @param data RBSP data, emulation prevention bytes already removed by sps_util_nal_to_rbsp
+ */
 void bitstream_init(bitstream_t *buf, const unsigned char *data, size_t size);
 
 bool bitstream_read_bits(bitstream_t *buf, uint32_t size, uint32_t *value);
 
+/**
+ * @return Number of bits read so far
+ */
+static inline size_t bitstream_tell(const bitstream_t *buf) {
+    return buf->pos * 8 - buf->cache_bits;
+}
+
 bool bitstream_read_eg(bitstream_t *buf, int32_t *value);
 
 bool bitstream_read_ueg(bitstream_t *buf, uint32_t *value);
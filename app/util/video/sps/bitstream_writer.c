@@ -0,0 +1,87 @@
+#include "bitstream_writer.h"
+
+static bool bitstream_writer_flush(bitstream_writer_t *writer);
+
+void bitstream_writer_init(bitstream_writer_t *writer, unsigned char *data, size_t capacity) {
+    writer->data = data;
+    writer->capacity = capacity;
+    writer->size = 0;
+    writer->cache = 0;
+    writer->cache_bits = 0;
+}
+
+bool bitstream_write_bits(bitstream_writer_t *writer, uint32_t size, uint32_t value) {
+    if (size > 32) return false;
+    if (size == 0) return true;
+    // Cache holds less than 8 bits between calls, so the value always fits
+    uint64_t bits = size < 32 ? value & ((1U << size) - 1) : value;
+    writer->cache |= bits << (64 - writer->cache_bits - size);
+    writer->cache_bits += size;
+    return bitstream_writer_flush(writer);
+}
+
+bool bitstream_write_ueg(bitstream_writer_t *writer, uint32_t value) {
+    uint64_t code = (uint64_t) value + 1;
+    uint32_t code_bits = 64 - __builtin_clzll(code);
+    // Prefix zeroes, then the code with its leading 1 as marker bit
+    if (!bitstream_write_bits(writer, code_bits - 1, 0)) return false;
+    if (code_bits > 32) {
+        if (!bitstream_write_bits(writer, code_bits - 32, (uint32_t) (code >> 32))) return false;
+        code_bits = 32;
+    }
+    return bitstream_write_bits(writer, code_bits, (uint32_t) code);
+}
+
+bool bitstream_write_eg(bitstream_writer_t *writer, int32_t value) {
+    uint32_t code;
+    if (value > 0) {
+        code = (uint32_t) value * 2 - 1;
+    } else {
+        code = (uint32_t) -(int64_t) value * 2;
+    }
+    return bitstream_write_ueg(writer, code);
+}
+
+bool bitstream_write_trailing_bits(bitstream_writer_t *writer) {
+    if (!bitstream_write_bits(writer, 1, 1)) return false;
+    if (writer->cache_bits % 8 != 0) {
+        if (!bitstream_write_bits(writer, 8 - writer->cache_bits % 8, 0)) return false;
+    }
+    return true;
+}
+
+bool bitstream_copy_bits(bitstream_t *buf, bitstream_writer_t *writer, size_t size) {
+    uint32_t value;
+    while (size > 0) {
+        uint32_t chunk = size > 32 ? 32 : (uint32_t) size;
+        if (!bitstream_read_bits(buf, chunk, &value)) return false;
+        if (!bitstream_write_bits(writer, chunk, value)) return false;
+        size -= chunk;
+    }
+    return true;
+}
+
+size_t bitstream_rbsp_stop_bit(const unsigned char *data, size_t size) {
+    while (size > 0 && data[size - 1] == 0) {
+        size--;
+    }
+    if (size == 0) {
+        return 0;
+    }
+    return size * 8 - 1 - __builtin_ctz(data[size - 1]);
+}
+
+/**
+ * Move whole bytes out of the cache.
+ */
+static bool bitstream_writer_flush(bitstream_writer_t *writer) {
+    while (writer->cache_bits >= 8) {
+        if (writer->size >= writer->capacity) {
+            return false;
+        }
+        writer->data[writer->size++] = (unsigned char) (writer->cache >> 56);
+        writer->cache <<= 8;
+        writer->cache_bits -= 8;
+    }
+    return true;
+}
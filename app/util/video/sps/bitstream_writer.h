@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bitstream.h"
+
+/**
+ * Counterpart of bitstream_t. Produces RBSP data, use sps_util_rbsp_to_nal to insert emulation prevention bytes.
+ */
+typedef struct bitstream_writer_t {
+    unsigned char *data;
+    size_t capacity;
+    /** Number of whole bytes written to data */
+    size_t size;
+    /** Pending bits, aligned to the most significant bit */
+    uint64_t cache;
+    uint32_t cache_bits;
+} bitstream_writer_t;
+
+void bitstream_writer_init(bitstream_writer_t *writer, unsigned char *data, size_t capacity);
+
+/**
+ * @param size Number of bits, up to 32
+ * @return false if the buffer is full
+ */
+bool bitstream_write_bits(bitstream_writer_t *writer, uint32_t size, uint32_t value);
+
+bool bitstream_write_ueg(bitstream_writer_t *writer, uint32_t value);
+
+bool bitstream_write_eg(bitstream_writer_t *writer, int32_t value);
+
+/**
+ * Write rbsp_stop_one_bit and alignment zero bits. writer->size is the RBSP size afterwards.
+ */
+bool bitstream_write_trailing_bits(bitstream_writer_t *writer);
+
+/**
+ * Read `size` bits from buf, and write them as-is.
+ */
+bool bitstream_copy_bits(bitstream_t *buf, bitstream_writer_t *writer, size_t size);
+
+/**
+ * @return Position in bits of rbsp_stop_one_bit, or 0 if the RBSP has none
+ */
+size_t bitstream_rbsp_stop_bit(const unsigned char *data, size_t size);
@@ -17,4 +17,4 @@ int sps_util_nal_skip_start_code(const unsigned char *data, size_t size, size_t
         }
     }
     return -1;
-}
\ No newline at end of file
+}
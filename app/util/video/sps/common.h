@@ -3,7 +3,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "sps_util.h"
 #include "bitstream.h"
+#include "bitstream_writer.h"
 
 #define bitstream_skip_bits_checked(s, v) if (!bitstream_skip_bits((s), (v))) return false
 
@@ -17,6 +19,8 @@
 
 #define bitstream_read8_checked(s, v) if (!bitstream_read8((s), (v))) return false
 
+#define bitstream_read_bits_checked(s, n, v) if (!bitstream_read_bits((s), (n), (v))) return false
+
 #define bitstream_read_eg_checked(s, v) if (!bitstream_read_eg((s), (v))) return false
 
 #define bitstream_read_ueg_checked(s, v) if (!bitstream_read_ueg((s), (v))) return false
@@ -26,7 +30,84 @@
 #define CHECK_RETURN(ret) if (!(ret)) return false
 
 /**
- *
+ * Divide both terms by their greatest common divisor, so frame rates read like 60/1 instead of 120/2
+ */
+static inline void sps_util_reduce_fraction(uint32_t *num, uint32_t *den) {
+    uint32_t a = *num, b = *den;
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    if (a > 1) {
+        *num /= a;
+        *den /= a;
+    }
+}
+
+typedef enum sps_patch_kind_t {
+    /** vui_parameters_present_flag is 0 */
+    SPS_PATCH_H264_NO_VUI,
+    /** bitstream_restriction_flag is 0 */
+    SPS_PATCH_H264_NO_RESTRICTION,
+    /** num_reorder_frames and max_dec_frame_buffering */
+    SPS_PATCH_H264_RESTRICTION,
+    /** sub_layer_ordering_info_present_flag and the sub-layer ordering info */
+    SPS_PATCH_HEVC_ORDERING_INFO,
+} sps_patch_kind_t;
+
+/**
+ * Range of an SPS RBSP, in bits, holding the fields that control decoder output delay
+ */
+typedef struct sps_patch_t {
+    sps_patch_kind_t kind;
+    size_t begin;
+    size_t end;
+    /** HEVC: long-term reference pictures are used, so the picture buffer can't be sized from short-term sets */
+    bool long_term_refs;
+    /** HEVC: sps_max_latency_increase_plus1 of the highest sub-layer, kept by the rewrite */
+    uint32_t max_latency_increase_plus1;
+} sps_patch_t;
+
+typedef bool (*sps_patch_write_fn)(bitstream_writer_t *writer, const sps_info_t *info, const sps_patch_t *patch);
+
+/**
+ * Copy an SPS RBSP, with the patched range replaced by what write_fn writes, and insert emulation prevention bytes.
+ */
+bool sps_util_patch_sps(const unsigned char *rbsp, size_t rbsp_size, const sps_patch_t *patch, const sps_info_t *info,
+                        sps_patch_write_fn write_fn, unsigned char *out, size_t out_capacity, size_t *out_size);
+
+/**
+ * Parse st_ref_pic_set(idx) of HEVC, from an SPS or a slice header.
+ * @param num_sets num_short_term_ref_pic_sets of the SPS. idx equals it in slice headers
+ * @param sets Sets of the SPS, sets predicted from another one need them
+ */
+bool sps_util_parse_st_ref_pic_set_hevc(bitstream_t *buf, uint32_t idx, uint32_t num_sets,
+                                        const sps_ref_pic_set_t *sets, sps_ref_pic_set_t *rps);
+
+/* Parameter sets come before any slice, so searching for them doesn't need to index the whole access unit */
+#define NAL_INDEX_SEARCH_SIZE 16
+
+/**
+ * Byte-by-byte scanner, superseded by sps_util_find_start_code. Kept as reference for benchmarks.
  * @return Index of the first byte of the NAL needed
  */
-int sps_util_nal_skip_start_code(const unsigned char *data, size_t size, size_t begin);
\ No newline at end of file
+int sps_util_nal_skip_start_code(const unsigned char *data, size_t size, size_t begin);
+
+/**
+ * Uses SSE2 or NEON kernel when available at build time, otherwise same as sps_util_find_start_code_scalar.
+ * @return Index of the first byte of next 00 00 01 start code, or size if not found
+ */
+size_t sps_util_find_start_code(const unsigned char *data, size_t size, size_t begin);
+
+size_t sps_util_find_start_code_scalar(const unsigned char *data, size_t size, size_t begin);
+
+/**
+ * @return Index of the first byte of next 00 00 03 sequence, or size if not found
+ */
+size_t sps_util_find_emulation_prevention(const unsigned char *data, size_t size, size_t begin);
+
+/**
+ * @return Name of the kernel used by sps_util_find_start_code
+ */
+const char *sps_util_find_start_code_kernel();
@@ -9,6 +9,332 @@ typedef struct sps_dimension_t {
     uint16_t height;
 } sps_dimension_t;
 
+/**
+ * Sequence level parameters useful to configure a decoder
+ */
+typedef struct sps_info_t {
+    sps_dimension_t dimension;
+    /** profile_idc for H.264, general_profile_idc for HEVC */
+    uint8_t profile_idc;
+    /** level_idc for H.264 (level * 10), general_level_idc for HEVC (level * 30) */
+    uint8_t level_idc;
+    /** 0: monochrome, 1: 4:2:0, 2: 4:2:2, 3: 4:4:4 */
+    uint8_t chroma_format_idc;
+    uint8_t bit_depth_luma;
+    uint8_t bit_depth_chroma;
+    uint8_t max_num_ref_frames;
+    /** Size in bits of frame_num in slice headers, H.264 only. 0 if unknown */
+    uint8_t log2_max_frame_num;
+    /** Size in bits of pic_order_cnt_lsb in slice headers, 0 if not present or unknown */
+    uint8_t log2_max_pic_order_cnt_lsb;
+    bool separate_colour_plane;
+    /** H.264 only, frame_num can skip values without any frame being lost */
+    bool frame_num_gaps_allowed;
+    /** Number of frames that can precede any frame in decoding order and follow it in output order, or -1 if unknown */
+    int8_t max_num_reorder_frames;
+    /** Required size of the decoded picture buffer in frames, or -1 if unknown */
+    int8_t max_dec_frame_buffering;
+    /** Frame rate from VUI timing info, or 0/0 if not present */
+    uint32_t frame_rate_num, frame_rate_den;
+    bool full_range;
+    /** Code points of ITU-T H.273, 2 (unspecified) if colour description is not present */
+    uint8_t colour_primaries;
+    uint8_t transfer_characteristics;
+    uint8_t matrix_coefficients;
+} sps_info_t;
+
+typedef enum sps_nal_type_h264_t {
+    SPS_NAL_H264_SLICE = 1,
+    SPS_NAL_H264_IDR = 5,
+    SPS_NAL_H264_SEI = 6,
+    SPS_NAL_H264_SPS = 7,
+    SPS_NAL_H264_PPS = 8,
+    SPS_NAL_H264_AUD = 9,
+    SPS_NAL_H264_FILLER = 12,
+} sps_nal_type_h264_t;
+
+typedef enum sps_nal_type_hevc_t {
+    SPS_NAL_HEVC_BLA_W_LP = 16,
+    SPS_NAL_HEVC_IDR_W_RADL = 19,
+    SPS_NAL_HEVC_IDR_N_LP = 20,
+    SPS_NAL_HEVC_CRA = 21,
+    SPS_NAL_HEVC_VPS = 32,
+    SPS_NAL_HEVC_SPS = 33,
+    SPS_NAL_HEVC_PPS = 34,
+    SPS_NAL_HEVC_AUD = 35,
+    SPS_NAL_HEVC_FILLER = 38,
+    SPS_NAL_HEVC_PREFIX_SEI = 39,
+    SPS_NAL_HEVC_SUFFIX_SEI = 40,
+} sps_nal_type_hevc_t;
+
+/**
+ * How a frame is used by following frames, by order of importance
+ */
+typedef enum sps_frame_type_t {
+    SPS_FRAME_UNKNOWN = 0,
+    /** IDR for H.264, any IRAP picture for HEVC. Decoding can restart from here */
+    SPS_FRAME_IDR,
+    /** Intra coded, but frames after it may still reference frames before it */
+    SPS_FRAME_I,
+    /** Inter coded, and referenced by following frames */
+    SPS_FRAME_P,
+    /** Not referenced by any other frame, can be dropped without breaking decoding */
+    SPS_FRAME_NON_REF,
+} sps_frame_type_t;
+
+/** Limit of num_short_term_ref_pic_sets in HEVC SPS */
+#define SPS_MAX_SHORT_TERM_REF_PIC_SETS 64
+
+/**
+ * HEVC short-term reference picture set, as picture order count differences from the picture using it
+ */
+typedef struct sps_ref_pic_set_t {
+    uint8_t num_negative, num_positive;
+    /** DeltaPocS0 then DeltaPocS1, closest pictures first. A predicted set may start DeltaPocS1 with 0, as HM does */
+    int32_t delta_poc[16];
+    /** Bit i is set if the picture of delta_poc[i] is referenced by the current picture. Others are only kept */
+    uint16_t used_by_curr;
+} sps_ref_pic_set_t;
+
+/**
+ * Carried from one access unit to the next by the slice header parsers. Zero-initialize before first use
+ */
+typedef struct sps_slice_state_t {
+    /** From the last PPS seen, needed to locate slice_type */
+    uint8_t num_extra_slice_header_bits;
+    bool output_flag_present;
+    /** From the last SPS, see sps_util_slice_state_set_sps. Frame order is only read once they are known */
+    uint8_t log2_max_frame_num;
+    uint8_t log2_max_pic_order_cnt_lsb;
+    bool separate_colour_plane;
+    bool frame_num_gaps_allowed;
+    /** Frames are decoded in a different order than displayed, so picture order count isn't monotonic */
+    bool reordering;
+    /** HEVC, from the last SPS, see sps_util_slice_state_set_ref_pic_sets_hevc. Slice reference picture sets are
+     * only read once they are known */
+    bool has_ref_pic_sets;
+    uint8_t num_short_term_ref_pic_sets;
+    sps_ref_pic_set_t short_term_ref_pic_sets[SPS_MAX_SHORT_TERM_REF_PIC_SETS];
+} sps_slice_state_t;
+
+/**
+ * What the slice header of the first slice tells about an access unit
+ */
+typedef struct sps_frame_header_t {
+    sps_frame_type_t type;
+    /** false if order couldn't be read, or isn't needed as the frame is not a reference (H.264 only) */
+    bool has_order;
+    /** frame_num for H.264, slice_pic_order_cnt_lsb for HEVC */
+    uint32_t order;
+    /** HEVC only */
+    uint8_t nal_unit_type;
+    uint8_t temporal_id;
+    /** HEVC only, false if the short-term reference picture set couldn't be read */
+    bool has_ref_pic_set;
+    sps_ref_pic_set_t ref_pic_set;
+} sps_frame_header_t;
+
+/** Pictures of a reference picture set, and the picture using it */
+#define SPS_FRAME_ORDER_MAX_REFS 17
+
+/**
+ * Follows frame order of reference frames, to find out when one is missing. Zero-initialize before first use
+ */
+typedef struct sps_frame_order_t {
+    /** last holds order of the previous reference frame for H.264, and refs is complete for HEVC */
+    bool valid;
+    /** A reference frame was missing, and no IDR was seen since */
+    bool broken;
+    uint32_t last;
+    /** HEVC only, picture order count of the previous picture with TemporalId 0, that is neither a leading nor a
+     * sub-layer non-reference picture. Base of PicOrderCntMsb */
+    int32_t prev_tid0_poc;
+    /** HEVC only, picture order counts of the pictures received that the next one can reference, as kept by the
+     * reference picture set of the last one */
+    int32_t refs[SPS_FRAME_ORDER_MAX_REFS];
+    uint8_t num_refs;
+} sps_frame_order_t;
+
+/**
+ * Location of a NAL unit in an access unit
+ */
+typedef struct sps_nal_unit_t {
+    /** Offset of the NAL unit header, right after the start code */
+    uint32_t offset;
+    /** Size of the NAL unit, excluding start code and trailing zero bytes */
+    uint32_t size;
+    uint8_t type;
+} sps_nal_unit_t;
+
+/**
+ * Reusable storage for RBSP data, when emulation prevention bytes have to be removed.
+ * Zero-initialize before first use, and release with sps_util_rbsp_buffer_free.
+ */
+typedef struct sps_rbsp_buffer_t {
+    unsigned char *data;
+    size_t capacity;
+} sps_rbsp_buffer_t;
+
 bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_dimension_t *dimension);
 
-bool sps_util_parse_dimension_hevc(const unsigned char *data, size_t size, sps_dimension_t *dimension);
\ No newline at end of file
+bool sps_util_parse_dimension_hevc(const unsigned char *data, size_t size, sps_dimension_t *dimension);
+
+/**
+ * Parse dimension from a single SPS NAL unit, as located by the NAL index.
+ * @param nal Pointer to the NAL unit header
+ * @param scratch Used if the NAL unit contains emulation prevention bytes. Can be NULL
+ */
+bool sps_util_parse_sps_dimension_h264(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                       sps_dimension_t *dimension);
+
+bool sps_util_parse_sps_dimension_hevc(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                       sps_dimension_t *dimension);
+
+/**
+ * Parse every sequence level parameter in sps_info_t from a single SPS NAL unit. Costs more than parsing dimension
+ * only, as the SPS has to be read until the end of VUI timing info.
+ * @param scratch Used if the NAL unit contains emulation prevention bytes. Can be NULL
+ */
+bool sps_util_parse_sps_info_h264(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                  sps_info_t *info);
+
+bool sps_util_parse_sps_info_hevc(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                  sps_info_t *info);
+
+/** Largest SPS NAL unit the rewrite functions can produce */
+#define SPS_UTIL_REWRITE_MAX_SIZE 1024
+
+/**
+ * Rewrite an SPS so the decoder outputs each frame as soon as it's decoded, instead of filling its picture buffer
+ * first. For H.264, VUI bitstream_restriction is added if missing, with num_reorder_frames=0 and
+ * max_dec_frame_buffering reduced to max_num_ref_frames. An existing non-zero num_reorder_frames is kept, as frames
+ * would be displayed out of order otherwise.
+ * @param out Receives the rewritten NAL unit, starting with the NAL header
+ * @return false if the SPS can't be parsed or out is too small
+ */
+bool sps_util_rewrite_sps_low_latency_h264(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                           unsigned char *out, size_t out_capacity, size_t *out_size);
+
+/**
+ * HEVC signals picture buffering in the SPS itself rather than in VUI, so sps_max_dec_pic_buffering_minus1 is reduced
+ * to the largest reference picture set. sps_max_latency_increase_plus1 is kept.
+ */
+bool sps_util_rewrite_sps_low_latency_hevc(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                           unsigned char *out, size_t out_capacity, size_t *out_size);
+
+/**
+ * Convert a NAL unit to RBSP, by removing emulation prevention bytes (the 03 in 00 00 03).
+ * @param scratch Receives the RBSP if any emulation prevention byte was found, and grown if needed
+ * @param rbsp Set to nal itself if there is nothing to remove, otherwise to scratch->data
+ * @return false if growing the scratch buffer failed
+ */
+bool sps_util_nal_to_rbsp(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                          const unsigned char **rbsp, size_t *rbsp_size);
+
+/**
+ * Reverse of sps_util_nal_to_rbsp, insert emulation prevention bytes so no start code appears in the NAL unit.
+ * @return false if nal_capacity is too small
+ */
+bool sps_util_rbsp_to_nal(const unsigned char *rbsp, size_t rbsp_size, unsigned char *nal, size_t nal_capacity,
+                          size_t *nal_size);
+
+void sps_util_rbsp_buffer_free(sps_rbsp_buffer_t *scratch);
+
+/**
+ * Locate the SPS NAL unit in an access unit.
+ * @param nal Set to the NAL unit header, after the start code
+ * @param nal_size Set to size of the NAL unit, until next start code or end of data
+ * @return false if no SPS found
+ */
+bool sps_util_find_sps_h264(const unsigned char *data, size_t size, const unsigned char **nal, size_t *nal_size);
+
+bool sps_util_find_sps_hevc(const unsigned char *data, size_t size, const unsigned char **nal, size_t *nal_size);
+
+/**
+ * Scan an access unit once, and record offset, size and type of every NAL unit in it.
+ * @param units Table to fill
+ * @param max_units Capacity of the table. Scanning stops when the table is full
+ * @return Number of NAL units recorded
+ */
+int sps_util_nal_index_h264(const unsigned char *data, size_t size, sps_nal_unit_t *units, int max_units);
+
+int sps_util_nal_index_hevc(const unsigned char *data, size_t size, sps_nal_unit_t *units, int max_units);
+
+/**
+ * @return First NAL unit of given type in the table, or NULL if not found
+ */
+const sps_nal_unit_t *sps_util_nal_index_find(const sps_nal_unit_t *units, int count, uint8_t type);
+
+/** Bit of a NAL unit type in the mask given to the NAL filter */
+#define SPS_NAL_TYPE_BIT(type) (1ULL << (type))
+
+/**
+ * Remove NAL units of given types from an access unit, with their start code, by moving the following data over them.
+ * Nothing is moved before the first removed NAL unit.
+ * @param drop_types Mask of SPS_NAL_TYPE_BIT of types to remove
+ * @return New size of the access unit
+ */
+size_t sps_util_nal_filter_h264(unsigned char *data, size_t size, uint64_t drop_types);
+
+size_t sps_util_nal_filter_hevc(unsigned char *data, size_t size, uint64_t drop_types);
+
+/**
+ * @return true if a NAL unit of this type starts a picture that can be decoded without reference pictures
+ */
+bool sps_util_nal_is_keyframe_h264(uint8_t type);
+
+bool sps_util_nal_is_keyframe_hevc(uint8_t type);
+
+/**
+ * Classify an access unit from the NAL header and slice header of its first slice. Only the beginning of the access
+ * unit is scanned, up to the first slice.
+ */
+sps_frame_type_t sps_util_classify_frame_h264(const unsigned char *data, size_t size);
+
+/**
+ * @param state Updated by PPS found in the access unit
+ */
+sps_frame_type_t sps_util_classify_frame_hevc(const unsigned char *data, size_t size, sps_slice_state_t *state);
+
+const char *sps_util_frame_type_name(sps_frame_type_t type);
+
+/**
+ * Copy what the slice header parsers need from a newly parsed SPS.
+ */
+void sps_util_slice_state_set_sps(sps_slice_state_t *state, const sps_info_t *info);
+
+/**
+ * Read the short-term reference picture sets of an HEVC SPS, which slices refer to by index. Call after
+ * sps_util_slice_state_set_sps with the same SPS.
+ * @return false if the SPS can't be parsed, slice reference picture sets won't be read then
+ */
+bool sps_util_slice_state_set_ref_pic_sets_hevc(sps_slice_state_t *state, const unsigned char *nal, size_t nal_size,
+                                                sps_rbsp_buffer_t *scratch);
+
+/**
+ * Parse the first slice header of an access unit, up to frame_num or slice_pic_order_cnt_lsb.
+ * @return false if no slice found, or its header can't be parsed
+ */
+bool sps_util_parse_frame_header_h264(const unsigned char *data, size_t size, const sps_slice_state_t *state,
+                                      sps_frame_header_t *header);
+
+/**
+ * @param state Updated by PPS found in the access unit
+ */
+bool sps_util_parse_frame_header_hevc(const unsigned char *data, size_t size, sps_slice_state_t *state,
+                                      sps_frame_header_t *header);
+
+/**
+ * Check no reference frame is missing before this one. For H.264, frame_num increments by one with each reference
+ * frame. HEVC has no such counter, so the pictures a slice references, from its reference picture set, must have
+ * been received, and not dropped by the reference picture sets of the pictures since. Encoder frame skips and lost
+ * pictures nothing references are not gaps. RASL pictures, and pictures whose reference picture set can't be read,
+ * are not checked.
+ * @return false if at least one reference frame is missing before this one, and for every following frame until next
+ * IDR, or IRAP picture for HEVC, as they may reference the missing frame
+ */
+bool sps_util_frame_order_check_h264(sps_frame_order_t *order, const sps_slice_state_t *state,
+                                     const sps_frame_header_t *header);
+
+bool sps_util_frame_order_check_hevc(sps_frame_order_t *order, const sps_slice_state_t *state,
+                                     const sps_frame_header_t *header);
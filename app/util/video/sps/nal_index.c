@@ -0,0 +1,115 @@
+#include "sps_util.h"
+#include "common.h"
+
+#include <string.h>
+
+/* NAL units indexed at once by the filter. Access units with more of them are indexed in several passes */
+#define NAL_FILTER_BATCH_SIZE 32
+
+typedef uint8_t (*nal_type_fn)(const unsigned char *header);
+
+typedef int (*nal_index_fn)(const unsigned char *data, size_t size, sps_nal_unit_t *units, int max_units);
+
+static int nal_index(const unsigned char *data, size_t size, sps_nal_unit_t *units, int max_units,
+                     nal_type_fn type_fn);
+
+static size_t nal_filter(unsigned char *data, size_t size, uint64_t drop_types, nal_index_fn index_fn);
+
+static uint8_t nal_type_h264(const unsigned char *header);
+
+static uint8_t nal_type_hevc(const unsigned char *header);
+
+int sps_util_nal_index_h264(const unsigned char *data, size_t size, sps_nal_unit_t *units, int max_units) {
+    return nal_index(data, size, units, max_units, nal_type_h264);
+}
+
+int sps_util_nal_index_hevc(const unsigned char *data, size_t size, sps_nal_unit_t *units, int max_units) {
+    return nal_index(data, size, units, max_units, nal_type_hevc);
+}
+
+size_t sps_util_nal_filter_h264(unsigned char *data, size_t size, uint64_t drop_types) {
+    return nal_filter(data, size, drop_types, sps_util_nal_index_h264);
+}
+
+size_t sps_util_nal_filter_hevc(unsigned char *data, size_t size, uint64_t drop_types) {
+    return nal_filter(data, size, drop_types, sps_util_nal_index_hevc);
+}
+
+const sps_nal_unit_t *sps_util_nal_index_find(const sps_nal_unit_t *units, int count, uint8_t type) {
+    for (int i = 0; i < count; i++) {
+        if (units[i].type == type) {
+            return &units[i];
+        }
+    }
+    return NULL;
+}
+
+bool sps_util_nal_is_keyframe_h264(uint8_t type) {
+    return type == SPS_NAL_H264_IDR;
+}
+
+bool sps_util_nal_is_keyframe_hevc(uint8_t type) {
+    // BLA, IDR and CRA pictures are all IRAP pictures
+    return type >= SPS_NAL_HEVC_BLA_W_LP && type <= SPS_NAL_HEVC_CRA;
+}
+
+static int nal_index(const unsigned char *data, size_t size, sps_nal_unit_t *units, int max_units,
+                     nal_type_fn type_fn) {
+    int count = 0;
+    size_t start_code = sps_util_find_start_code(data, size, 0);
+    while (start_code < size && count < max_units) {
+        size_t begin = start_code + 3;
+        size_t next = sps_util_find_start_code(data, size, begin);
+        size_t end = next;
+        // Leading zero of a 4-byte start code, or trailing_zero_8bits
+        while (end > begin && data[end - 1] == 0) {
+            end--;
+        }
+        if (end > begin) {
+            sps_nal_unit_t *unit = &units[count++];
+            unit->offset = (uint32_t) begin;
+            unit->size = (uint32_t) (end - begin);
+            unit->type = type_fn(data + begin);
+        }
+        start_code = next;
+    }
+    return count;
+}
+
+/**
+ * Each NAL unit owns the bytes from the end of the previous one to its own end, so a removed NAL unit takes its start
+ * code and the trailing zeroes before it along.
+ */
+static size_t nal_filter(unsigned char *data, size_t size, uint64_t drop_types, nal_index_fn index_fn) {
+    sps_nal_unit_t units[NAL_FILTER_BATCH_SIZE];
+    // Beginning of the next NAL unit to keep or drop, and end of kept data
+    size_t read = 0, write = 0;
+    int count;
+    do {
+        size_t base = read;
+        count = index_fn(data + base, size - base, units, NAL_FILTER_BATCH_SIZE);
+        for (int i = 0; i < count; i++) {
+            size_t end = base + units[i].offset + units[i].size;
+            if (!(drop_types & SPS_NAL_TYPE_BIT(units[i].type))) {
+                if (write != read) {
+                    memmove(data + write, data + read, end - read);
+                }
+                write += end - read;
+            }
+            read = end;
+        }
+    } while (count == NAL_FILTER_BATCH_SIZE);
+    // Trailing zeroes, or data not indexed
+    if (write != read) {
+        memmove(data + write, data + read, size - read);
+    }
+    return write + size - read;
+}
+
+static uint8_t nal_type_h264(const unsigned char *header) {
+    return header[0] & 0x1F;
+}
+
+static uint8_t nal_type_hevc(const unsigned char *header) {
+    return (header[0] & 0x7E) >> 1;
+}
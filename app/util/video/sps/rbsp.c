@@ -0,0 +1,62 @@
+#include "sps_util.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool sps_util_nal_to_rbsp(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                          const unsigned char **rbsp, size_t *rbsp_size) {
+    size_t ep = sps_util_find_emulation_prevention(nal, nal_size, 0);
+    if (ep >= nal_size) {
+        *rbsp = nal;
+        *rbsp_size = nal_size;
+        return true;
+    }
+    if (scratch->capacity < nal_size) {
+        unsigned char *data = realloc(scratch->data, nal_size);
+        if (data == NULL) {
+            return false;
+        }
+        scratch->data = data;
+        scratch->capacity = nal_size;
+    }
+    size_t copied = 0, begin = 0;
+    while (ep < nal_size) {
+        // Keep the two zeroes, drop the 03
+        size_t chunk = ep + 2 - begin;
+        memcpy(scratch->data + copied, nal + begin, chunk);
+        copied += chunk;
+        begin = ep + 3;
+        ep = sps_util_find_emulation_prevention(nal, nal_size, begin);
+    }
+    memcpy(scratch->data + copied, nal + begin, nal_size - begin);
+    copied += nal_size - begin;
+    *rbsp = scratch->data;
+    *rbsp_size = copied;
+    return true;
+}
+
+bool sps_util_rbsp_to_nal(const unsigned char *rbsp, size_t rbsp_size, unsigned char *nal, size_t nal_capacity,
+                          size_t *nal_size) {
+    size_t size = 0;
+    int zeroes = 0;
+    for (size_t i = 0; i < rbsp_size; i++) {
+        unsigned char byte = rbsp[i];
+        if (zeroes == 2 && byte <= 3) {
+            if (size >= nal_capacity) return false;
+            nal[size++] = 3;
+            zeroes = 0;
+        }
+        if (size >= nal_capacity) return false;
+        nal[size++] = byte;
+        zeroes = byte == 0 ? zeroes + 1 : 0;
+    }
+    *nal_size = size;
+    return true;
+}
+
+void sps_util_rbsp_buffer_free(sps_rbsp_buffer_t *scratch) {
+    free(scratch->data);
+    scratch->data = NULL;
+    scratch->capacity = 0;
+}
@@ -0,0 +1,406 @@
+#include <string.h>
+
+#include "sps_util.h"
+#include "common.h"
+
+/* Slice header fields needed, up to the HEVC reference picture set, are always within the first bytes of the NAL
+ * unit */
+#define SLICE_HEADER_PEEK_SIZE 64
+
+typedef struct slice_peek_t {
+    unsigned char data[SLICE_HEADER_PEEK_SIZE];
+    size_t size;
+} slice_peek_t;
+
+static void peek_rbsp(const unsigned char *nal, size_t available, slice_peek_t *peek);
+
+static bool parse_slice_h264(const unsigned char *nal, size_t available, const sps_slice_state_t *state,
+                             sps_frame_header_t *header);
+
+static bool parse_slice_hevc(const unsigned char *nal, size_t available, const sps_slice_state_t *state,
+                             sps_frame_header_t *header);
+
+static void parse_pps_hevc(const unsigned char *nal, size_t available, sps_slice_state_t *state);
+
+static int32_t pic_order_cnt_hevc(const sps_frame_order_t *order, const sps_slice_state_t *state,
+                                  const sps_frame_header_t *header);
+
+static bool has_ref_hevc(const sps_frame_order_t *order, int32_t poc);
+
+sps_frame_type_t sps_util_classify_frame_h264(const unsigned char *data, size_t size) {
+    static const sps_slice_state_t no_sps = {0};
+    sps_frame_header_t header;
+    if (!sps_util_parse_frame_header_h264(data, size, &no_sps, &header)) {
+        return SPS_FRAME_UNKNOWN;
+    }
+    return header.type;
+}
+
+sps_frame_type_t sps_util_classify_frame_hevc(const unsigned char *data, size_t size, sps_slice_state_t *state) {
+    sps_frame_header_t header;
+    if (!sps_util_parse_frame_header_hevc(data, size, state, &header)) {
+        return SPS_FRAME_UNKNOWN;
+    }
+    return header.type;
+}
+
+bool sps_util_parse_frame_header_h264(const unsigned char *data, size_t size, const sps_slice_state_t *state,
+                                      sps_frame_header_t *header) {
+    size_t start_code = sps_util_find_start_code(data, size, 0);
+    while (start_code < size) {
+        size_t begin = start_code + 3;
+        if (begin >= size) {
+            break;
+        }
+        uint8_t type = data[begin] & 0x1F;
+        if (type >= SPS_NAL_H264_SLICE && type <= SPS_NAL_H264_IDR) {
+            // Every slice of a picture has the same type and reference status, the first one is enough
+            return parse_slice_h264(data + begin, size - begin, state, header);
+        }
+        start_code = sps_util_find_start_code(data, size, begin);
+    }
+    return false;
+}
+
+bool sps_util_parse_frame_header_hevc(const unsigned char *data, size_t size, sps_slice_state_t *state,
+                                      sps_frame_header_t *header) {
+    size_t start_code = sps_util_find_start_code(data, size, 0);
+    while (start_code < size) {
+        size_t begin = start_code + 3;
+        if (begin + 1 >= size) {
+            break;
+        }
+        uint8_t type = (data[begin] & 0x7E) >> 1;
+        if (type < SPS_NAL_HEVC_VPS) {
+            return parse_slice_hevc(data + begin, size - begin, state, header);
+        } else if (type == SPS_NAL_HEVC_PPS) {
+            parse_pps_hevc(data + begin, size - begin, state);
+        }
+        start_code = sps_util_find_start_code(data, size, begin);
+    }
+    return false;
+}
+
+void sps_util_slice_state_set_sps(sps_slice_state_t *state, const sps_info_t *info) {
+    state->log2_max_frame_num = info->log2_max_frame_num;
+    state->log2_max_pic_order_cnt_lsb = info->log2_max_pic_order_cnt_lsb;
+    state->separate_colour_plane = info->separate_colour_plane;
+    state->frame_num_gaps_allowed = info->frame_num_gaps_allowed;
+    state->reordering = info->max_num_reorder_frames != 0;
+}
+
+bool sps_util_frame_order_check_h264(sps_frame_order_t *order, const sps_slice_state_t *state,
+                                     const sps_frame_header_t *header) {
+    if (header->type == SPS_FRAME_IDR) {
+        order->valid = header->has_order;
+        order->broken = false;
+        order->last = header->order;
+        return true;
+    }
+    if (order->broken || !header->has_order) {
+        return !order->broken;
+    }
+    if (order->valid && !state->frame_num_gaps_allowed) {
+        uint32_t mask = (1U << state->log2_max_frame_num) - 1;
+        // Second field of a frame has the same frame_num as the first one
+        if (header->order != order->last && header->order != ((order->last + 1) & mask)) {
+            order->valid = false;
+            order->broken = true;
+            return false;
+        }
+    }
+    order->valid = true;
+    order->last = header->order;
+    return true;
+}
+
+bool sps_util_frame_order_check_hevc(sps_frame_order_t *order, const sps_slice_state_t *state,
+                                     const sps_frame_header_t *header) {
+    uint8_t type = header->nal_unit_type;
+    if (header->type == SPS_FRAME_IDR) {
+        // Pictures following an IRAP picture never reference pictures before it, except RASL pictures
+        order->broken = false;
+        if (header->has_order) {
+            // A CRA picture continues picture order count of the previous pictures if they are known
+            int32_t poc = pic_order_cnt_hevc(order, state, header);
+            order->prev_tid0_poc = poc;
+            order->refs[0] = poc;
+            order->num_refs = 1;
+        }
+        order->valid = header->has_order;
+        return true;
+    }
+    if (order->broken) {
+        return false;
+    }
+    if (!order->valid || !header->has_order || !header->has_ref_pic_set) {
+        // Which pictures are kept is unknown until next IRAP picture
+        order->valid = false;
+        return true;
+    }
+    const sps_ref_pic_set_t *rps = &header->ref_pic_set;
+    int32_t poc = pic_order_cnt_hevc(order, state, header);
+    int count = rps->num_negative + rps->num_positive;
+    // RASL pictures reference pictures before the CRA picture, which is fine to lose as they are skipped then
+    bool rasl = type == 8 || type == 9;
+    for (int i = 0; i < count && !rasl; i++) {
+        // Entries predicted onto this picture have a delta of 0 and aren't references
+        if (rps->delta_poc[i] == 0) {
+            continue;
+        }
+        if ((rps->used_by_curr & (1U << i)) && !has_ref_hevc(order, poc + rps->delta_poc[i])) {
+            order->valid = false;
+            order->broken = true;
+            return false;
+        }
+    }
+    // Like the decoder, forget pictures outside the reference picture set, and keep this one
+    int32_t refs[SPS_FRAME_ORDER_MAX_REFS];
+    uint8_t num_refs = 0;
+    for (int i = 0; i < count; i++) {
+        int32_t ref = poc + rps->delta_poc[i];
+        // Predicted sets can list a picture twice
+        bool listed = false;
+        for (int j = 0; j < num_refs; j++) {
+            listed |= refs[j] == ref;
+        }
+        if (rps->delta_poc[i] != 0 && !listed && has_ref_hevc(order, ref)) {
+            refs[num_refs++] = ref;
+        }
+    }
+    refs[num_refs++] = poc;
+    memcpy(order->refs, refs, num_refs * sizeof(int32_t));
+    order->num_refs = num_refs;
+    // RADL_N, RADL_R, RASL_N, RASL_R, and sub-layer non-reference pictures
+    if (header->temporal_id == 0 && !(type >= 6 && type <= 9) && !(type <= 14 && type % 2 == 0)) {
+        order->prev_tid0_poc = poc;
+    }
+    return true;
+}
+
+const char *sps_util_frame_type_name(sps_frame_type_t type) {
+    switch (type) {
+        case SPS_FRAME_IDR:
+            return "IDR";
+        case SPS_FRAME_I:
+            return "I";
+        case SPS_FRAME_P:
+            return "P";
+        case SPS_FRAME_NON_REF:
+            return "non-ref";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * Remove emulation prevention bytes from the beginning of a NAL unit. The end of the NAL unit is unknown, so the
+ * peeked data may run into the next one, which doesn't matter for fields at the beginning.
+ */
+static void peek_rbsp(const unsigned char *nal, size_t available, slice_peek_t *peek) {
+    int zeroes = 0;
+    peek->size = 0;
+    for (size_t i = 0; i < available && peek->size < SLICE_HEADER_PEEK_SIZE; i++) {
+        if (zeroes == 2 && nal[i] == 3) {
+            zeroes = 0;
+            continue;
+        }
+        peek->data[peek->size++] = nal[i];
+        zeroes = nal[i] == 0 ? zeroes + 1 : 0;
+    }
+}
+
+/**
+ * @return false if slice type can't be read. Frame order is only read for reference frames, when the SPS is known
+ */
+static bool parse_slice_h264(const unsigned char *nal, size_t available, const sps_slice_state_t *state,
+                             sps_frame_header_t *header) {
+    uint8_t nal_ref_idc = (nal[0] >> 5) & 0x03;
+    bool idr = (nal[0] & 0x1F) == SPS_NAL_H264_IDR;
+    header->has_order = false;
+    header->order = 0;
+    if (nal_ref_idc == 0) {
+        header->type = SPS_FRAME_NON_REF;
+        return true;
+    }
+    if (idr) {
+        // frame_num of IDR pictures is always 0
+        header->type = SPS_FRAME_IDR;
+        header->has_order = true;
+        return true;
+    }
+    slice_peek_t peek;
+    peek_rbsp(nal, available, &peek);
+    bitstream_t buf;
+    bitstream_init(&buf, peek.data, peek.size);
+    uint32_t tmp, slice_type;
+    // nal_unit_header
+    if (!bitstream_skip_bits(&buf, 8)) return false;
+    // first_mb_in_slice
+    if (!bitstream_read_ueg(&buf, &tmp)) return false;
+    if (!bitstream_read_ueg(&buf, &slice_type) || slice_type > 9) return false;
+    switch (slice_type % 5) {
+        case 2: // I
+        case 4: // SI
+            header->type = SPS_FRAME_I;
+            break;
+        default:
+            header->type = SPS_FRAME_P;
+            break;
+    }
+    if (state->log2_max_frame_num == 0) {
+        return true;
+    }
+    // pic_parameter_set_id
+    if (!bitstream_read_ueg(&buf, &tmp)) return true;
+    // colour_plane_id
+    if (state->separate_colour_plane && !bitstream_skip_bits(&buf, 2)) return true;
+    header->has_order = bitstream_read_bits(&buf, state->log2_max_frame_num, &header->order);
+    return true;
+}
+
+/**
+ * @return false if slice type can't be read. A sub-layer non-reference picture is still classified from its NAL type
+ * then. Picture order count and reference picture set are read when the SPS is known
+ */
+static bool parse_slice_hevc(const unsigned char *nal, size_t available, const sps_slice_state_t *state,
+                             sps_frame_header_t *header) {
+    uint8_t type = (nal[0] & 0x7E) >> 1;
+    uint8_t nuh_temporal_id_plus1 = nal[1] & 0x07;
+    header->has_order = false;
+    header->order = 0;
+    header->nal_unit_type = type;
+    header->temporal_id = nuh_temporal_id_plus1 != 0 ? nuh_temporal_id_plus1 - 1 : 0;
+    header->has_ref_pic_set = false;
+    // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and reserved RSV_VCL_N10/12/14 are sub-layer non-reference pictures
+    bool non_ref = type <= 14 && type % 2 == 0;
+    if (non_ref) {
+        header->type = SPS_FRAME_NON_REF;
+    }
+    if (type == SPS_NAL_HEVC_IDR_W_RADL || type == SPS_NAL_HEVC_IDR_N_LP) {
+        // Picture order count restarts from 0, and isn't in the slice header
+        header->type = SPS_FRAME_IDR;
+        header->has_order = true;
+        return true;
+    }
+    slice_peek_t peek;
+    peek_rbsp(nal, available, &peek);
+    bitstream_t buf;
+    bitstream_init(&buf, peek.data, peek.size);
+    bool first_slice_segment_in_pic_flag;
+    uint32_t slice_pic_parameter_set_id, slice_type;
+    // nal_unit_header
+    if (!bitstream_skip_bits(&buf, 16)) return non_ref;
+    if (!bitstream_read1(&buf, &first_slice_segment_in_pic_flag)) return non_ref;
+    if (!first_slice_segment_in_pic_flag) {
+        // slice_segment_address needs the picture size, classify from the first segment only
+        return non_ref;
+    }
+    bool irap = sps_util_nal_is_keyframe_hevc(type);
+    if (irap) {
+        // no_output_of_prior_pics_flag
+        if (!bitstream_skip_bits(&buf, 1)) return false;
+    }
+    if (!bitstream_read_ueg(&buf, &slice_pic_parameter_set_id)) return non_ref;
+    // slice_reserved_flag[i]
+    if (!bitstream_skip_bits(&buf, state->num_extra_slice_header_bits)) return non_ref;
+    if (!bitstream_read_ueg(&buf, &slice_type) || slice_type > 2) return non_ref;
+    if (irap) {
+        header->type = SPS_FRAME_IDR;
+    } else if (!non_ref) {
+        header->type = slice_type == 2 ? SPS_FRAME_I : SPS_FRAME_P;
+    }
+    if (state->log2_max_pic_order_cnt_lsb == 0) {
+        return true;
+    }
+    // pic_output_flag
+    if (state->output_flag_present && !bitstream_skip_bits(&buf, 1)) return true;
+    // colour_plane_id
+    if (state->separate_colour_plane && !bitstream_skip_bits(&buf, 2)) return true;
+    header->has_order = bitstream_read_bits(&buf, state->log2_max_pic_order_cnt_lsb, &header->order);
+    if (!header->has_order || !state->has_ref_pic_sets) {
+        return true;
+    }
+    bool short_term_ref_pic_set_sps_flag;
+    if (!bitstream_read1(&buf, &short_term_ref_pic_set_sps_flag)) return true;
+    uint32_t num_sets = state->num_short_term_ref_pic_sets;
+    if (!short_term_ref_pic_set_sps_flag) {
+        header->has_ref_pic_set = sps_util_parse_st_ref_pic_set_hevc(&buf, num_sets, num_sets,
+                                                                     state->short_term_ref_pic_sets,
+                                                                     &header->ref_pic_set);
+        return true;
+    }
+    uint32_t short_term_ref_pic_set_idx = 0;
+    if (num_sets > 1) {
+        // Ceil(Log2(num_short_term_ref_pic_sets)) bits
+        uint8_t bits = 0;
+        while ((1U << bits) < num_sets) {
+            bits++;
+        }
+        if (!bitstream_read_bits(&buf, bits, &short_term_ref_pic_set_idx)) return true;
+    }
+    if (short_term_ref_pic_set_idx < num_sets) {
+        header->ref_pic_set = state->short_term_ref_pic_sets[short_term_ref_pic_set_idx];
+        header->has_ref_pic_set = true;
+    }
+    return true;
+}
+
+static void parse_pps_hevc(const unsigned char *nal, size_t available, sps_slice_state_t *state) {
+    slice_peek_t peek;
+    peek_rbsp(nal, available, &peek);
+    bitstream_t buf;
+    bitstream_init(&buf, peek.data, peek.size);
+    uint32_t tmp;
+    bool output_flag_present_flag;
+    uint8_t num_extra_slice_header_bits;
+    // nal_unit_header
+    if (!bitstream_skip_bits(&buf, 16)) return;
+    // pps_pic_parameter_set_id
+    if (!bitstream_read_ueg(&buf, &tmp)) return;
+    // pps_seq_parameter_set_id
+    if (!bitstream_read_ueg(&buf, &tmp)) return;
+    // dependent_slice_segments_enabled_flag
+    if (!bitstream_skip_bits(&buf, 1)) return;
+    if (!bitstream_read1(&buf, &output_flag_present_flag)) return;
+    if (!bitstream_read3(&buf, &num_extra_slice_header_bits)) return;
+    state->output_flag_present = output_flag_present_flag;
+    state->num_extra_slice_header_bits = num_extra_slice_header_bits;
+}
+
+/**
+ * PicOrderCnt of the picture, from slice_pic_order_cnt_lsb and the previous TemporalId 0 picture.
+ */
+static int32_t pic_order_cnt_hevc(const sps_frame_order_t *order, const sps_slice_state_t *state,
+                                  const sps_frame_header_t *header) {
+    uint8_t type = header->nal_unit_type;
+    if (type == SPS_NAL_HEVC_IDR_W_RADL || type == SPS_NAL_HEVC_IDR_N_LP) {
+        return 0;
+    }
+    int32_t lsb = (int32_t) header->order;
+    // BLA pictures, and CRA pictures starting the stream, have PicOrderCntMsb 0
+    if (type < SPS_NAL_HEVC_CRA && sps_util_nal_is_keyframe_hevc(type)) {
+        return lsb;
+    }
+    if (type == SPS_NAL_HEVC_CRA && !order->valid) {
+        return lsb;
+    }
+    int32_t max_lsb = 1 << state->log2_max_pic_order_cnt_lsb;
+    int32_t prev_lsb = order->prev_tid0_poc & (max_lsb - 1);
+    int32_t prev_msb = order->prev_tid0_poc - prev_lsb;
+    if (lsb < prev_lsb && prev_lsb - lsb >= max_lsb / 2) {
+        return prev_msb + max_lsb + lsb;
+    } else if (lsb > prev_lsb && lsb - prev_lsb > max_lsb / 2) {
+        return prev_msb - max_lsb + lsb;
+    }
+    return prev_msb + lsb;
+}
+
+static bool has_ref_hevc(const sps_frame_order_t *order, int32_t poc) {
+    for (uint8_t i = 0; i < order->num_refs; i++) {
+        if (order->refs[i] == poc) {
+            return true;
+        }
+    }
+    return false;
+}
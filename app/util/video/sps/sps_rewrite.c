@@ -0,0 +1,22 @@
+#include "sps_util.h"
+#include "common.h"
+
+bool sps_util_patch_sps(const unsigned char *rbsp, size_t rbsp_size, const sps_patch_t *patch, const sps_info_t *info,
+                        sps_patch_write_fn write_fn, unsigned char *out, size_t out_capacity, size_t *out_size) {
+    size_t stop_bit = bitstream_rbsp_stop_bit(rbsp, rbsp_size);
+    if (patch->begin > patch->end || patch->end > stop_bit) {
+        return false;
+    }
+    unsigned char patched[SPS_UTIL_REWRITE_MAX_SIZE];
+    bitstream_writer_t writer;
+    bitstream_writer_init(&writer, patched, sizeof(patched));
+    bitstream_t buf;
+    bitstream_init(&buf, rbsp, rbsp_size);
+
+    CHECK_RETURN(bitstream_copy_bits(&buf, &writer, patch->begin));
+    CHECK_RETURN(write_fn(&writer, info, patch));
+    CHECK_RETURN(bitstream_skip_bits(&buf, patch->end - patch->begin));
+    CHECK_RETURN(bitstream_copy_bits(&buf, &writer, stop_bit - patch->end));
+    CHECK_RETURN(bitstream_write_trailing_bits(&writer));
+    return sps_util_rbsp_to_nal(patched, writer.size, out, out_capacity, out_size);
+}
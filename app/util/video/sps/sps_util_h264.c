@@ -4,27 +4,85 @@
 
 #define EXTENDED_SAR 255
 
-static bool skip_vui_parameters(bitstream_t *buf);
+static bool parse_sps_nal(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch, sps_info_t *info,
+                          bool full);
+
+static bool parse_sps(const unsigned char *rbsp, size_t rbsp_size, sps_info_t *info, bool full, sps_patch_t *patch);
+
+static bool parse_vui_parameters(bitstream_t *buf, sps_info_t *info, sps_patch_t *patch);
+
+static bool write_low_latency_patch(bitstream_writer_t *writer, const sps_info_t *info, const sps_patch_t *patch);
 
 static bool skip_hrd_parameters(bitstream_t *buf);
 
 bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_dimension_t *dimension) {
-    int begin = 0;
-    while ((begin = sps_util_nal_skip_start_code(data, size, begin)) >= 0) {
-        if ((data[begin] & 0x1F) == 0x07/* SPS */) {
-            break;
-        }
+    const unsigned char *nal;
+    size_t nal_size;
+    if (!sps_util_find_sps_h264(data, size, &nal, &nal_size)) {
+        return false;
+    }
+    return sps_util_parse_sps_dimension_h264(nal, nal_size, NULL, dimension);
+}
+
+bool sps_util_parse_sps_dimension_h264(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                       sps_dimension_t *dimension) {
+    sps_info_t info;
+    if (!parse_sps_nal(nal, nal_size, scratch, &info, false)) {
+        return false;
     }
-    if (begin < 0|| begin >= size) {
+    *dimension = info.dimension;
+    return true;
+}
+
+bool sps_util_parse_sps_info_h264(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                  sps_info_t *info) {
+    return parse_sps_nal(nal, nal_size, scratch, info, true);
+}
+
+static bool parse_sps_nal(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch, sps_info_t *info,
+                          bool full) {
+    sps_rbsp_buffer_t local_scratch = {NULL, 0};
+    const unsigned char *rbsp;
+    size_t rbsp_size;
+    if (!sps_util_nal_to_rbsp(nal, nal_size, scratch != NULL ? scratch : &local_scratch, &rbsp, &rbsp_size)) {
         return false;
     }
+    bool result = parse_sps(rbsp, rbsp_size, info, full, NULL);
+    sps_util_rbsp_buffer_free(&local_scratch);
+    return result;
+}
+
+bool sps_util_rewrite_sps_low_latency_h264(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                           unsigned char *out, size_t out_capacity, size_t *out_size) {
+    sps_rbsp_buffer_t local_scratch = {NULL, 0};
+    const unsigned char *rbsp;
+    size_t rbsp_size;
+    if (!sps_util_nal_to_rbsp(nal, nal_size, scratch != NULL ? scratch : &local_scratch, &rbsp, &rbsp_size)) {
+        return false;
+    }
+    sps_info_t info;
+    sps_patch_t patch;
+    bool result = parse_sps(rbsp, rbsp_size, &info, true, &patch) &&
+                  sps_util_patch_sps(rbsp, rbsp_size, &patch, &info, write_low_latency_patch, out, out_capacity,
+                                     out_size);
+    sps_util_rbsp_buffer_free(&local_scratch);
+    return result;
+}
+
+/**
+ * @param full Parse VUI as well. Otherwise stop once the dimension is known, and leave VUI fields to defaults
+ * @param patch If not NULL, receives location of the fields to rewrite for low latency output. Requires full
+ */
+static bool parse_sps(const unsigned char *rbsp, size_t rbsp_size, sps_info_t *info, bool full, sps_patch_t *patch) {
     bitstream_t buf;
-    bitstream_init(&buf, data + begin, size - begin);
+    bitstream_init(&buf, rbsp, rbsp_size);
 
     uint8_t subwc[] = {1, 2, 2, 1};
     uint8_t subhc[] = {1, 2, 1, 1};
 
     uint32_t chroma_format_idc = 1;
+    uint32_t bit_depth_luma_minus8 = 0, bit_depth_chroma_minus8 = 0;
+    bool separate_colour_plane_flag = false;
 
     uint32_t width, height;
 
@@ -39,8 +97,8 @@ bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_d
     if (!bitstream_skip_bits(&buf, 2))
         return false;
 
-    // level_idc
-    bitstream_skip_bits_checked(&buf, 8);
+    uint8_t level_idc;
+    bitstream_read8_checked(&buf, &level_idc);
 
     uint32_t tmp;
     // id
@@ -54,14 +112,12 @@ bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_d
         if (!bitstream_read_ueg(&buf, &chroma_format_idc)) return false;
         if (chroma_format_idc > 3) return false;
         if (chroma_format_idc == 3) {
-            // separate_colour_plane_flag
-            bitstream_skip_bits_checked(&buf, 1);
+            bitstream_read1_checked(&buf, &separate_colour_plane_flag);
         }
 
-        // bit_depth_luma_minus8
-        bitstream_read_ueg_checked(&buf, &tmp);
-        // bit_depth_chroma_minus8
-        bitstream_read_ueg_checked(&buf, &tmp);
+        bitstream_read_ueg_checked(&buf, &bit_depth_luma_minus8);
+        bitstream_read_ueg_checked(&buf, &bit_depth_chroma_minus8);
+        if (bit_depth_luma_minus8 > 6 || bit_depth_chroma_minus8 > 6) return false;
         // qpprime_y_zero_transform_bypass_flag
         bitstream_skip_bits_checked(&buf, 1);
 
@@ -78,14 +134,15 @@ bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_d
         }
     }
 
-    // log2_max_frame_num_minus4
-    bitstream_read_ueg_checked(&buf, &tmp);
+    uint32_t log2_max_frame_num_minus4;
+    bitstream_read_ueg_checked(&buf, &log2_max_frame_num_minus4);
+    if (log2_max_frame_num_minus4 > 12) return false;
 
-    uint32_t pic_order_cnt_type;
+    uint32_t pic_order_cnt_type, log2_max_pic_order_cnt_lsb_minus4 = 0;
     bitstream_read_ueg_checked(&buf, &pic_order_cnt_type);
     if (pic_order_cnt_type == 0) {
-        // log2_max_pic_order_cnt_lsb_minus4
-        bitstream_read_ueg_checked(&buf, &tmp);
+        bitstream_read_ueg_checked(&buf, &log2_max_pic_order_cnt_lsb_minus4);
+        if (log2_max_pic_order_cnt_lsb_minus4 > 12) return false;
     } else if (pic_order_cnt_type == 1) {
         // delta_pic_order_always_zero_flag
         bitstream_skip_bits_checked(&buf, 1);
@@ -102,10 +159,11 @@ bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_d
         }
     }
 
-    // num_ref_frames
-    bitstream_read_ueg_checked(&buf, &tmp);
-    // gaps_in_frame_num_value_allowed_flag
-    bitstream_skip_bits_checked(&buf, 1);
+    uint32_t max_num_ref_frames;
+    bitstream_read_ueg_checked(&buf, &max_num_ref_frames);
+    if (max_num_ref_frames > 16) return false;
+    bool gaps_in_frame_num_value_allowed_flag;
+    bitstream_read1_checked(&buf, &gaps_in_frame_num_value_allowed_flag);
     uint32_t pic_width_in_mbs_minus1;
     if (!bitstream_read_ueg(&buf, &pic_width_in_mbs_minus1)) return false;
     uint32_t pic_height_in_map_units_minus1;
@@ -132,12 +190,6 @@ bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_d
         bitstream_read_ueg_checked(&buf, &frame_crop_bottom_offset);
     }
 
-    bool vui_parameters_present_flag = false;
-    bitstream_read1_checked(&buf, &vui_parameters_present_flag);
-    if (vui_parameters_present_flag) {
-        if (!skip_vui_parameters(&buf)) return false;
-    }
-
     /* Calculate width and height */
     width = ((int) pic_width_in_mbs_minus1 + 1);
     width *= 16;
@@ -156,12 +208,47 @@ bool sps_util_parse_dimension_h264(const unsigned char *data, size_t size, sps_d
         return false;
     }
 
-    dimension->width = width;
-    dimension->height = height;
+    info->dimension.width = width;
+    info->dimension.height = height;
+    info->profile_idc = profile_idc;
+    info->level_idc = level_idc;
+    info->chroma_format_idc = chroma_format_idc;
+    info->bit_depth_luma = bit_depth_luma_minus8 + 8;
+    info->bit_depth_chroma = bit_depth_chroma_minus8 + 8;
+    info->max_num_ref_frames = max_num_ref_frames;
+    info->log2_max_frame_num = log2_max_frame_num_minus4 + 4;
+    info->log2_max_pic_order_cnt_lsb = pic_order_cnt_type == 0 ? log2_max_pic_order_cnt_lsb_minus4 + 4 : 0;
+    info->separate_colour_plane = separate_colour_plane_flag;
+    info->frame_num_gaps_allowed = gaps_in_frame_num_value_allowed_flag;
+    info->max_num_reorder_frames = -1;
+    info->max_dec_frame_buffering = -1;
+    info->frame_rate_num = 0;
+    info->frame_rate_den = 0;
+    info->full_range = false;
+    info->colour_primaries = 2;
+    info->transfer_characteristics = 2;
+    info->matrix_coefficients = 2;
+    if (!full) {
+        return true;
+    }
+
+    if (patch != NULL) {
+        patch->long_term_refs = false;
+        patch->kind = SPS_PATCH_H264_NO_VUI;
+        patch->begin = bitstream_tell(&buf);
+    }
+    bool vui_parameters_present_flag = false;
+    bitstream_read1_checked(&buf, &vui_parameters_present_flag);
+    if (patch != NULL) {
+        patch->end = bitstream_tell(&buf);
+    }
+    if (vui_parameters_present_flag) {
+        if (!parse_vui_parameters(&buf, info, patch)) return false;
+    }
     return true;
 }
 
-static bool skip_vui_parameters(bitstream_t *buf) {
+static bool parse_vui_parameters(bitstream_t *buf, sps_info_t *info, sps_patch_t *patch) {
     bool aspect_ratio_info_present_flag = false;
     bitstream_read1_checked(buf, &aspect_ratio_info_present_flag);
     if (aspect_ratio_info_present_flag) {
@@ -187,33 +274,40 @@ static bool skip_vui_parameters(bitstream_t *buf) {
     if (video_signal_type_present_flag) {
         // video_format
         bitstream_skip_bits(buf, 3);
-        // video_full_range_flag
-        bitstream_skip_bits(buf, 1);
+        bitstream_read1_checked(buf, &info->full_range);
         bool colour_description_present_flag = false;
         bitstream_read1_checked(buf, &colour_description_present_flag);
         if (colour_description_present_flag) {
-            bitstream_skip_bits(buf, 8);
-            bitstream_skip_bits(buf, 8);
-            bitstream_skip_bits(buf, 8);
+            bitstream_read8_checked(buf, &info->colour_primaries);
+            bitstream_read8_checked(buf, &info->transfer_characteristics);
+            bitstream_read8_checked(buf, &info->matrix_coefficients);
         }
     }
 
     bool chroma_loc_info_present_flag = false;
     bitstream_read1_checked(buf, &chroma_loc_info_present_flag);
     if (chroma_loc_info_present_flag) {
-        bitstream_skip_bits(buf, 5);
-        bitstream_skip_bits(buf, 5);
+        uint32_t tmp;
+        // chroma_sample_loc_type_top_field
+        bitstream_read_ueg_checked(buf, &tmp);
+        // chroma_sample_loc_type_bottom_field
+        bitstream_read_ueg_checked(buf, &tmp);
     }
 
     bool timing_info_present_flag = false;
     bitstream_read1_checked(buf, &timing_info_present_flag);
     if (timing_info_present_flag) {
-        // num_units_in_tick
-        bitstream_skip_bits(buf, 32);
-        // time_scale
-        bitstream_skip_bits(buf, 32);
+        uint32_t num_units_in_tick, time_scale;
+        bitstream_read_bits_checked(buf, 32, &num_units_in_tick);
+        bitstream_read_bits_checked(buf, 32, &time_scale);
         // fixed_frame_rate_flag
         bitstream_skip_bits(buf, 1);
+        // A frame lasts two ticks, one for each field
+        if (num_units_in_tick > 0 && time_scale > 0 && num_units_in_tick <= UINT32_MAX / 2) {
+            info->frame_rate_num = time_scale;
+            info->frame_rate_den = num_units_in_tick * 2;
+            sps_util_reduce_fraction(&info->frame_rate_num, &info->frame_rate_den);
+        }
     }
 
     bool nal_hrd_parameters_present_flag = false;
@@ -237,8 +331,15 @@ static bool skip_vui_parameters(bitstream_t *buf) {
 
     // pic_struct_present_flag
     bitstream_skip_bits(buf, 1);
+    if (patch != NULL) {
+        patch->kind = SPS_PATCH_H264_NO_RESTRICTION;
+        patch->begin = bitstream_tell(buf);
+    }
     bool bitstream_restriction_flag = false;
     bitstream_read1_checked(buf, &bitstream_restriction_flag);
+    if (patch != NULL) {
+        patch->end = bitstream_tell(buf);
+    }
     if (bitstream_restriction_flag) {
         // motion_vectors_over_pic_boundaries_flag
         bitstream_skip_bits(buf, 1);
@@ -251,15 +352,73 @@ static bool skip_vui_parameters(bitstream_t *buf) {
         bitstream_read_ueg(buf, &tmp);
         // log2_max_mv_length_vertical
         bitstream_read_ueg(buf, &tmp);
-        // num_reorder_frames
-        bitstream_read_ueg(buf, &tmp);
-        // max_dec_frame_buffering
-        bitstream_read_ueg(buf, &tmp);
+        if (patch != NULL) {
+            patch->kind = SPS_PATCH_H264_RESTRICTION;
+            patch->begin = bitstream_tell(buf);
+        }
+        uint32_t num_reorder_frames, max_dec_frame_buffering;
+        bitstream_read_ueg_checked(buf, &num_reorder_frames);
+        bitstream_read_ueg_checked(buf, &max_dec_frame_buffering);
+        if (patch != NULL) {
+            patch->end = bitstream_tell(buf);
+        }
+        if (num_reorder_frames > 16 || max_dec_frame_buffering > 16) return false;
+        info->max_num_reorder_frames = (int8_t) num_reorder_frames;
+        info->max_dec_frame_buffering = (int8_t) max_dec_frame_buffering;
     }
 
     return true;
 }
 
+static bool write_low_latency_patch(bitstream_writer_t *writer, const sps_info_t *info, const sps_patch_t *patch) {
+    switch (patch->kind) {
+        case SPS_PATCH_H264_NO_VUI: {
+            // vui_parameters_present_flag
+            CHECK_RETURN(bitstream_write_bits(writer, 1, 1));
+            // Everything absent from aspect_ratio_info_present_flag to pic_struct_present_flag
+            CHECK_RETURN(bitstream_write_bits(writer, 8, 0));
+        }
+        // fall through
+        case SPS_PATCH_H264_NO_RESTRICTION: {
+            // bitstream_restriction_flag
+            CHECK_RETURN(bitstream_write_bits(writer, 1, 1));
+            // Values inferred when bitstream_restriction is absent
+            // motion_vectors_over_pic_boundaries_flag
+            CHECK_RETURN(bitstream_write_bits(writer, 1, 1));
+            // max_bytes_per_pic_denom
+            CHECK_RETURN(bitstream_write_ueg(writer, 2));
+            // max_bits_per_mb_denom
+            CHECK_RETURN(bitstream_write_ueg(writer, 1));
+            // log2_max_mv_length_horizontal
+            CHECK_RETURN(bitstream_write_ueg(writer, 15));
+            // log2_max_mv_length_vertical
+            CHECK_RETURN(bitstream_write_ueg(writer, 15));
+        }
+        // fall through
+        case SPS_PATCH_H264_RESTRICTION: {
+            uint32_t num_reorder_frames = info->max_num_reorder_frames > 0 ? info->max_num_reorder_frames : 0;
+            uint32_t max_dec_frame_buffering = info->max_num_ref_frames;
+            if (max_dec_frame_buffering < num_reorder_frames) {
+                max_dec_frame_buffering = num_reorder_frames;
+            }
+            if (max_dec_frame_buffering < 1) {
+                max_dec_frame_buffering = 1;
+            }
+            // Never grow a buffer size the encoder already signalled
+            if (info->max_dec_frame_buffering >= 0 &&
+                max_dec_frame_buffering > (uint32_t) info->max_dec_frame_buffering) {
+                max_dec_frame_buffering = info->max_dec_frame_buffering;
+            }
+            CHECK_RETURN(bitstream_write_ueg(writer, num_reorder_frames));
+            CHECK_RETURN(bitstream_write_ueg(writer, max_dec_frame_buffering));
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
 static bool skip_hrd_parameters(bitstream_t *buf) {
     uint32_t cpb_cnt_minus1;
     bitstream_read_ueg(buf, &cpb_cnt_minus1);
@@ -291,3 +450,15 @@ static bool skip_hrd_parameters(bitstream_t *buf) {
     bitstream_skip_bits(buf, 5);
     return true;
 }
+
+bool sps_util_find_sps_h264(const unsigned char *data, size_t size, const unsigned char **nal, size_t *nal_size) {
+    sps_nal_unit_t units[NAL_INDEX_SEARCH_SIZE];
+    int count = sps_util_nal_index_h264(data, size, units, NAL_INDEX_SEARCH_SIZE);
+    const sps_nal_unit_t *unit = sps_util_nal_index_find(units, count, SPS_NAL_H264_SPS);
+    if (unit == NULL) {
+        return false;
+    }
+    *nal = data + unit->offset;
+    *nal_size = unit->size;
+    return true;
+}
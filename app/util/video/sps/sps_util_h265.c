@@ -8,22 +8,103 @@
 
 #define EXTENDED_SAR 255
 
-static bool parse_profile_info(bitstream_t *buf);
+static bool parse_sps_nal(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch, sps_info_t *info,
+                          bool full);
 
-static bool parse_profile_tier_level(bitstream_t *buf, uint8_t max_sub_layers_minus1);
+static bool parse_sps(const unsigned char *rbsp, size_t rbsp_size, sps_info_t *info, bool full, sps_patch_t *patch,
+                      sps_slice_state_t *slice_state);
+
+static bool parse_profile_info(bitstream_t *buf, uint8_t *profile_idc);
+
+static bool parse_profile_tier_level(bitstream_t *buf, uint8_t max_sub_layers_minus1, sps_info_t *info);
+
+static bool skip_scaling_list_data(bitstream_t *buf);
+
+static bool add_ref_pic(int32_t *delta_poc, bool *used, int *count, int32_t delta, bool used_by_curr);
+
+static bool parse_vui_parameters(bitstream_t *buf, sps_info_t *info);
+
+static bool write_low_latency_patch(bitstream_writer_t *writer, const sps_info_t *info, const sps_patch_t *patch);
 
 bool sps_util_parse_dimension_hevc(const unsigned char *data, size_t size, sps_dimension_t *dimension) {
-    int begin = 0;
-    while ((begin = sps_util_nal_skip_start_code(data, size, begin)) >= 0) {
-        if ((data[begin] & 0x7E) >> 1 == 33/* SPS */) {
-            break;
-        }
+    const unsigned char *nal;
+    size_t nal_size;
+    if (!sps_util_find_sps_hevc(data, size, &nal, &nal_size)) {
+        return false;
     }
-    if (begin < 0 || begin >= size) {
+    return sps_util_parse_sps_dimension_hevc(nal, nal_size, NULL, dimension);
+}
+
+bool sps_util_parse_sps_dimension_hevc(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                       sps_dimension_t *dimension) {
+    sps_info_t info;
+    if (!parse_sps_nal(nal, nal_size, scratch, &info, false)) {
         return false;
     }
+    *dimension = info.dimension;
+    return true;
+}
+
+bool sps_util_parse_sps_info_hevc(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                  sps_info_t *info) {
+    return parse_sps_nal(nal, nal_size, scratch, info, true);
+}
+
+static bool parse_sps_nal(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch, sps_info_t *info,
+                          bool full) {
+    sps_rbsp_buffer_t local_scratch = {NULL, 0};
+    const unsigned char *rbsp;
+    size_t rbsp_size;
+    if (!sps_util_nal_to_rbsp(nal, nal_size, scratch != NULL ? scratch : &local_scratch, &rbsp, &rbsp_size)) {
+        return false;
+    }
+    bool result = parse_sps(rbsp, rbsp_size, info, full, NULL, NULL);
+    sps_util_rbsp_buffer_free(&local_scratch);
+    return result;
+}
+
+bool sps_util_rewrite_sps_low_latency_hevc(const unsigned char *nal, size_t nal_size, sps_rbsp_buffer_t *scratch,
+                                           unsigned char *out, size_t out_capacity, size_t *out_size) {
+    sps_rbsp_buffer_t local_scratch = {NULL, 0};
+    const unsigned char *rbsp;
+    size_t rbsp_size;
+    if (!sps_util_nal_to_rbsp(nal, nal_size, scratch != NULL ? scratch : &local_scratch, &rbsp, &rbsp_size)) {
+        return false;
+    }
+    sps_info_t info;
+    sps_patch_t patch;
+    bool result = parse_sps(rbsp, rbsp_size, &info, true, &patch, NULL) &&
+                  sps_util_patch_sps(rbsp, rbsp_size, &patch, &info, write_low_latency_patch, out, out_capacity,
+                                     out_size);
+    sps_util_rbsp_buffer_free(&local_scratch);
+    return result;
+}
+
+bool sps_util_slice_state_set_ref_pic_sets_hevc(sps_slice_state_t *state, const unsigned char *nal, size_t nal_size,
+                                                sps_rbsp_buffer_t *scratch) {
+    state->has_ref_pic_sets = false;
+    sps_rbsp_buffer_t local_scratch = {NULL, 0};
+    const unsigned char *rbsp;
+    size_t rbsp_size;
+    if (!sps_util_nal_to_rbsp(nal, nal_size, scratch != NULL ? scratch : &local_scratch, &rbsp, &rbsp_size)) {
+        return false;
+    }
+    sps_info_t info;
+    state->has_ref_pic_sets = parse_sps(rbsp, rbsp_size, &info, true, NULL, state);
+    sps_util_rbsp_buffer_free(&local_scratch);
+    return state->has_ref_pic_sets;
+}
+
+/**
+ * @param full Parse until the end of VUI timing info. Otherwise stop once the dimension is known, and leave other
+ * fields to defaults
+ * @param patch If not NULL, receives location of the fields to rewrite for low latency output. Requires full
+ * @param slice_state If not NULL, receives the short-term reference picture sets. Requires full
+ */
+static bool parse_sps(const unsigned char *rbsp, size_t rbsp_size, sps_info_t *info, bool full, sps_patch_t *patch,
+                      sps_slice_state_t *slice_state) {
     bitstream_t buf;
-    bitstream_init(&buf, data + begin, size - begin);
+    bitstream_init(&buf, rbsp, rbsp_size);
 
     uint8_t subwc[] = {1, 2, 2, 1, 1};
     uint8_t subhc[] = {1, 2, 1, 1, 1};
@@ -32,14 +113,17 @@ bool sps_util_parse_dimension_hevc(const unsigned char *data, size_t size, sps_d
 
     uint32_t tmp;
 
+    // nal_unit_header
+    bitstream_skip_bits_checked(&buf, 16);
     // sps_video_parameter_set_id
     bitstream_skip_bits_checked(&buf, 4);
     // sps_max_sub_layers_minus1
     bitstream_read3_checked(&buf, &max_sub_layers_minus1);
+    if (max_sub_layers_minus1 > 6) return false;
     // sps_temporal_id_nesting_flag
     bitstream_skip_bits(&buf, 1);
 
-    if (!parse_profile_tier_level(&buf, max_sub_layers_minus1)) {
+    if (!parse_profile_tier_level(&buf, max_sub_layers_minus1, info)) {
         return false;
     }
 
@@ -48,9 +132,10 @@ bool sps_util_parse_dimension_hevc(const unsigned char *data, size_t size, sps_d
 
     uint32_t chroma_format_idc;
     if (!bitstream_read_ueg(&buf, &chroma_format_idc)) return false;
+    if (chroma_format_idc > 3) return false;
+    bool separate_colour_plane_flag = false;
     if (chroma_format_idc == 3) {
-        // separate_colour_plane_flag:1
-        bitstream_skip_bits(&buf, 1);
+        bitstream_read1_checked(&buf, &separate_colour_plane_flag);
     }
 
     uint32_t pic_width_in_luma_samples;
@@ -82,18 +167,158 @@ bool sps_util_parse_dimension_hevc(const unsigned char *data, size_t size, sps_d
         return false;
     }
 
-    dimension->width = width;
-    dimension->height = height;
+    info->dimension.width = width;
+    info->dimension.height = height;
+    info->chroma_format_idc = chroma_format_idc;
+    info->bit_depth_luma = 8;
+    info->bit_depth_chroma = 8;
+    info->max_num_ref_frames = 0;
+    info->log2_max_frame_num = 0;
+    info->log2_max_pic_order_cnt_lsb = 0;
+    info->separate_colour_plane = separate_colour_plane_flag;
+    info->frame_num_gaps_allowed = false;
+    info->max_num_reorder_frames = -1;
+    info->max_dec_frame_buffering = -1;
+    info->frame_rate_num = 0;
+    info->frame_rate_den = 0;
+    info->full_range = false;
+    info->colour_primaries = 2;
+    info->transfer_characteristics = 2;
+    info->matrix_coefficients = 2;
+    if (!full) {
+        return true;
+    }
+
+    uint32_t bit_depth_luma_minus8, bit_depth_chroma_minus8;
+    bitstream_read_ueg_checked(&buf, &bit_depth_luma_minus8);
+    bitstream_read_ueg_checked(&buf, &bit_depth_chroma_minus8);
+    if (bit_depth_luma_minus8 > 8 || bit_depth_chroma_minus8 > 8) return false;
+    info->bit_depth_luma = bit_depth_luma_minus8 + 8;
+    info->bit_depth_chroma = bit_depth_chroma_minus8 + 8;
+
+    uint32_t log2_max_pic_order_cnt_lsb_minus4;
+    bitstream_read_ueg_checked(&buf, &log2_max_pic_order_cnt_lsb_minus4);
+    if (log2_max_pic_order_cnt_lsb_minus4 > 12) return false;
+    info->log2_max_pic_order_cnt_lsb = log2_max_pic_order_cnt_lsb_minus4 + 4;
+
+    if (patch != NULL) {
+        patch->kind = SPS_PATCH_HEVC_ORDERING_INFO;
+        patch->begin = bitstream_tell(&buf);
+    }
+    bool sub_layer_ordering_info_present_flag;
+    bitstream_read1_checked(&buf, &sub_layer_ordering_info_present_flag);
+    // Values of the highest sub-layer apply to the whole stream
+    for (int i = sub_layer_ordering_info_present_flag ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; i++) {
+        uint32_t max_dec_pic_buffering_minus1, max_num_reorder_pics;
+        bitstream_read_ueg_checked(&buf, &max_dec_pic_buffering_minus1);
+        bitstream_read_ueg_checked(&buf, &max_num_reorder_pics);
+        uint32_t max_latency_increase_plus1;
+        bitstream_read_ueg_checked(&buf, &max_latency_increase_plus1);
+        if (patch != NULL) {
+            patch->max_latency_increase_plus1 = max_latency_increase_plus1;
+        }
+        if (max_dec_pic_buffering_minus1 > 15 || max_num_reorder_pics > max_dec_pic_buffering_minus1) return false;
+        info->max_dec_frame_buffering = (int8_t) (max_dec_pic_buffering_minus1 + 1);
+        info->max_num_reorder_frames = (int8_t) max_num_reorder_pics;
+    }
+    if (patch != NULL) {
+        patch->end = bitstream_tell(&buf);
+    }
+
+    // log2_min_luma_coding_block_size_minus3
+    bitstream_read_ueg_checked(&buf, &tmp);
+    // log2_diff_max_min_luma_coding_block_size
+    bitstream_read_ueg_checked(&buf, &tmp);
+    // log2_min_luma_transform_block_size_minus2
+    bitstream_read_ueg_checked(&buf, &tmp);
+    // log2_diff_max_min_luma_transform_block_size
+    bitstream_read_ueg_checked(&buf, &tmp);
+    // max_transform_hierarchy_depth_inter
+    bitstream_read_ueg_checked(&buf, &tmp);
+    // max_transform_hierarchy_depth_intra
+    bitstream_read_ueg_checked(&buf, &tmp);
+
+    bool scaling_list_enabled_flag;
+    bitstream_read1_checked(&buf, &scaling_list_enabled_flag);
+    if (scaling_list_enabled_flag) {
+        bool sps_scaling_list_data_present_flag;
+        bitstream_read1_checked(&buf, &sps_scaling_list_data_present_flag);
+        if (sps_scaling_list_data_present_flag) {
+            CHECK_RETURN(skip_scaling_list_data(&buf));
+        }
+    }
+
+    // amp_enabled_flag, sample_adaptive_offset_enabled_flag
+    bitstream_skip_bits_checked(&buf, 2);
+
+    bool pcm_enabled_flag;
+    bitstream_read1_checked(&buf, &pcm_enabled_flag);
+    if (pcm_enabled_flag) {
+        // pcm_sample_bit_depth_luma_minus1, pcm_sample_bit_depth_chroma_minus1
+        bitstream_skip_bits_checked(&buf, 8);
+        // log2_min_pcm_luma_coding_block_size_minus3
+        bitstream_read_ueg_checked(&buf, &tmp);
+        // log2_diff_max_min_pcm_luma_coding_block_size
+        bitstream_read_ueg_checked(&buf, &tmp);
+        // pcm_loop_filter_disabled_flag
+        bitstream_skip_bits_checked(&buf, 1);
+    }
+
+    uint32_t num_short_term_ref_pic_sets;
+    bitstream_read_ueg_checked(&buf, &num_short_term_ref_pic_sets);
+    if (num_short_term_ref_pic_sets > SPS_MAX_SHORT_TERM_REF_PIC_SETS) return false;
+    sps_ref_pic_set_t local_sets[SPS_MAX_SHORT_TERM_REF_PIC_SETS];
+    sps_ref_pic_set_t *sets = slice_state != NULL ? slice_state->short_term_ref_pic_sets : local_sets;
+    uint8_t max_num_ref_frames = 0;
+    for (uint32_t i = 0; i < num_short_term_ref_pic_sets; i++) {
+        CHECK_RETURN(sps_util_parse_st_ref_pic_set_hevc(&buf, i, num_short_term_ref_pic_sets, sets, &sets[i]));
+        uint8_t num_delta_pocs = sets[i].num_negative + sets[i].num_positive;
+        if (sets[i].num_positive > 0 && sets[i].delta_poc[sets[i].num_negative] == 0) {
+            num_delta_pocs--;
+        }
+        if (num_delta_pocs > max_num_ref_frames) {
+            max_num_ref_frames = num_delta_pocs;
+        }
+    }
+    info->max_num_ref_frames = max_num_ref_frames;
+    if (slice_state != NULL) {
+        slice_state->num_short_term_ref_pic_sets = num_short_term_ref_pic_sets;
+    }
+
+    bool long_term_ref_pics_present_flag;
+    bitstream_read1_checked(&buf, &long_term_ref_pics_present_flag);
+    if (patch != NULL) {
+        patch->long_term_refs = long_term_ref_pics_present_flag;
+    }
+    if (long_term_ref_pics_present_flag) {
+        uint32_t num_long_term_ref_pics_sps;
+        bitstream_read_ueg_checked(&buf, &num_long_term_ref_pics_sps);
+        if (num_long_term_ref_pics_sps > 32) return false;
+        for (uint32_t i = 0; i < num_long_term_ref_pics_sps; i++) {
+            // lt_ref_pic_poc_lsb_sps[i], used_by_curr_pic_lt_sps_flag[i]
+            bitstream_skip_bits_checked(&buf, log2_max_pic_order_cnt_lsb_minus4 + 4 + 1);
+        }
+    }
+
+    // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+    bitstream_skip_bits_checked(&buf, 2);
+
+    bool vui_parameters_present_flag;
+    bitstream_read1_checked(&buf, &vui_parameters_present_flag);
+    if (vui_parameters_present_flag) {
+        CHECK_RETURN(parse_vui_parameters(&buf, info));
+    }
     return true;
 }
 
-static bool parse_profile_info(bitstream_t *buf) {
+static bool parse_profile_info(bitstream_t *buf, uint8_t *profile_idc) {
     // profile_space:2
     bitstream_skip_bits_checked(buf, 2);
     // tier_flag:1
     bitstream_skip_bits_checked(buf, 1);
-    // profile_idc:5
-    bitstream_skip_bits_checked(buf, 5);
+    uint32_t value;
+    bitstream_read_bits_checked(buf, 5, &value);
+    *profile_idc = value;
 
     for (int i = 0; i < 32; i++) {
         // profile_compatibility_flag[i]
@@ -113,18 +338,17 @@ static bool parse_profile_info(bitstream_t *buf) {
     return true;
 }
 
-static bool parse_profile_tier_level(bitstream_t *buf, uint8_t max_sub_layers_minus1) {
+static bool parse_profile_tier_level(bitstream_t *buf, uint8_t max_sub_layers_minus1, sps_info_t *info) {
     bool sub_layer_profile_present_flag[6];
     bool sub_layer_level_present_flag[6];
 
-    CHECK_RETURN(parse_profile_info(buf));
+    CHECK_RETURN(parse_profile_info(buf, &info->profile_idc));
 
-    // level_idc
-    bitstream_skip_bits(buf, 8);
+    bitstream_read8_checked(buf, &info->level_idc);
 
     for (int i = 0; i < max_sub_layers_minus1; i++) {
         bitstream_read1_checked(buf, &sub_layer_profile_present_flag[i]);
-        bitstream_read1_checked(buf, &sub_layer_profile_present_flag[i]);
+        bitstream_read1_checked(buf, &sub_layer_level_present_flag[i]);
     }
 
     if (max_sub_layers_minus1 > 0) {
@@ -136,7 +360,8 @@ static bool parse_profile_tier_level(bitstream_t *buf, uint8_t max_sub_layers_mi
 
     for (int i = 0; i < max_sub_layers_minus1; i++) {
         if (sub_layer_profile_present_flag[i]) {
-            CHECK_RETURN(parse_profile_info(buf));
+            uint8_t sub_layer_profile_idc;
+            CHECK_RETURN(parse_profile_info(buf, &sub_layer_profile_idc));
         }
 
         if (sub_layer_level_present_flag[i]) {
@@ -145,4 +370,263 @@ static bool parse_profile_tier_level(bitstream_t *buf, uint8_t max_sub_layers_mi
         }
     }
     return true;
-}
\ No newline at end of file
+}
+
+static bool skip_scaling_list_data(bitstream_t *buf) {
+    uint32_t tmp;
+    for (int size_id = 0; size_id < 4; size_id++) {
+        for (int matrix_id = 0; matrix_id < 6; matrix_id += (size_id == 3) ? 3 : 1) {
+            bool scaling_list_pred_mode_flag;
+            bitstream_read1_checked(buf, &scaling_list_pred_mode_flag);
+            if (!scaling_list_pred_mode_flag) {
+                // scaling_list_pred_matrix_id_delta
+                bitstream_read_ueg_checked(buf, &tmp);
+                continue;
+            }
+            int coef_num = 1 << (4 + (size_id << 1));
+            if (coef_num > 64) {
+                coef_num = 64;
+            }
+            if (size_id > 1) {
+                // scaling_list_dc_coef_minus8
+                bitstream_read_eg_checked(buf, (int32_t *) (&tmp));
+            }
+            for (int i = 0; i < coef_num; i++) {
+                // scaling_list_delta_coef
+                bitstream_read_eg_checked(buf, (int32_t *) (&tmp));
+            }
+        }
+    }
+    return true;
+}
+
+bool sps_util_parse_st_ref_pic_set_hevc(bitstream_t *buf, uint32_t idx, uint32_t num_sets,
+                                        const sps_ref_pic_set_t *sets, sps_ref_pic_set_t *rps) {
+    bool inter_ref_pic_set_prediction_flag = false;
+    if (idx != 0) {
+        bitstream_read1_checked(buf, &inter_ref_pic_set_prediction_flag);
+    }
+    int32_t negative[16], positive[16];
+    bool negative_used[16], positive_used[16];
+    int num_negative = 0, num_positive = 0;
+    if (inter_ref_pic_set_prediction_flag) {
+        uint32_t delta_idx_minus1 = 0;
+        if (idx == num_sets) {
+            bitstream_read_ueg_checked(buf, &delta_idx_minus1);
+        }
+        if (delta_idx_minus1 >= idx) return false;
+        const sps_ref_pic_set_t *ref = &sets[idx - (delta_idx_minus1 + 1)];
+        bool delta_rps_sign;
+        uint32_t abs_delta_rps_minus1;
+        bitstream_read1_checked(buf, &delta_rps_sign);
+        bitstream_read_ueg_checked(buf, &abs_delta_rps_minus1);
+        if (abs_delta_rps_minus1 > 32767) return false;
+        int32_t delta_rps = (delta_rps_sign ? -1 : 1) * (int32_t) (abs_delta_rps_minus1 + 1);
+        // Pictures of the reference set, then the picture using it
+        int ref_count = ref->num_negative + ref->num_positive;
+        bool used_by_curr_pic_flag[17], use_delta_flag[17];
+        for (int j = 0; j <= ref_count; j++) {
+            bitstream_read1_checked(buf, &used_by_curr_pic_flag[j]);
+            use_delta_flag[j] = true;
+            if (!used_by_curr_pic_flag[j]) {
+                bitstream_read1_checked(buf, &use_delta_flag[j]);
+            }
+        }
+        // Equations 7-61 and 7-62, keeping both lists ordered from the closest picture
+        for (int j = ref->num_positive - 1; j >= 0; j--) {
+            int k = ref->num_negative + j;
+            int32_t delta = ref->delta_poc[k] + delta_rps;
+            if (delta < 0 && use_delta_flag[k]) {
+                CHECK_RETURN(add_ref_pic(negative, negative_used, &num_negative, delta, used_by_curr_pic_flag[k]));
+            }
+        }
+        if (delta_rps < 0 && use_delta_flag[ref_count]) {
+            CHECK_RETURN(add_ref_pic(negative, negative_used, &num_negative, delta_rps,
+                                     used_by_curr_pic_flag[ref_count]));
+        }
+        for (int j = 0; j < ref->num_negative; j++) {
+            int32_t delta = ref->delta_poc[j] + delta_rps;
+            if (delta < 0 && use_delta_flag[j]) {
+                CHECK_RETURN(add_ref_pic(negative, negative_used, &num_negative, delta, used_by_curr_pic_flag[j]));
+            }
+        }
+        // A picture predicted onto the current one isn't a reference, but the HM decoder and FFmpeg keep it as the
+        // closest positive picture and encoders rely on it being counted when a later set predicts from this one
+        for (int j = 0; j < ref_count; j++) {
+            if (ref->delta_poc[j] + delta_rps == 0 && use_delta_flag[j]) {
+                CHECK_RETURN(add_ref_pic(positive, positive_used, &num_positive, 0, used_by_curr_pic_flag[j]));
+            }
+        }
+        for (int j = ref->num_negative - 1; j >= 0; j--) {
+            int32_t delta = ref->delta_poc[j] + delta_rps;
+            if (delta > 0 && use_delta_flag[j]) {
+                CHECK_RETURN(add_ref_pic(positive, positive_used, &num_positive, delta, used_by_curr_pic_flag[j]));
+            }
+        }
+        if (delta_rps > 0 && use_delta_flag[ref_count]) {
+            CHECK_RETURN(add_ref_pic(positive, positive_used, &num_positive, delta_rps,
+                                     used_by_curr_pic_flag[ref_count]));
+        }
+        for (int j = 0; j < ref->num_positive; j++) {
+            int k = ref->num_negative + j;
+            int32_t delta = ref->delta_poc[k] + delta_rps;
+            if (delta > 0 && use_delta_flag[k]) {
+                CHECK_RETURN(add_ref_pic(positive, positive_used, &num_positive, delta, used_by_curr_pic_flag[k]));
+            }
+        }
+    } else {
+        uint32_t num_negative_pics, num_positive_pics;
+        bitstream_read_ueg_checked(buf, &num_negative_pics);
+        bitstream_read_ueg_checked(buf, &num_positive_pics);
+        if (num_negative_pics > 16 || num_positive_pics > 16) return false;
+        int32_t poc = 0;
+        for (uint32_t i = 0; i < num_negative_pics + num_positive_pics; i++) {
+            uint32_t delta_poc_minus1;
+            bool used_by_curr_pic_flag;
+            bitstream_read_ueg_checked(buf, &delta_poc_minus1);
+            bitstream_read1_checked(buf, &used_by_curr_pic_flag);
+            if (delta_poc_minus1 > 32767) return false;
+            if (i < num_negative_pics) {
+                poc -= (int32_t) (delta_poc_minus1 + 1);
+                CHECK_RETURN(add_ref_pic(negative, negative_used, &num_negative, poc, used_by_curr_pic_flag));
+            } else {
+                // Positive deltas accumulate from the current picture again
+                poc = (i == num_negative_pics ? 0 : poc) + (int32_t) (delta_poc_minus1 + 1);
+                CHECK_RETURN(add_ref_pic(positive, positive_used, &num_positive, poc, used_by_curr_pic_flag));
+            }
+        }
+    }
+    if (num_negative + num_positive > 16) return false;
+    rps->num_negative = num_negative;
+    rps->num_positive = num_positive;
+    rps->used_by_curr = 0;
+    for (int i = 0; i < num_negative + num_positive; i++) {
+        bool used = i < num_negative ? negative_used[i] : positive_used[i - num_negative];
+        rps->delta_poc[i] = i < num_negative ? negative[i] : positive[i - num_negative];
+        if (used) {
+            rps->used_by_curr |= 1U << i;
+        }
+    }
+    return true;
+}
+
+static bool add_ref_pic(int32_t *delta_poc, bool *used, int *count, int32_t delta, bool used_by_curr) {
+    if (*count >= 16) {
+        return false;
+    }
+    delta_poc[*count] = delta;
+    used[*count] = used_by_curr;
+    (*count)++;
+    return true;
+}
+
+static bool parse_vui_parameters(bitstream_t *buf, sps_info_t *info) {
+    uint32_t tmp;
+    bool aspect_ratio_info_present_flag;
+    bitstream_read1_checked(buf, &aspect_ratio_info_present_flag);
+    if (aspect_ratio_info_present_flag) {
+        uint8_t aspect_ratio_idc;
+        bitstream_read8_checked(buf, &aspect_ratio_idc);
+        if (aspect_ratio_idc == EXTENDED_SAR) {
+            // sar_width, sar_height
+            bitstream_skip_bits_checked(buf, 32);
+        }
+    }
+
+    bool overscan_info_present_flag;
+    bitstream_read1_checked(buf, &overscan_info_present_flag);
+    if (overscan_info_present_flag) {
+        // overscan_appropriate_flag
+        bitstream_skip_bits_checked(buf, 1);
+    }
+
+    bool video_signal_type_present_flag;
+    bitstream_read1_checked(buf, &video_signal_type_present_flag);
+    if (video_signal_type_present_flag) {
+        // video_format
+        bitstream_skip_bits_checked(buf, 3);
+        bitstream_read1_checked(buf, &info->full_range);
+        bool colour_description_present_flag;
+        bitstream_read1_checked(buf, &colour_description_present_flag);
+        if (colour_description_present_flag) {
+            bitstream_read8_checked(buf, &info->colour_primaries);
+            bitstream_read8_checked(buf, &info->transfer_characteristics);
+            bitstream_read8_checked(buf, &info->matrix_coefficients);
+        }
+    }
+
+    bool chroma_loc_info_present_flag;
+    bitstream_read1_checked(buf, &chroma_loc_info_present_flag);
+    if (chroma_loc_info_present_flag) {
+        // chroma_sample_loc_type_top_field
+        bitstream_read_ueg_checked(buf, &tmp);
+        // chroma_sample_loc_type_bottom_field
+        bitstream_read_ueg_checked(buf, &tmp);
+    }
+
+    // neutral_chroma_indication_flag, field_seq_flag, frame_field_info_present_flag
+    bitstream_skip_bits_checked(buf, 3);
+
+    bool default_display_window_flag;
+    bitstream_read1_checked(buf, &default_display_window_flag);
+    if (default_display_window_flag) {
+        for (int i = 0; i < 4; i++) {
+            // def_disp_win_{left,right,top,bottom}_offset
+            bitstream_read_ueg_checked(buf, &tmp);
+        }
+    }
+
+    bool vui_timing_info_present_flag;
+    bitstream_read1_checked(buf, &vui_timing_info_present_flag);
+    if (vui_timing_info_present_flag) {
+        uint32_t num_units_in_tick, time_scale;
+        bitstream_read_bits_checked(buf, 32, &num_units_in_tick);
+        bitstream_read_bits_checked(buf, 32, &time_scale);
+        if (num_units_in_tick > 0 && time_scale > 0) {
+            info->frame_rate_num = time_scale;
+            info->frame_rate_den = num_units_in_tick;
+            sps_util_reduce_fraction(&info->frame_rate_num, &info->frame_rate_den);
+        }
+    }
+    return true;
+}
+
+/**
+ * Replace per sub-layer ordering info with a single set, which then applies to every sub-layer
+ */
+static bool write_low_latency_patch(bitstream_writer_t *writer, const sps_info_t *info, const sps_patch_t *patch) {
+    if (patch->kind != SPS_PATCH_HEVC_ORDERING_INFO) {
+        return false;
+    }
+    uint32_t max_dec_pic_buffering_minus1 = info->max_num_ref_frames;
+    if (patch->long_term_refs) {
+        max_dec_pic_buffering_minus1 = info->max_dec_frame_buffering - 1;
+    }
+    if (max_dec_pic_buffering_minus1 < (uint32_t) info->max_num_reorder_frames) {
+        max_dec_pic_buffering_minus1 = info->max_num_reorder_frames;
+    }
+    // Never grow a buffer size the encoder already signalled
+    if (max_dec_pic_buffering_minus1 + 1 > (uint32_t) info->max_dec_frame_buffering) {
+        max_dec_pic_buffering_minus1 = info->max_dec_frame_buffering - 1;
+    }
+    // sub_layer_ordering_info_present_flag
+    CHECK_RETURN(bitstream_write_bits(writer, 1, 0));
+    CHECK_RETURN(bitstream_write_ueg(writer, max_dec_pic_buffering_minus1));
+    // sps_max_num_reorder_pics
+    CHECK_RETURN(bitstream_write_ueg(writer, info->max_num_reorder_frames));
+    // Keep the latency limit the encoder signalled, clearing it would allow more delay, not less
+    CHECK_RETURN(bitstream_write_ueg(writer, patch->max_latency_increase_plus1));
+    return true;
+}
+
+bool sps_util_find_sps_hevc(const unsigned char *data, size_t size, const unsigned char **nal, size_t *nal_size) {
+    sps_nal_unit_t units[NAL_INDEX_SEARCH_SIZE];
+    int count = sps_util_nal_index_hevc(data, size, units, NAL_INDEX_SEARCH_SIZE);
+    const sps_nal_unit_t *unit = sps_util_nal_index_find(units, count, SPS_NAL_HEVC_SPS);
+    if (unit == NULL) {
+        return false;
+    }
+    *nal = data + unit->offset;
+    *nal_size = unit->size;
+    return true;
+}
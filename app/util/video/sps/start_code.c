@@ -0,0 +1,93 @@
+#include "common.h"
+
+#if !defined(SPS_UTIL_NO_SIMD) && defined(__SSE2__)
+#define START_CODE_SSE2 1
+#include <emmintrin.h>
+#elif !defined(SPS_UTIL_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define START_CODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+static inline size_t find_zero_zero_byte(const unsigned char *data, size_t size, size_t begin, unsigned char third);
+
+static inline size_t find_zero_zero_byte_scalar(const unsigned char *data, size_t size, size_t begin,
+                                                unsigned char third);
+
+size_t sps_util_find_start_code(const unsigned char *data, size_t size, size_t begin) {
+    return find_zero_zero_byte(data, size, begin, 0x01);
+}
+
+size_t sps_util_find_start_code_scalar(const unsigned char *data, size_t size, size_t begin) {
+    return find_zero_zero_byte_scalar(data, size, begin, 0x01);
+}
+
+size_t sps_util_find_emulation_prevention(const unsigned char *data, size_t size, size_t begin) {
+    return find_zero_zero_byte(data, size, begin, 0x03);
+}
+
+const char *sps_util_find_start_code_kernel() {
+#if START_CODE_SSE2
+    return "sse2";
+#elif START_CODE_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+/**
+ * Find next 00 00 xx sequence, third byte must not be 0
+ */
+static inline size_t find_zero_zero_byte(const unsigned char *data, size_t size, size_t begin, unsigned char third) {
+    size_t i = begin;
+#if START_CODE_SSE2
+    const __m128i zero = _mm_setzero_si128(), match_byte = _mm_set1_epi8((char) third);
+    // Compare 16 candidate positions at once: data[j] == 0 && data[j + 1] == 0 && data[j + 2] == third
+    for (; i + 18 <= size; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (data + i + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i *) (data + i + 2));
+        __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+                                      _mm_cmpeq_epi8(b2, match_byte));
+        int mask = _mm_movemask_epi8(match);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif START_CODE_NEON
+    const uint8x16_t zero = vdupq_n_u8(0), match_byte = vdupq_n_u8(third);
+    for (; i + 18 <= size; i += 16) {
+        uint8x16_t b0 = vld1q_u8(data + i), b1 = vld1q_u8(data + i + 1), b2 = vld1q_u8(data + i + 2);
+        uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)), vceqq_u8(b2, match_byte));
+        // No movemask on NEON, matched lanes are 0xFF so count trailing zero bits in each half instead
+        uint64x2_t match64 = vreinterpretq_u64_u8(match);
+        uint64_t lo = vgetq_lane_u64(match64, 0), hi = vgetq_lane_u64(match64, 1);
+        if (lo != 0) {
+            return i + (__builtin_ctzll(lo) >> 3);
+        } else if (hi != 0) {
+            return i + 8 + (__builtin_ctzll(hi) >> 3);
+        }
+    }
+#endif
+    return find_zero_zero_byte_scalar(data, size, i, third);
+}
+
+static inline size_t find_zero_zero_byte_scalar(const unsigned char *data, size_t size, size_t begin,
+                                                unsigned char third) {
+    size_t i = begin;
+    while (i + 2 < size) {
+        unsigned char b = data[i + 2];
+        if (b == third) {
+            if (data[i] == 0 && data[i + 1] == 0) {
+                return i;
+            }
+            i += 3;
+        } else if (b == 0) {
+            i += 1;
+        } else {
+            // No match can begin at i, i + 1 or i + 2
+            i += 3;
+        }
+    }
+    return size;
+}
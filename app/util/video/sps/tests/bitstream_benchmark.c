@@ -0,0 +1,241 @@
+/**
+ * Compare the word-cached bitstream reader with the previous bit-by-bit reader, by walking real SPS payloads
+ * (scaling lists, VUI with colour description, timing and bitstream_restriction) with both.
+ * The word-cached reader is timed including the RBSP extraction it relies on.
+ */
+#include "bitstream.h"
+#include "sps_util.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "sample_data.h"
+
+#define ITERATIONS 200000
+
+typedef struct legacy_bitstream_t {
+    const unsigned char *data;
+    size_t data_size;
+    uint32_t offset;
+    uint32_t consecutive_zeroes;
+} legacy_bitstream_t;
+
+typedef struct reader_t {
+    const char *name;
+
+    void (*init)(void *buf, const unsigned char *data, size_t size);
+
+    bool (*read_bits)(void *buf, uint32_t size, uint32_t *value);
+
+    bool (*read_ueg)(void *buf, uint32_t *value);
+} reader_t;
+
+static bool legacy_read_bits(void *buf, uint32_t size, uint32_t *value);
+
+static bool legacy_read_ueg(void *buf, uint32_t *value);
+
+static void legacy_init(void *buf, const unsigned char *data, size_t size);
+
+static bool walk_sps_h264(const reader_t *reader, void *buf, uint32_t *checksum);
+
+static double now_ms();
+
+static sps_rbsp_buffer_t scratch = {NULL, 0};
+
+static void new_init(void *buf, const unsigned char *data, size_t size) {
+    const unsigned char *rbsp;
+    size_t rbsp_size;
+    sps_util_nal_to_rbsp(data, size, &scratch, &rbsp, &rbsp_size);
+    bitstream_init(buf, rbsp, rbsp_size);
+}
+
+static bool new_read_bits(void *buf, uint32_t size, uint32_t *value) {
+    return bitstream_read_bits(buf, size, value);
+}
+
+static bool new_read_ueg(void *buf, uint32_t *value) {
+    return bitstream_read_ueg(buf, value);
+}
+
+static const reader_t readers[] = {
+        {"bit-by-bit", legacy_init, legacy_read_bits, legacy_read_ueg},
+        {"word-cached", new_init, new_read_bits, new_read_ueg},
+};
+
+int main() {
+    // Skip start code
+    const unsigned char *nal = sample_data_sps_h264_uhd_hdr + 4;
+    size_t nal_size = sizeof(sample_data_sps_h264_uhd_hdr) - 4;
+    uint32_t checksums[2];
+    double elapsed[2];
+    for (int r = 0; r < 2; r++) {
+        const reader_t *reader = &readers[r];
+        union {
+            legacy_bitstream_t legacy;
+            bitstream_t current;
+        } buf;
+        uint32_t checksum = 0;
+        double begin = now_ms();
+        for (int i = 0; i < ITERATIONS; i++) {
+            checksum = 0;
+            reader->init(&buf, nal, nal_size);
+            if (!walk_sps_h264(reader, &buf, &checksum)) {
+                fprintf(stderr, "%s reader failed to walk SPS\n", reader->name);
+                return 1;
+            }
+        }
+        elapsed[r] = now_ms() - begin;
+        checksums[r] = checksum;
+        printf("%-12s %8.1f ns/SPS (checksum %08x)\n", reader->name, elapsed[r] * 1000000.0 / ITERATIONS,
+               checksum);
+    }
+    printf("Speedup: %.2fx\n", elapsed[0] / elapsed[1]);
+    sps_util_rbsp_buffer_free(&scratch);
+    return checksums[0] == checksums[1] ? 0 : 1;
+}
+
+#define READ_BITS(n) do { if (!reader->read_bits(buf, (n), &v)) return false; \
+    *checksum = *checksum * 31 + v; } while (0)
+#define READ_UEG() do { if (!reader->read_ueg(buf, &v)) return false; *checksum = *checksum * 31 + v; } while (0)
+
+/**
+ * Same syntax as sps_util_parse_sps_dimension_h264, limited to what the fixture contains.
+ */
+static bool walk_sps_h264(const reader_t *reader, void *buf, uint32_t *checksum) {
+    uint32_t v;
+    // nal_unit_header, profile_idc, constraint flags, level_idc
+    READ_BITS(8);
+    READ_BITS(8);
+    READ_BITS(8);
+    READ_BITS(8);
+    // seq_parameter_set_id, chroma_format_idc, bit depths
+    READ_UEG();
+    READ_UEG();
+    READ_UEG();
+    READ_UEG();
+    // qpprime_y_zero_transform_bypass_flag
+    READ_BITS(1);
+    // seq_scaling_matrix_present_flag
+    READ_BITS(1);
+    if (v) {
+        for (int i = 0; i < 8; i++) {
+            READ_BITS(1);
+            if (!v) continue;
+            int last = 8, next = 8;
+            for (int j = 0; j < (i < 6 ? 16 : 64); j++) {
+                if (next != 0) {
+                    READ_UEG();
+                    int32_t delta = (v & 1) ? (int32_t) ((v >> 1) + 1) : -(int32_t) (v >> 1);
+                    next = (last + delta + 256) % 256;
+                }
+                last = next == 0 ? last : next;
+            }
+        }
+    }
+    // log2_max_frame_num_minus4, pic_order_cnt_type, log2_max_pic_order_cnt_lsb_minus4, max_num_ref_frames
+    READ_UEG();
+    READ_UEG();
+    READ_UEG();
+    READ_UEG();
+    // gaps_in_frame_num_value_allowed_flag
+    READ_BITS(1);
+    // pic_width_in_mbs_minus1, pic_height_in_map_units_minus1
+    READ_UEG();
+    READ_UEG();
+    // frame_mbs_only_flag, direct_8x8_inference_flag, frame_cropping_flag, vui_parameters_present_flag
+    READ_BITS(4);
+    // aspect_ratio_info_present_flag, aspect_ratio_idc
+    READ_BITS(1);
+    READ_BITS(8);
+    // overscan_info_present_flag, video_signal_type_present_flag, video_format, video_full_range_flag,
+    // colour_description_present_flag
+    READ_BITS(7);
+    // colour_primaries, transfer_characteristics, matrix_coefficients
+    READ_BITS(8);
+    READ_BITS(8);
+    READ_BITS(8);
+    // chroma_loc_info_present_flag, timing_info_present_flag
+    READ_BITS(2);
+    // num_units_in_tick, time_scale, fixed_frame_rate_flag
+    READ_BITS(32);
+    READ_BITS(32);
+    READ_BITS(1);
+    // nal_hrd, vcl_hrd, pic_struct_present_flag, bitstream_restriction_flag, motion_vectors_over_pic_boundaries_flag
+    READ_BITS(5);
+    for (int i = 0; i < 6; i++) {
+        READ_UEG();
+    }
+    return true;
+}
+
+static void legacy_init(void *buf, const unsigned char *data, size_t size) {
+    legacy_bitstream_t *bs = buf;
+    bs->data = data;
+    bs->data_size = size;
+    bs->offset = 0;
+    bs->consecutive_zeroes = 0;
+}
+
+static bool legacy_read_bits(void *ptr, uint32_t size, uint32_t *value) {
+    legacy_bitstream_t *buf = ptr;
+    if (size > 32) return false;
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        if ((buf->offset + i) % 8 == 0) {
+            uint32_t byte_index = (buf->offset + i) / 8;
+            if (byte_index >= buf->data_size) {
+                return false;
+            }
+            unsigned char b = buf->data[byte_index];
+            if (b == 0) {
+                buf->consecutive_zeroes++;
+            } else if (b == 0x03 && buf->consecutive_zeroes == 2) {
+                if (++byte_index >= buf->data_size) {
+                    return false;
+                }
+                buf->offset += 8;
+                buf->consecutive_zeroes = buf->data[byte_index] == 0;
+            } else {
+                buf->consecutive_zeroes = 0;
+            }
+        }
+        uint32_t cur_offset = buf->offset + i;
+        uint32_t byte_index = cur_offset / 8;
+        if (byte_index >= buf->data_size) {
+            return false;
+        }
+        uint8_t bit_offset = 7 - cur_offset % 8;
+        result |= (buf->data[byte_index] >> bit_offset & 0x1) << (size - i - 1);
+    }
+    buf->offset += size;
+    *value = result;
+    return true;
+}
+
+static bool legacy_read_ueg(void *buf, uint32_t *value) {
+    uint32_t bitcount = 0;
+    uint32_t tmp;
+    for (;;) {
+        if (!legacy_read_bits(buf, 1, &tmp)) return false;
+        if (tmp == 0) {
+            bitcount++;
+        } else {
+            break;
+        }
+    }
+    uint32_t result = 0;
+    if (bitcount) {
+        if (!legacy_read_bits(buf, bitcount, &tmp)) {
+            return false;
+        }
+        result = (uint32_t) ((1 << bitcount) - 1 + tmp);
+    }
+    *value = result;
+    return true;
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
@@ -0,0 +1,114 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum field_type_t {
+    FIELD_BITS,
+    FIELD_UEG,
+    FIELD_EG,
+} field_type_t;
+
+typedef struct field_t {
+    field_type_t type;
+    uint32_t size;
+    uint32_t value;
+} field_t;
+
+/**
+ * Write random fields, and read them back with bitstream_t
+ */
+static void test_round_trip(void) {
+    static field_t fields[2000];
+    static unsigned char data[16384];
+    srand(1);
+    for (int round = 0; round < 50; round++) {
+        bitstream_writer_t writer;
+        bitstream_writer_init(&writer, data, sizeof(data));
+        for (int i = 0; i < 2000; i++) {
+            field_t *field = &fields[i];
+            field->type = rand() % 3;
+            // Mix of small values, and values using every bit
+            uint32_t value = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+            switch (field->type) {
+                case FIELD_BITS:
+                    field->size = 1 + rand() % 32;
+                    field->value = field->size < 32 ? value & ((1U << field->size) - 1) : value;
+                    assert(bitstream_write_bits(&writer, field->size, field->value));
+                    break;
+                case FIELD_UEG:
+                    field->value = rand() % 2 ? value % 16 : (value == UINT32_MAX ? value - 1 : value);
+                    assert(bitstream_write_ueg(&writer, field->value));
+                    break;
+                case FIELD_EG:
+                    field->value = (uint32_t) ((int32_t) (value % 2001) - 1000);
+                    assert(bitstream_write_eg(&writer, (int32_t) field->value));
+                    break;
+            }
+        }
+        assert(bitstream_write_trailing_bits(&writer));
+        assert(writer.cache_bits == 0);
+
+        bitstream_t buf;
+        bitstream_init(&buf, data, writer.size);
+        for (int i = 0; i < 2000; i++) {
+            const field_t *field = &fields[i];
+            uint32_t value;
+            int32_t signed_value;
+            switch (field->type) {
+                case FIELD_BITS:
+                    assert(bitstream_read_bits(&buf, field->size, &value));
+                    assert(value == field->value);
+                    break;
+                case FIELD_UEG:
+                    assert(bitstream_read_ueg(&buf, &value));
+                    assert(value == field->value);
+                    break;
+                case FIELD_EG:
+                    assert(bitstream_read_eg(&buf, &signed_value));
+                    assert(signed_value == (int32_t) field->value);
+                    break;
+            }
+        }
+        assert(bitstream_rbsp_stop_bit(data, writer.size) == bitstream_tell(&buf));
+    }
+}
+
+static void test_overflow(void) {
+    unsigned char data[2];
+    bitstream_writer_t writer;
+    bitstream_writer_init(&writer, data, sizeof(data));
+    assert(bitstream_write_bits(&writer, 16, 0xABCD));
+    assert(!bitstream_write_bits(&writer, 8, 0));
+    assert(data[0] == 0xAB && data[1] == 0xCD);
+}
+
+static void test_rbsp_to_nal(void) {
+    static const unsigned char rbsp[] = {0x42, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0x00, 0x00, 0x04, 0x00,
+                                         0x00};
+    static const unsigned char nal[] = {0x42, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x01, 0x00, 0x03, 0x00, 0x00,
+                                        0x04, 0x00, 0x00};
+    unsigned char out[32];
+    size_t out_size;
+    assert(sps_util_rbsp_to_nal(rbsp, sizeof(rbsp), out, sizeof(out), &out_size));
+    assert(out_size == sizeof(nal));
+    assert(memcmp(out, nal, sizeof(nal)) == 0);
+    assert(!sps_util_rbsp_to_nal(rbsp, sizeof(rbsp), out, sizeof(nal) - 1, &out_size));
+
+    // Back to the original RBSP
+    sps_rbsp_buffer_t scratch = {NULL, 0};
+    const unsigned char *unescaped;
+    size_t unescaped_size;
+    assert(sps_util_nal_to_rbsp(out, out_size, &scratch, &unescaped, &unescaped_size));
+    assert(unescaped_size == sizeof(rbsp));
+    assert(memcmp(unescaped, rbsp, sizeof(rbsp)) == 0);
+    sps_util_rbsp_buffer_free(&scratch);
+}
+
+int main() {
+    test_round_trip();
+    test_overflow();
+    test_rbsp_to_nal();
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * Compare the NAL indexer with the byte-by-byte start code scanner, on synthetic 4K IDR access units.
+ */
+#include "sps_util.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sample_data.h"
+
+#define FRAME_SIZE (6 * 1024 * 1024)
+#define SLICES 8
+#define ITERATIONS 50
+
+static size_t build_idr_frame(unsigned char *frame, size_t capacity);
+
+static double now_ms();
+
+int main() {
+    unsigned char *frame = malloc(FRAME_SIZE);
+    size_t size = build_idr_frame(frame, FRAME_SIZE);
+
+    int legacy_count = 0;
+    double legacy_begin = now_ms();
+    for (int i = 0; i < ITERATIONS; i++) {
+        legacy_count = 0;
+        int begin = 0;
+        while ((begin = sps_util_nal_skip_start_code(frame, size, begin)) >= 0) {
+            legacy_count++;
+        }
+    }
+    double legacy_ms = (now_ms() - legacy_begin) / ITERATIONS;
+
+    size_t scalar_found = 0;
+    double scalar_begin = now_ms();
+    for (int i = 0; i < ITERATIONS; i++) {
+        scalar_found = 0;
+        for (size_t pos = 0; (pos = sps_util_find_start_code_scalar(frame, size, pos)) < size; pos += 3) {
+            scalar_found++;
+        }
+    }
+    double scalar_ms = (now_ms() - scalar_begin) / ITERATIONS;
+
+    sps_nal_unit_t units[64];
+    int index_count = 0;
+    double index_begin = now_ms();
+    for (int i = 0; i < ITERATIONS; i++) {
+        index_count = sps_util_nal_index_hevc(frame, size, units, 64);
+    }
+    double index_ms = (now_ms() - index_begin) / ITERATIONS;
+
+    double mib = (double) size / (1024 * 1024);
+    printf("Frame: %.2f MiB, %d NAL units\n", mib, index_count);
+    printf("sps_util_nal_skip_start_code: %8.3f ms/frame, %8.1f MiB/s\n", legacy_ms, mib / legacy_ms * 1000);
+    printf("Scalar start code search:     %8.3f ms/frame, %8.1f MiB/s\n", scalar_ms, mib / scalar_ms * 1000);
+    printf("sps_util_nal_index_hevc:      %8.3f ms/frame, %8.1f MiB/s (%s)\n", index_ms, mib / index_ms * 1000,
+           sps_util_find_start_code_kernel());
+    free(frame);
+    return legacy_count == index_count && scalar_found == (size_t) index_count ? 0 : 1;
+}
+
+/**
+ * VPS/SPS/PPS followed by slices of random payload, with emulation prevention applied.
+ */
+static size_t build_idr_frame(unsigned char *frame, size_t capacity) {
+    srand(42);
+    size_t offset = 0;
+    memcpy(frame, sample_data_sps_h265_1, sizeof(sample_data_sps_h265_1));
+    offset += sizeof(sample_data_sps_h265_1);
+    size_t slice_size = (capacity - offset) / SLICES - 4;
+    for (int slice = 0; slice < SLICES; slice++) {
+        static const unsigned char header[] = {0x00, 0x00, 0x01, 0x26, 0x01};
+        memcpy(frame + offset, header, sizeof(header));
+        size_t end = offset + slice_size;
+        offset += sizeof(header);
+        int zeroes = 0;
+        while (offset < end) {
+            // Encoded slice data has plenty of zero bytes
+            unsigned char b = rand() % 4 == 0 ? 0 : (unsigned char) rand();
+            if (zeroes >= 2 && b <= 3) {
+                frame[offset++] = 0x03;
+                zeroes = 0;
+                continue;
+            }
+            zeroes = b == 0 ? zeroes + 1 : 0;
+            frame[offset++] = b;
+        }
+        // rbsp_slice_trailing_bits
+        frame[offset - 1] = 0x80;
+    }
+    return offset;
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+}
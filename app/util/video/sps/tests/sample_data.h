@@ -7,4 +7,51 @@ static const uint8_t sample_data_sps_h265_1[] = {
         0x42, 0x01, 0x01, 0x21, 0x40, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03,
         0x00, 0x7b, 0xa0, 0x03, 0xc0, 0x80, 0x11, 0x07, 0xcb, 0x96, 0x5d, 0x29, 0x08, 0x46, 0x45, 0xfd,
         0x0c, 0x05, 0xa8, 0x30, 0x30, 0x30, 0x20, 0x00, 0x00, 0x03, 0x00, 0x20, 0x00, 0x00, 0x07, 0x81,
-};
\ No newline at end of file
+};
+
+/**
+ * H.264 High profile, 3840x2160, with seq_scaling_matrix, BT.2020/PQ colour description, 60 fps VUI timing and
+ * bitstream_restriction (num_reorder_frames=0, max_dec_frame_buffering=1)
+ */
+static const uint8_t sample_data_sps_h264_uhd_hdr[] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x33, 0xad, 0xb1, 0x31, 0x03, 0x45, 0x90, 0x5b, 0x30,
+        0xd2, 0x1c, 0x68, 0xbe, 0x2c, 0xa2, 0xc9, 0x1a, 0x61, 0x67, 0x10, 0x20, 0xc3, 0x4c, 0x6c, 0x69,
+        0xc6, 0x90, 0x49, 0x62, 0x48, 0x2c, 0xc5, 0x20, 0x81, 0x31, 0x66, 0x30, 0x83, 0xb1, 0x64, 0x14,
+        0x2c, 0xc3, 0x4c, 0x74, 0x22, 0x48, 0xc6, 0x8c, 0x99, 0x4e, 0x30, 0x48, 0xa1, 0x87, 0x17, 0x31,
+        0x48, 0x98, 0xa4, 0x53, 0x0b, 0x16, 0x48, 0x91, 0x8e, 0x25, 0x46, 0x88, 0x16, 0x30, 0x86, 0x18,
+        0xd8, 0xa6, 0x64, 0x61, 0x88, 0x58, 0xb2, 0xa1, 0x42, 0x05, 0x8d, 0x14, 0x28, 0xa2, 0x0c, 0x21,
+        0x14, 0x54, 0x43, 0x1a, 0x98, 0x93, 0x0b, 0x43, 0x4e, 0x30, 0xa2, 0x45, 0x1f, 0x42, 0xc4, 0xa9,
+        0x0a, 0x27, 0x21, 0x45, 0x58, 0x89, 0xc4, 0x8b, 0x38, 0x93, 0x88, 0x38, 0xd4, 0x61, 0x25, 0x28,
+        0xd1, 0x32, 0x33, 0x19, 0x89, 0x14, 0x43, 0x08, 0x10, 0x01, 0xf5, 0x1a, 0x86, 0x08, 0x18, 0x4f,
+        0x16, 0x84, 0x46, 0x9c, 0x49, 0xd0, 0x91, 0x6c, 0xc3, 0x45, 0x8d, 0x30, 0x9d, 0xa0, 0x0f, 0x00,
+        0x10, 0xfb, 0x01, 0x6a, 0x12, 0x20, 0x12, 0x80, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x3c,
+        0x46, 0xd0, 0x44, 0x23, 0x50
+};
+
+/**
+ * HEVC Main 10, 3840x2160 coded as 3840x2176 with conformance window, 2 temporal sub-layers, scaling list data,
+ * inter predicted short-term RPS, long-term reference pictures, BT.2020/PQ colour description and 59.94 fps VUI timing
+ */
+static const uint8_t sample_data_sps_h265_main10_hdr[] = {
+        0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x03, 0x02, 0x20, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+        0x03, 0x00, 0x00, 0x03, 0x00, 0x99, 0xc0, 0x00, 0x02, 0x20, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00,
+        0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x20, 0x7c, 0x4b, 0x65,
+        0xad, 0xac, 0x92, 0x25, 0xe6, 0x46, 0x36, 0x8c, 0x8a, 0x53, 0x29, 0x1a, 0x31, 0x4f, 0x65, 0x3a,
+        0x31, 0x08, 0x75, 0xb2, 0x11, 0x10, 0xa8, 0xe6, 0x47, 0x39, 0xca, 0x54, 0x75, 0x9a, 0xe8, 0xc5,
+        0x45, 0x23, 0x9c, 0x87, 0x91, 0xd1, 0x8e, 0x46, 0xcc, 0x54, 0xce, 0x74, 0x63, 0xce, 0x67, 0x39,
+        0xcc, 0x43, 0x94, 0xa7, 0xc9, 0x9d, 0x10, 0xa6, 0x23, 0x67, 0x6c, 0xee, 0x63, 0x94, 0xa4, 0x39,
+        0xcf, 0x34, 0xa4, 0x45, 0xa2, 0x90, 0xc5, 0x92, 0x7c, 0xa7, 0x66, 0x32, 0x67, 0x29, 0x66, 0x44,
+        0x47, 0x39, 0x4b, 0x67, 0x32, 0x66, 0x73, 0x9c, 0xe5, 0x44, 0x29, 0xda, 0x6d, 0x4a, 0xa6, 0x45,
+        0x34, 0xa4, 0x2b, 0x29, 0x91, 0x48, 0x52, 0x90, 0x88, 0xa4, 0xd1, 0xe7, 0x39, 0xce, 0x99, 0x48,
+        0x4b, 0x99, 0x5a, 0x29, 0x0e, 0x52, 0xd1, 0x0c, 0x91, 0xdc, 0x49, 0x48, 0x73, 0xbc, 0xa7, 0x39,
+        0x5b, 0x48, 0xa7, 0x65, 0xb2, 0x10, 0x89, 0x15, 0x1c, 0xf6, 0x46, 0x73, 0xa2, 0x1e, 0x72, 0x36,
+        0x53, 0x9e, 0x99, 0x0e, 0x42, 0x10, 0xa6, 0x6c, 0xe4, 0x9c, 0xcc, 0x64, 0xc7, 0x35, 0x1d, 0x13,
+        0x47, 0x47, 0x39, 0xc8, 0x77, 0x23, 0x90, 0x8b, 0x99, 0x1d, 0x19, 0x1d, 0xa3, 0xce, 0x52, 0x1e,
+        0x64, 0x4b, 0x3b, 0x65, 0x22, 0x2a, 0x29, 0x99, 0x2e, 0x57, 0x23, 0x29, 0x26, 0x31, 0x8a, 0x59,
+        0x53, 0x29, 0x4b, 0x66, 0x31, 0xc8, 0x76, 0x62, 0x9f, 0x65, 0x36, 0x45, 0x23, 0x21, 0x8c, 0xac,
+        0xe6, 0x3b, 0x32, 0x39, 0x08, 0xd3, 0x64, 0x32, 0xc8, 0x72, 0x17, 0x29, 0xcc, 0x66, 0x53, 0x14,
+        0xc7, 0x21, 0xe7, 0x22, 0x21, 0x0c, 0xce, 0x42, 0x94, 0xd6, 0x52, 0x1c, 0xd4, 0x43, 0x94, 0xac,
+        0xcd, 0x11, 0x24, 0x62, 0xcc, 0x62, 0x14, 0xf2, 0x4b, 0xe2, 0x3e, 0xb6, 0xf4, 0x4d, 0x81, 0x65,
+        0x9f, 0xfe, 0x00, 0x02, 0x00, 0x02, 0xd4, 0x24, 0x40, 0x26, 0xd8, 0xfc, 0x00, 0x00, 0x0f, 0xa4,
+        0x00, 0x03, 0xa9, 0x80, 0x20
+};
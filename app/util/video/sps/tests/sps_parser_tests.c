@@ -1,6 +1,9 @@
 #include "sps_util.h"
+#include "common.h"
+#include "sample_data.h"
 
 #include <assert.h>
+#include <string.h>
 
 static const unsigned char h264_test_data[] = {
         0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x2a,
@@ -27,6 +30,14 @@ void test_sps_parse_dimension_h264(void) {
     assert(dimension.height == 1080);
 }
 
+void test_sps_parse_dimension_h264_scaling_list(void) {
+    sps_dimension_t dimension;
+    assert(sps_util_parse_dimension_h264(sample_data_sps_h264_uhd_hdr, sizeof(sample_data_sps_h264_uhd_hdr),
+                                         &dimension));
+    assert(dimension.width == 3840);
+    assert(dimension.height == 2160);
+}
+
 void test_sps_parse_dimension_hevc(void) {
     sps_dimension_t dimension;
     assert(sps_util_parse_dimension_hevc(h265_test_data, sizeof(h265_test_data), &dimension));
@@ -34,9 +45,632 @@ void test_sps_parse_dimension_hevc(void) {
     assert(dimension.height == 1080);
 }
 
+static bool parse_info_h264(const unsigned char *data, size_t size, sps_info_t *info) {
+    const unsigned char *nal;
+    size_t nal_size;
+    return sps_util_find_sps_h264(data, size, &nal, &nal_size) &&
+           sps_util_parse_sps_info_h264(nal, nal_size, NULL, info);
+}
+
+static bool parse_info_hevc(const unsigned char *data, size_t size, sps_info_t *info) {
+    const unsigned char *nal;
+    size_t nal_size;
+    return sps_util_find_sps_hevc(data, size, &nal, &nal_size) &&
+           sps_util_parse_sps_info_hevc(nal, nal_size, NULL, info);
+}
+
+void test_sps_parse_info_h264(void) {
+    sps_info_t info;
+    assert(parse_info_h264(h264_test_data, sizeof(h264_test_data), &info));
+    assert(info.dimension.width == 1920 && info.dimension.height == 1080);
+    assert(info.profile_idc == 100 && info.level_idc == 42);
+    assert(info.chroma_format_idc == 1);
+    assert(info.bit_depth_luma == 8 && info.bit_depth_chroma == 8);
+    assert(info.max_num_ref_frames == 1);
+    assert(info.max_num_reorder_frames == 0 && info.max_dec_frame_buffering == 1);
+    assert(info.frame_rate_num == 60 && info.frame_rate_den == 1);
+    assert(!info.full_range);
+    assert(info.colour_primaries == 6 && info.transfer_characteristics == 6 && info.matrix_coefficients == 6);
+
+    assert(parse_info_h264(sample_data_sps_h264_uhd_hdr, sizeof(sample_data_sps_h264_uhd_hdr), &info));
+    assert(info.dimension.width == 3840 && info.dimension.height == 2160);
+    assert(info.profile_idc == 100 && info.level_idc == 51);
+    assert(info.max_num_reorder_frames == 0 && info.max_dec_frame_buffering == 1);
+    assert(info.frame_rate_num == 60 && info.frame_rate_den == 1);
+    assert(info.colour_primaries == 9 && info.transfer_characteristics == 16 && info.matrix_coefficients == 9);
+}
+
+void test_sps_parse_info_hevc(void) {
+    sps_info_t info;
+    assert(parse_info_hevc(h265_test_data, sizeof(h265_test_data), &info));
+    assert(info.dimension.width == 1920 && info.dimension.height == 1080);
+    assert(info.profile_idc == 1 && info.level_idc == 123);
+    assert(info.chroma_format_idc == 1);
+    assert(info.bit_depth_luma == 8 && info.bit_depth_chroma == 8);
+    assert(info.max_num_ref_frames == 1);
+    assert(info.max_num_reorder_frames == 0 && info.max_dec_frame_buffering == 2);
+    assert(info.frame_rate_num == 60 && info.frame_rate_den == 1);
+    assert(info.colour_primaries == 6 && info.transfer_characteristics == 6 && info.matrix_coefficients == 6);
+
+    assert(parse_info_hevc(sample_data_sps_h265_1, sizeof(sample_data_sps_h265_1), &info));
+    assert(info.max_num_ref_frames == 4);
+    assert(info.max_num_reorder_frames == 0 && info.max_dec_frame_buffering == 5);
+
+    assert(parse_info_hevc(sample_data_sps_h265_main10_hdr, sizeof(sample_data_sps_h265_main10_hdr), &info));
+    assert(info.dimension.width == 3840 && info.dimension.height == 2160);
+    assert(info.profile_idc == 2 && info.level_idc == 153);
+    assert(info.bit_depth_luma == 10 && info.bit_depth_chroma == 10);
+    // Second set is predicted from {-1, -3} with deltaRps 1, which gives {-2, 1} and the current picture at 0
+    assert(info.max_num_ref_frames == 2);
+    assert(info.max_num_reorder_frames == 1 && info.max_dec_frame_buffering == 3);
+    assert(info.frame_rate_num == 60000 && info.frame_rate_den == 1001);
+    assert(!info.full_range);
+    assert(info.colour_primaries == 9 && info.transfer_characteristics == 16 && info.matrix_coefficients == 9);
+
+    // Parsing dimension only doesn't need anything past the conformance window
+    sps_dimension_t dimension;
+    assert(sps_util_parse_dimension_hevc(sample_data_sps_h265_main10_hdr, 48, &dimension));
+    assert(dimension.width == 3840 && dimension.height == 2160);
+    assert(!parse_info_hevc(sample_data_sps_h265_main10_hdr, 48, &info));
+}
+
+/**
+ * Rewrite an SPS for low latency output, and check that only the buffering fields changed
+ */
+static void check_rewrite(const unsigned char *data, size_t size, bool hevc, int8_t expected_reorder,
+                          int8_t expected_dpb) {
+    sps_info_t info, rewritten_info;
+    unsigned char rewritten[SPS_UTIL_REWRITE_MAX_SIZE];
+    size_t rewritten_size;
+    const unsigned char *nal;
+    size_t nal_size;
+    if (hevc) {
+        assert(parse_info_hevc(data, size, &info));
+        assert(sps_util_find_sps_hevc(data, size, &nal, &nal_size));
+        assert(sps_util_rewrite_sps_low_latency_hevc(nal, nal_size, NULL, rewritten, sizeof(rewritten),
+                                                     &rewritten_size));
+        assert(sps_util_parse_sps_info_hevc(rewritten, rewritten_size, NULL, &rewritten_info));
+    } else {
+        assert(parse_info_h264(data, size, &info));
+        assert(sps_util_find_sps_h264(data, size, &nal, &nal_size));
+        assert(sps_util_rewrite_sps_low_latency_h264(nal, nal_size, NULL, rewritten, sizeof(rewritten),
+                                                     &rewritten_size));
+        assert(sps_util_parse_sps_info_h264(rewritten, rewritten_size, NULL, &rewritten_info));
+    }
+    assert(rewritten_info.max_num_reorder_frames == expected_reorder);
+    assert(rewritten_info.max_dec_frame_buffering == expected_dpb);
+    info.max_num_reorder_frames = expected_reorder;
+    info.max_dec_frame_buffering = expected_dpb;
+    assert(memcmp(&info, &rewritten_info, sizeof(sps_info_t)) == 0);
+    // NAL header is kept as-is
+    assert(rewritten[0] == nal[0]);
+
+    // Rewriting again changes nothing
+    unsigned char again[SPS_UTIL_REWRITE_MAX_SIZE];
+    size_t again_size;
+    if (hevc) {
+        assert(sps_util_rewrite_sps_low_latency_hevc(rewritten, rewritten_size, NULL, again, sizeof(again),
+                                                     &again_size));
+    } else {
+        assert(sps_util_rewrite_sps_low_latency_h264(rewritten, rewritten_size, NULL, again, sizeof(again),
+                                                     &again_size));
+    }
+    assert(again_size == rewritten_size && memcmp(again, rewritten, rewritten_size) == 0);
+}
+
+void test_sps_rewrite_h264(void) {
+    // Constrained baseline, 1280x720, no VUI, 2 reference frames
+    static const unsigned char no_vui[] = {
+            0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1f, 0x95, 0xb0, 0x14, 0x01, 0x6e, 0x40,
+    };
+    // Main, 1920x1080, VUI with colour description, timing and NAL HRD but no bitstream_restriction
+    static const unsigned char no_restriction[] = {
+            0x00, 0x00, 0x00, 0x01, 0x67, 0x4d, 0x40, 0x28, 0xec, 0x80, 0x3c, 0x01, 0x13, 0xf2, 0xcd, 0xc0,
+            0x40, 0x40, 0x7c, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x03, 0xa9, 0x83, 0x91, 0x80, 0x02, 0xee, 0x10,
+            0x00, 0x3a, 0x98, 0xaf, 0x7b, 0xe0, 0xa0,
+    };
+    check_rewrite(no_vui, sizeof(no_vui), false, 0, 2);
+    check_rewrite(no_restriction, sizeof(no_restriction), false, 0, 3);
+    // Already minimal
+    check_rewrite(h264_test_data, sizeof(h264_test_data), false, 0, 1);
+    check_rewrite(sample_data_sps_h264_uhd_hdr, sizeof(sample_data_sps_h264_uhd_hdr), false, 0, 1);
+
+    unsigned char rewritten[8];
+    size_t rewritten_size;
+    assert(!sps_util_rewrite_sps_low_latency_h264(no_vui + 4, sizeof(no_vui) - 4, NULL, rewritten,
+                                                  sizeof(rewritten), &rewritten_size));
+}
+
+void test_sps_rewrite_hevc(void) {
+    // h265_test_data signalling a picture buffer of 5 and sps_max_latency_increase_plus1 of 3
+    static const unsigned char large_dpb[] = {
+            0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x21,
+            0x40, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+            0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7B, 0xA0,
+            0x03, 0xC0, 0x80, 0x11, 0x07, 0xCB, 0x94, 0x59,
+            0x12, 0x90, 0x84, 0x64, 0xB8, 0xC0, 0x5A, 0x83,
+            0x03, 0x03, 0x52, 0x08, 0x00, 0x00, 0x03, 0x00,
+            0x08, 0x00, 0x00, 0x03, 0x01, 0xE1, 0x7C, 0x68,
+            0xB4,
+    };
+    // Picture buffer reduced to 2, latency limit unchanged
+    static const unsigned char large_dpb_rewritten[] = {
+            0x42, 0x01, 0x01, 0x21,
+            0x40, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+            0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7B, 0xA0,
+            0x03, 0xC0, 0x80, 0x11, 0x07, 0xCB, 0x94, 0xA4,
+            0x4A, 0x42, 0x11, 0x92, 0xE3, 0x01, 0x6A, 0x0C,
+            0x0C, 0x0D, 0x48, 0x20, 0x00, 0x00, 0x03, 0x00,
+            0x20, 0x00, 0x00, 0x07, 0x85, 0xF1, 0xA2, 0xD0,
+    };
+    sps_info_t info;
+    assert(parse_info_hevc(large_dpb, sizeof(large_dpb), &info));
+    assert(info.max_dec_frame_buffering == 5 && info.max_num_reorder_frames == 0);
+    check_rewrite(large_dpb, sizeof(large_dpb), true, 0, 2);
+    unsigned char rewritten[SPS_UTIL_REWRITE_MAX_SIZE];
+    size_t rewritten_size;
+    assert(sps_util_rewrite_sps_low_latency_hevc(large_dpb + 4, sizeof(large_dpb) - 4, NULL, rewritten,
+                                                 sizeof(rewritten), &rewritten_size));
+    assert(rewritten_size == sizeof(large_dpb_rewritten));
+    assert(memcmp(rewritten, large_dpb_rewritten, rewritten_size) == 0);
+
+    check_rewrite(h265_test_data, sizeof(h265_test_data), true, 0, 2);
+    check_rewrite(sample_data_sps_h265_1, sizeof(sample_data_sps_h265_1), true, 0, 5);
+    // Uses long-term reference pictures, only sub-layer info is merged
+    check_rewrite(sample_data_sps_h265_main10_hdr, sizeof(sample_data_sps_h265_main10_hdr), true, 1, 3);
+}
+
+void test_sps_find_h264(void) {
+    static const unsigned char pps[] = {0x00, 0x00, 0x00, 0x01, 0x68, 0xee, 0x3c, 0x80};
+    unsigned char au[sizeof(h264_test_data) + sizeof(pps)];
+    memcpy(au, h264_test_data, sizeof(h264_test_data));
+    memcpy(au + sizeof(h264_test_data), pps, sizeof(pps));
+
+    const unsigned char *nal = NULL;
+    size_t nal_size = 0;
+    assert(sps_util_find_sps_h264(au, sizeof(au), &nal, &nal_size));
+    assert(nal == au + 4);
+    assert(nal_size == sizeof(h264_test_data) - 4);
+
+    assert(!sps_util_find_sps_h264(pps, sizeof(pps), &nal, &nal_size));
+}
+
+void test_sps_find_hevc(void) {
+    const unsigned char *nal = NULL;
+    size_t nal_size = 0;
+    assert(sps_util_find_sps_hevc(h265_test_data, sizeof(h265_test_data), &nal, &nal_size));
+    assert(nal == h265_test_data + 4);
+    assert(nal_size == sizeof(h265_test_data) - 4);
+}
+
+void test_nal_index_h264(void) {
+    static const unsigned char aud[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xf0};
+    static const unsigned char pps[] = {0x00, 0x00, 0x01, 0x68, 0xee, 0x3c, 0x80};
+    static const unsigned char idr[] = {0x00, 0x00, 0x01, 0x65, 0x88, 0x80, 0x00, 0x00, 0x03, 0x00, 0x40, 0x00};
+    unsigned char au[sizeof(aud) + sizeof(h264_test_data) + sizeof(pps) + sizeof(idr)];
+    size_t offset = 0;
+    memcpy(au + offset, aud, sizeof(aud));
+    offset += sizeof(aud);
+    memcpy(au + offset, h264_test_data, sizeof(h264_test_data));
+    offset += sizeof(h264_test_data);
+    memcpy(au + offset, pps, sizeof(pps));
+    offset += sizeof(pps);
+    memcpy(au + offset, idr, sizeof(idr));
+
+    sps_nal_unit_t units[8];
+    int count = sps_util_nal_index_h264(au, sizeof(au), units, 8);
+    assert(count == 4);
+    assert(units[0].type == SPS_NAL_H264_AUD && units[0].offset == 4 && units[0].size == 2);
+    assert(units[1].type == SPS_NAL_H264_SPS && units[1].offset == sizeof(aud) + 4);
+    assert(units[1].size == sizeof(h264_test_data) - 4);
+    assert(units[2].type == SPS_NAL_H264_PPS && units[2].size == 4);
+    // Trailing zero byte is not part of the NAL unit
+    assert(units[3].type == SPS_NAL_H264_IDR && units[3].size == sizeof(idr) - 4);
+    assert(units[3].offset + units[3].size == sizeof(au) - 1);
+    assert(sps_util_nal_is_keyframe_h264(units[3].type));
+
+    assert(sps_util_nal_index_find(units, count, SPS_NAL_H264_PPS) == &units[2]);
+    assert(sps_util_nal_index_find(units, count, SPS_NAL_H264_SEI) == NULL);
+
+    // Scanning stops when the table is full
+    assert(sps_util_nal_index_h264(au, sizeof(au), units, 2) == 2);
+    assert(units[1].type == SPS_NAL_H264_SPS);
+
+    sps_dimension_t dimension;
+    assert(sps_util_parse_sps_dimension_h264(au + units[1].offset, units[1].size, NULL, &dimension));
+    assert(dimension.width == 1920 && dimension.height == 1080);
+
+    assert(sps_util_nal_index_h264(au, 2, units, 8) == 0);
+}
+
+void test_nal_filter_h264(void) {
+    static const unsigned char au[] = {
+            0x00, 0x00, 0x00, 0x01, 0x09, 0xf0,                   // AUD
+            0x00, 0x00, 0x01, 0x06, 0x05, 0x01, 0x80,             // SEI
+            0x00, 0x00, 0x01, 0x68, 0xee, 0x3c, 0x80,             // PPS
+            0x00, 0x00, 0x00, 0x01, 0x0c, 0xff, 0xff, 0x80, 0x00, // Filler, with trailing zero
+            0x00, 0x00, 0x01, 0x65, 0x88, 0x80, 0x00,             // IDR
+    };
+    static const uint64_t drop_types = SPS_NAL_TYPE_BIT(SPS_NAL_H264_AUD) | SPS_NAL_TYPE_BIT(SPS_NAL_H264_SEI) |
+                                       SPS_NAL_TYPE_BIT(SPS_NAL_H264_FILLER);
+    unsigned char data[sizeof(au)];
+    memcpy(data, au, sizeof(au));
+    size_t size = sps_util_nal_filter_h264(data, sizeof(data), drop_types);
+    // IDR keeps the 4-byte start code it had, and its trailing zero
+    assert(size == 7 + 8);
+    assert(memcmp(data, au + 13, 7) == 0);
+    assert(memcmp(data + 7, au + 28, 8) == 0);
+
+    // Nothing to remove
+    memcpy(data, au, sizeof(au));
+    assert(sps_util_nal_filter_h264(data, sizeof(data), SPS_NAL_TYPE_BIT(SPS_NAL_H264_SPS)) == sizeof(au));
+    assert(memcmp(data, au, sizeof(au)) == 0);
+
+    // More NAL units than indexed at once
+    unsigned char many[100 * 6];
+    for (int i = 0; i < 100; i++) {
+        unsigned char *nal = many + i * 6;
+        nal[0] = 0x00;
+        nal[1] = 0x00;
+        nal[2] = 0x00;
+        nal[3] = 0x01;
+        nal[4] = i % 2 ? 0x0c : 0x41;
+        nal[5] = (unsigned char) (i | 0x80);
+    }
+    size = sps_util_nal_filter_h264(many, sizeof(many), SPS_NAL_TYPE_BIT(SPS_NAL_H264_FILLER));
+    assert(size == 50 * 6);
+    sps_nal_unit_t units[64];
+    assert(sps_util_nal_index_h264(many, size, units, 64) == 50);
+    for (int i = 0; i < 50; i++) {
+        assert(units[i].type == SPS_NAL_H264_SLICE && many[units[i].offset + 1] == ((i * 2) | 0x80));
+    }
+}
+
+void test_nal_index_hevc(void) {
+    sps_nal_unit_t units[8];
+    int count = sps_util_nal_index_hevc(h265_test_data, sizeof(h265_test_data), units, 8);
+    assert(count == 1);
+    assert(units[0].type == SPS_NAL_HEVC_SPS);
+    assert(!sps_util_nal_is_keyframe_hevc(units[0].type));
+    assert(sps_util_nal_is_keyframe_hevc(SPS_NAL_HEVC_IDR_W_RADL));
+    assert(sps_util_nal_is_keyframe_hevc(SPS_NAL_HEVC_CRA));
+}
+
+void test_classify_frame_h264(void) {
+    static const unsigned char idr[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xf0, 0x00, 0x00, 0x01, 0x65, 0x88, 0x80};
+    static const unsigned char p[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xf0, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x48};
+    static const unsigned char i[] = {0x00, 0x00, 0x01, 0x06, 0x05, 0x01, 0x80, 0x00, 0x00, 0x01, 0x61, 0x88, 0x92};
+    static const unsigned char b[] = {0x00, 0x00, 0x00, 0x01, 0x01, 0x9f};
+    static const unsigned char no_slice[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xf0};
+    assert(sps_util_classify_frame_h264(idr, sizeof(idr)) == SPS_FRAME_IDR);
+    assert(sps_util_classify_frame_h264(p, sizeof(p)) == SPS_FRAME_P);
+    assert(sps_util_classify_frame_h264(i, sizeof(i)) == SPS_FRAME_I);
+    assert(sps_util_classify_frame_h264(b, sizeof(b)) == SPS_FRAME_NON_REF);
+    assert(sps_util_classify_frame_h264(no_slice, sizeof(no_slice)) == SPS_FRAME_UNKNOWN);
+    // Truncated slice header
+    assert(sps_util_classify_frame_h264(p, sizeof(p) - 2) == SPS_FRAME_UNKNOWN);
+}
+
+void test_classify_frame_hevc(void) {
+    static const unsigned char idr[] = {0x00, 0x00, 0x00, 0x01, 0x26, 0x01, 0xaf, 0x00};
+    static const unsigned char cra[] = {0x00, 0x00, 0x00, 0x01, 0x2a, 0x01, 0xaf, 0x00};
+    static const unsigned char trail_r[] = {0x00, 0x00, 0x00, 0x01, 0x02, 0x01, 0xd2, 0xc0};
+    static const unsigned char trail_n[] = {0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0xd2, 0xc0};
+    static const unsigned char not_first_segment[] = {0x00, 0x00, 0x00, 0x01, 0x02, 0x01, 0x45, 0x80};
+    // PPS with num_extra_slice_header_bits=2, then an I slice
+    static const unsigned char pps_i[] = {0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xc4, 0x80,
+                                          0x00, 0x00, 0x00, 0x01, 0x02, 0x01, 0xc6, 0xb0};
+    sps_slice_state_t state = {0};
+    assert(sps_util_classify_frame_hevc(idr, sizeof(idr), &state) == SPS_FRAME_IDR);
+    assert(sps_util_classify_frame_hevc(cra, sizeof(cra), &state) == SPS_FRAME_IDR);
+    assert(sps_util_classify_frame_hevc(trail_r, sizeof(trail_r), &state) == SPS_FRAME_P);
+    assert(sps_util_classify_frame_hevc(trail_n, sizeof(trail_n), &state) == SPS_FRAME_NON_REF);
+    assert(sps_util_classify_frame_hevc(not_first_segment, sizeof(not_first_segment), &state) == SPS_FRAME_UNKNOWN);
+    // Extra slice header bits are unknown without the PPS
+    assert(sps_util_classify_frame_hevc(pps_i + 8, sizeof(pps_i) - 8, &state) == SPS_FRAME_UNKNOWN);
+    assert(sps_util_classify_frame_hevc(pps_i, sizeof(pps_i), &state) == SPS_FRAME_I);
+    assert(state.num_extra_slice_header_bits == 2);
+    assert(sps_util_classify_frame_hevc(pps_i + 8, sizeof(pps_i) - 8, &state) == SPS_FRAME_I);
+}
+
+static bool check_order_h264(sps_frame_order_t *order, const sps_slice_state_t *state, unsigned char nal_header,
+                             unsigned char slice) {
+    const unsigned char frame[] = {0x00, 0x00, 0x00, 0x01, nal_header, slice};
+    sps_frame_header_t header;
+    assert(sps_util_parse_frame_header_h264(frame, sizeof(frame), state, &header));
+    return sps_util_frame_order_check_h264(order, state, &header);
+}
+
+/**
+ * Slice of an HEVC picture, referencing previous pictures only
+ */
+typedef struct test_slice_hevc_t {
+    uint8_t type;
+    uint8_t temporal_id;
+    uint32_t poc_lsb;
+    /** Reference picture set of the SPS to use, or -1 to write one in the slice header from the fields below */
+    int rps_idx;
+    /** DeltaPocS0, from the closest picture */
+    int num_refs;
+    int32_t refs[4];
+    /** Bit i set if refs[i] is used by the picture, otherwise it's only kept */
+    uint16_t used;
+} test_slice_hevc_t;
+
+static size_t build_slice_hevc(const test_slice_hevc_t *slice, const sps_slice_state_t *state, unsigned char *out,
+                               size_t capacity) {
+    unsigned char rbsp[64];
+    bitstream_writer_t writer;
+    bitstream_writer_init(&writer, rbsp, sizeof(rbsp));
+    // forbidden_zero_bit, nal_unit_type, nuh_layer_id, nuh_temporal_id_plus1
+    assert(bitstream_write_bits(&writer, 16, (slice->type << 9) | (slice->temporal_id + 1)));
+    // first_slice_segment_in_pic_flag
+    assert(bitstream_write_bits(&writer, 1, 1));
+    bool irap = sps_util_nal_is_keyframe_hevc(slice->type);
+    if (irap) {
+        // no_output_of_prior_pics_flag
+        assert(bitstream_write_bits(&writer, 1, 0));
+    }
+    // slice_pic_parameter_set_id
+    assert(bitstream_write_ueg(&writer, 0));
+    assert(bitstream_write_bits(&writer, state->num_extra_slice_header_bits, 0));
+    // slice_type, I or P
+    assert(bitstream_write_ueg(&writer, irap ? 2 : 1));
+    if (slice->type != SPS_NAL_HEVC_IDR_W_RADL && slice->type != SPS_NAL_HEVC_IDR_N_LP) {
+        assert(bitstream_write_bits(&writer, state->log2_max_pic_order_cnt_lsb, slice->poc_lsb));
+        // short_term_ref_pic_set_sps_flag
+        assert(bitstream_write_bits(&writer, 1, slice->rps_idx >= 0));
+        if (slice->rps_idx >= 0) {
+            uint32_t bits = 0;
+            while ((1U << bits) < state->num_short_term_ref_pic_sets) {
+                bits++;
+            }
+            assert(bitstream_write_bits(&writer, bits, slice->rps_idx));
+        } else {
+            if (state->num_short_term_ref_pic_sets > 0) {
+                // inter_ref_pic_set_prediction_flag
+                assert(bitstream_write_bits(&writer, 1, 0));
+            }
+            assert(bitstream_write_ueg(&writer, slice->num_refs));
+            assert(bitstream_write_ueg(&writer, 0));
+            for (int i = 0; i < slice->num_refs; i++) {
+                int32_t prev = i == 0 ? 0 : slice->refs[i - 1];
+                assert(bitstream_write_ueg(&writer, prev - slice->refs[i] - 1));
+                assert(bitstream_write_bits(&writer, 1, (slice->used >> i) & 1));
+            }
+        }
+    }
+    // Rest of the slice
+    assert(bitstream_write_bits(&writer, 24, 0));
+    assert(bitstream_write_trailing_bits(&writer));
+    assert(capacity > 4);
+    memcpy(out, "\x00\x00\x00\x01", 4);
+    size_t size;
+    assert(sps_util_rbsp_to_nal(rbsp, writer.size, out + 4, capacity - 4, &size));
+    return size + 4;
+}
+
+static bool check_order_hevc(sps_frame_order_t *order, sps_slice_state_t *state, const test_slice_hevc_t *slice) {
+    unsigned char frame[64];
+    size_t size = build_slice_hevc(slice, state, frame, sizeof(frame));
+    sps_frame_header_t header;
+    assert(sps_util_parse_frame_header_hevc(frame, size, state, &header));
+    return sps_util_frame_order_check_hevc(order, state, &header);
+}
+
+void test_frame_order_h264(void) {
+    sps_info_t info;
+    assert(parse_info_h264(sample_data_sps_h264_uhd_hdr, sizeof(sample_data_sps_h264_uhd_hdr), &info));
+    assert(info.log2_max_frame_num == 4 && info.log2_max_pic_order_cnt_lsb == 6 && !info.frame_num_gaps_allowed);
+    sps_slice_state_t state = {0};
+    sps_util_slice_state_set_sps(&state, &info);
+
+    sps_frame_header_t header;
+    static const unsigned char p3[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xf0, 0x00, 0x00, 0x01, 0x41, 0xe7};
+    assert(sps_util_parse_frame_header_h264(p3, sizeof(p3), &state, &header));
+    assert(header.type == SPS_FRAME_P && header.has_order && header.order == 3);
+
+    sps_frame_order_t order = {0};
+    // IDR, frame_num 1 and 2, then a non-reference frame
+    assert(check_order_h264(&order, &state, 0x65, 0x88));
+    assert(check_order_h264(&order, &state, 0x41, 0xe3));
+    assert(check_order_h264(&order, &state, 0x41, 0xe5));
+    assert(check_order_h264(&order, &state, 0x01, 0xe7));
+    // frame_num 3 is lost
+    assert(!check_order_h264(&order, &state, 0x41, 0xe9));
+    assert(!check_order_h264(&order, &state, 0x41, 0xeb));
+    assert(!check_order_h264(&order, &state, 0x01, 0xed));
+    // Clean again from next IDR, and frame_num wraps
+    assert(check_order_h264(&order, &state, 0x65, 0x88));
+    order.last = 14;
+    assert(check_order_h264(&order, &state, 0x41, 0xff));
+    assert(check_order_h264(&order, &state, 0x41, 0xe1));
+
+    // Gaps are legitimate if the SPS allows them
+    state.frame_num_gaps_allowed = true;
+    assert(check_order_h264(&order, &state, 0x41, 0xeb));
+}
+
+void test_frame_order_hevc(void) {
+    sps_info_t info;
+    assert(parse_info_hevc(sample_data_sps_h265_1, sizeof(sample_data_sps_h265_1), &info));
+    assert(info.log2_max_pic_order_cnt_lsb == 8 && info.max_num_reorder_frames == 0);
+    sps_slice_state_t state = {0};
+    sps_util_slice_state_set_sps(&state, &info);
+    assert(sps_util_slice_state_set_ref_pic_sets_hevc(&state, sample_data_sps_h265_1 + 4,
+                                                      sizeof(sample_data_sps_h265_1) - 4, NULL));
+    assert(state.has_ref_pic_sets && state.num_short_term_ref_pic_sets > 0);
+    uint8_t largest = 0;
+    for (int i = 0; i < state.num_short_term_ref_pic_sets; i++) {
+        const sps_ref_pic_set_t *rps = &state.short_term_ref_pic_sets[i];
+        assert(rps->num_negative + rps->num_positive <= 16);
+        if (rps->num_negative + rps->num_positive > largest) {
+            largest = rps->num_negative + rps->num_positive;
+        }
+    }
+    assert(largest == info.max_num_ref_frames);
+
+    // Reference picture sets of a low delay stream, the previous picture, or the two previous ones
+    state.num_short_term_ref_pic_sets = 2;
+    state.short_term_ref_pic_sets[0] = (sps_ref_pic_set_t) {.num_negative = 1, .delta_poc = {-1}, .used_by_curr = 1};
+    state.short_term_ref_pic_sets[1] = (sps_ref_pic_set_t) {.num_negative = 2, .delta_poc = {-1, -2},
+            .used_by_curr = 3};
+    const test_slice_hevc_t idr = {.type = SPS_NAL_HEVC_IDR_W_RADL};
+    sps_frame_order_t order = {0};
+    assert(check_order_hevc(&order, &state, &idr));
+    for (uint32_t poc = 1; poc <= 3; poc++) {
+        const test_slice_hevc_t p = {.type = 1, .poc_lsb = poc, .rps_idx = 0};
+        assert(check_order_hevc(&order, &state, &p));
+    }
+
+    // The POC step changes without any loss, when the encoder skips frames
+    const test_slice_hevc_t skip_2 = {.type = 1, .poc_lsb = 5, .rps_idx = -1, .num_refs = 1, .refs = {-2}, .used = 1};
+    const test_slice_hevc_t step_1 = {.type = 1, .poc_lsb = 6, .rps_idx = 0};
+    const test_slice_hevc_t skip_4 = {.type = 1, .poc_lsb = 10, .rps_idx = -1, .num_refs = 1, .refs = {-4},
+            .used = 1};
+    assert(check_order_hevc(&order, &state, &skip_2));
+    assert(check_order_hevc(&order, &state, &step_1));
+    assert(check_order_hevc(&order, &state, &skip_4));
+
+    // Lost sub-layer non-reference and TemporalId 1 pictures are not referenced by the following ones
+    const test_slice_hevc_t p_11 = {.type = 1, .poc_lsb = 11, .rps_idx = 0};
+    const test_slice_hevc_t p_13 = {.type = 1, .poc_lsb = 13, .rps_idx = -1, .num_refs = 2, .refs = {-2, -3},
+            .used = 1};
+    const test_slice_hevc_t p_15 = {.type = 1, .poc_lsb = 15, .rps_idx = -1, .num_refs = 2, .refs = {-2, -4},
+            .used = 1};
+    assert(check_order_hevc(&order, &state, &p_11));
+    // TRAIL_N 12 lost
+    assert(check_order_hevc(&order, &state, &p_13));
+    // TSA_R 14 with TemporalId 1 lost
+    assert(check_order_hevc(&order, &state, &p_15));
+
+    // TSA_R 14 is only kept by 16, that's a gap once 17 uses it
+    const test_slice_hevc_t p_16 = {.type = 1, .poc_lsb = 16, .rps_idx = -1, .num_refs = 2, .refs = {-1, -2},
+            .used = 1};
+    const test_slice_hevc_t p_17 = {.type = 1, .poc_lsb = 17, .rps_idx = -1, .num_refs = 2, .refs = {-1, -3},
+            .used = 3};
+    const test_slice_hevc_t p_18 = {.type = 1, .poc_lsb = 18, .rps_idx = 1};
+    assert(check_order_hevc(&order, &state, &p_16));
+    assert(!check_order_hevc(&order, &state, &p_17));
+    // Nothing is in order until next IRAP picture
+    assert(!check_order_hevc(&order, &state, &p_18));
+
+    // CRA continues picture order count, which wraps
+    const test_slice_hevc_t cra_250 = {.type = SPS_NAL_HEVC_CRA, .poc_lsb = 250, .rps_idx = 0};
+    const test_slice_hevc_t p_252 = {.type = 1, .poc_lsb = 252, .rps_idx = -1, .num_refs = 1, .refs = {-2},
+            .used = 1};
+    const test_slice_hevc_t p_257 = {.type = 1, .poc_lsb = 1, .rps_idx = -1, .num_refs = 1, .refs = {-5}, .used = 1};
+    const test_slice_hevc_t p_258 = {.type = 1, .poc_lsb = 2, .rps_idx = 0};
+    const test_slice_hevc_t p_260 = {.type = 1, .poc_lsb = 4, .rps_idx = 0};
+    assert(check_order_hevc(&order, &state, &cra_250));
+    assert(check_order_hevc(&order, &state, &p_252));
+    assert(check_order_hevc(&order, &state, &p_257));
+    assert(check_order_hevc(&order, &state, &p_258));
+    assert(order.refs[order.num_refs - 1] == 258);
+    // 259 lost
+    assert(!check_order_hevc(&order, &state, &p_260));
+
+    // Which pictures are kept is unknown without the SPS reference picture sets, nothing is reported then
+    state.has_ref_pic_sets = false;
+    assert(check_order_hevc(&order, &state, &idr));
+    assert(check_order_hevc(&order, &state, &p_18));
+    assert(check_order_hevc(&order, &state, &p_260));
+}
+
+void test_st_ref_pic_set_prediction_hevc(void) {
+    // Set predicted from {-1, -3}, for a picture one after: the previous picture itself, then -2 and -4
+    unsigned char rbsp[8];
+    bitstream_writer_t writer;
+    bitstream_writer_init(&writer, rbsp, sizeof(rbsp));
+    // inter_ref_pic_set_prediction_flag, delta_idx_minus1, delta_rps_sign, abs_delta_rps_minus1
+    assert(bitstream_write_bits(&writer, 1, 1));
+    assert(bitstream_write_ueg(&writer, 0));
+    assert(bitstream_write_bits(&writer, 1, 1));
+    assert(bitstream_write_ueg(&writer, 0));
+    // -2 used, -4 kept, -1 used
+    assert(bitstream_write_bits(&writer, 1, 1));
+    assert(bitstream_write_bits(&writer, 2, 1));
+    assert(bitstream_write_bits(&writer, 1, 1));
+    assert(bitstream_write_trailing_bits(&writer));
+    const sps_ref_pic_set_t sets[] = {{.num_negative = 2, .delta_poc = {-1, -3}, .used_by_curr = 3}};
+    sps_ref_pic_set_t rps;
+    bitstream_t buf;
+    bitstream_init(&buf, rbsp, writer.size);
+    assert(sps_util_parse_st_ref_pic_set_hevc(&buf, 1, 1, sets, &rps));
+    assert(rps.num_negative == 3 && rps.num_positive == 0);
+    assert(rps.delta_poc[0] == -1 && rps.delta_poc[1] == -2 && rps.delta_poc[2] == -4);
+    assert(rps.used_by_curr == 3);
+
+    // Same set for a picture one before, as the HDR sample does: -1 lands on the current picture and is still counted
+    bitstream_writer_init(&writer, rbsp, sizeof(rbsp));
+    assert(bitstream_write_bits(&writer, 1, 1));
+    assert(bitstream_write_ueg(&writer, 0));
+    assert(bitstream_write_bits(&writer, 1, 0));
+    assert(bitstream_write_ueg(&writer, 0));
+    // 0 used, -2 kept, 1 used
+    assert(bitstream_write_bits(&writer, 1, 1));
+    assert(bitstream_write_bits(&writer, 2, 1));
+    assert(bitstream_write_bits(&writer, 1, 1));
+    assert(bitstream_write_trailing_bits(&writer));
+    bitstream_init(&buf, rbsp, writer.size);
+    assert(sps_util_parse_st_ref_pic_set_hevc(&buf, 1, 1, sets, &rps));
+    assert(rps.num_negative == 1 && rps.num_positive == 2);
+    assert(rps.delta_poc[0] == -2 && rps.delta_poc[1] == 0 && rps.delta_poc[2] == 1);
+    assert(rps.used_by_curr == 6);
+}
+
+void test_nal_to_rbsp(void) {
+    sps_rbsp_buffer_t scratch = {NULL, 0};
+    const unsigned char *rbsp;
+    size_t rbsp_size;
+
+    // Nothing to remove, no copy
+    assert(sps_util_nal_to_rbsp(h264_test_data + 4, sizeof(h264_test_data) - 4, &scratch, &rbsp, &rbsp_size));
+    assert(rbsp == h264_test_data + 4);
+    assert(rbsp_size == sizeof(h264_test_data) - 4);
+    assert(scratch.data == NULL);
+
+    static const unsigned char escaped[] = {0x42, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x01, 0x00, 0x03, 0x00,
+                                            0x00, 0x03};
+    static const unsigned char unescaped[] = {0x42, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0x00, 0x00};
+    assert(sps_util_nal_to_rbsp(escaped, sizeof(escaped), &scratch, &rbsp, &rbsp_size));
+    assert(rbsp == scratch.data);
+    assert(rbsp_size == sizeof(unescaped));
+    assert(memcmp(rbsp, unescaped, sizeof(unescaped)) == 0);
+
+    // Scratch buffer is reused
+    unsigned char *scratch_data = scratch.data;
+    assert(sps_util_nal_to_rbsp(escaped, 4, &scratch, &rbsp, &rbsp_size));
+    assert(rbsp == scratch_data && rbsp_size == 3);
+
+    // Parsing an escaped SPS with a shared scratch buffer
+    sps_dimension_t dimension;
+    assert(sps_util_parse_sps_dimension_hevc(h265_test_data + 4, sizeof(h265_test_data) - 4, &scratch, &dimension));
+    assert(dimension.width == 1920 && dimension.height == 1080);
+
+    sps_util_rbsp_buffer_free(&scratch);
+    assert(scratch.data == NULL && scratch.capacity == 0);
+}
+
 // not needed when using generate_test_runner.rb
 int main() {
     test_sps_parse_dimension_h264();
+    test_sps_parse_dimension_h264_scaling_list();
     test_sps_parse_dimension_hevc();
+    test_sps_parse_info_h264();
+    test_sps_parse_info_hevc();
+    test_sps_rewrite_h264();
+    test_sps_rewrite_hevc();
+    test_sps_find_h264();
+    test_sps_find_hevc();
+    test_nal_index_h264();
+    test_nal_index_hevc();
+    test_nal_filter_h264();
+    test_classify_frame_h264();
+    test_classify_frame_hevc();
+    test_frame_order_h264();
+    test_frame_order_hevc();
+    test_st_ref_pic_set_prediction_hevc();
+    test_nal_to_rbsp();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t find_start_code_naive(const unsigned char *data, size_t size, size_t begin) {
+    for (size_t i = begin; i + 2 < size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            return i;
+        }
+    }
+    return size;
+}
+
+static size_t find_emulation_prevention_naive(const unsigned char *data, size_t size, size_t begin) {
+    for (size_t i = begin; i + 2 < size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 3) {
+            return i;
+        }
+    }
+    return size;
+}
+
+/**
+ * Walk every start code from every possible beginning offset, and compare all implementations
+ */
+static void check_buffer(const unsigned char *data, size_t size) {
+    for (size_t begin = 0; begin <= size; begin++) {
+        size_t expected = find_start_code_naive(data, size, begin);
+        assert(sps_util_find_start_code_scalar(data, size, begin) == expected);
+        assert(sps_util_find_start_code(data, size, begin) == expected);
+        assert(sps_util_find_emulation_prevention(data, size, begin) ==
+               find_emulation_prevention_naive(data, size, begin));
+    }
+}
+
+static void test_random(void) {
+    srand(1);
+    unsigned char data[300];
+    for (int round = 0; round < 2000; round++) {
+        size_t size = rand() % sizeof(data);
+        // From sparse to dense zeroes
+        int zero_chance = 1 + round % 4;
+        for (size_t i = 0; i < size; i++) {
+            int r = rand();
+            if (r % 8 < zero_chance) {
+                data[i] = 0;
+            } else if (r % 8 == 7) {
+                data[i] = r & 0x100 ? 1 : 3;
+            } else {
+                data[i] = (unsigned char) (r >> 8);
+            }
+        }
+        check_buffer(data, size);
+    }
+}
+
+static void test_adversarial(void) {
+    unsigned char data[96];
+
+    // Empty and tiny buffers
+    memset(data, 0, sizeof(data));
+    check_buffer(data, 0);
+    check_buffer(data, 2);
+
+    // All zeroes, all ones, no start code at all
+    check_buffer(data, sizeof(data));
+    memset(data, 1, sizeof(data));
+    check_buffer(data, sizeof(data));
+
+    // Start code at every offset, crossing SIMD block boundaries
+    for (size_t pos = 0; pos + 3 <= sizeof(data); pos++) {
+        memset(data, 0xFF, sizeof(data));
+        data[pos] = 0;
+        data[pos + 1] = 0;
+        data[pos + 2] = 1;
+        check_buffer(data, sizeof(data));
+        // Truncated start code at the end of buffer
+        check_buffer(data, pos + 2);
+    }
+
+    // Back to back start codes, and 4-byte start codes
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i % 3 == 2 ? 1 : 0;
+    }
+    check_buffer(data, sizeof(data));
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i % 4 == 3 ? 1 : 0;
+    }
+    check_buffer(data, sizeof(data));
+
+    // Emulation prevention sequences only
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i % 3 == 2 ? 3 : 0;
+    }
+    check_buffer(data, sizeof(data));
+}
+
+int main() {
+    printf("Start code kernel: %s\n", sps_util_find_start_code_kernel());
+    test_random();
+    test_adversarial();
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "util/frame_ring.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define PRODUCER_FRAMES 100000
+
+static int producer_worker(void *arg) {
+    frame_ring_t *ring = arg;
+    for (uint32_t i = 0; i < PRODUCER_FRAMES;) {
+        frame_ring_slot_t *slot = frame_ring_write_begin(ring, sizeof(uint32_t) * 4);
+        if (slot == NULL) {
+            continue;
+        }
+        for (int j = 0; j < 4; j++) {
+            memcpy(slot->data + j * sizeof(uint32_t), &i, sizeof(uint32_t));
+        }
+        slot->size = sizeof(uint32_t) * 4;
+        slot->flags = i;
+        frame_ring_write_commit(ring);
+        i++;
+    }
+    return 0;
+}
+
+static void test_single_thread() {
+    frame_ring_t *ring = frame_ring_create(3, 4);
+    frame_ring_stats_t stats;
+    frame_ring_get_stats(ring, &stats);
+    assert(stats.capacity == 4);
+    assert(frame_ring_read_begin(ring) == NULL);
+
+    for (int i = 0; i < 4; i++) {
+        frame_ring_slot_t *slot = frame_ring_write_begin(ring, 16);
+        assert(slot != NULL);
+        assert(slot->capacity >= 16);
+        slot->size = 16;
+        slot->flags = i;
+        frame_ring_write_commit(ring);
+    }
+    assert(frame_ring_write_begin(ring, 16) == NULL);
+    frame_ring_mark_dropped(ring);
+    assert(frame_ring_occupancy(ring) == 4);
+
+    for (int i = 0; i < 4; i++) {
+        frame_ring_slot_t *slot = frame_ring_read_begin(ring);
+        assert(slot != NULL);
+        assert(slot->flags == (uint32_t) i);
+        frame_ring_read_end(ring);
+    }
+    assert(frame_ring_read_begin(ring) == NULL);
+
+    frame_ring_get_stats(ring, &stats);
+    assert(stats.occupancy == 0);
+    assert(stats.high_watermark == 4);
+    assert(stats.pushed == 4);
+    assert(stats.dropped == 1);
+    frame_ring_destroy(ring);
+}
+
+static void test_producer_consumer() {
+    frame_ring_t *ring = frame_ring_create(8, 4);
+    SDL_Thread *producer = SDL_CreateThread(producer_worker, "producer", ring);
+    for (uint32_t expected = 0; expected < PRODUCER_FRAMES;) {
+        frame_ring_slot_t *slot = frame_ring_read_begin(ring);
+        if (slot == NULL) {
+            continue;
+        }
+        assert(slot->size == sizeof(uint32_t) * 4);
+        assert(slot->flags == expected);
+        for (int j = 0; j < 4; j++) {
+            uint32_t value;
+            memcpy(&value, slot->data + j * sizeof(uint32_t), sizeof(uint32_t));
+            assert(value == expected);
+        }
+        frame_ring_read_end(ring);
+        expected++;
+    }
+    SDL_WaitThread(producer, NULL);
+    assert(frame_ring_read_begin(ring) == NULL);
+    frame_ring_destroy(ring);
+}
+
+int main() {
+    test_single_thread();
+    test_producer_consumer();
+    return 0;
+}
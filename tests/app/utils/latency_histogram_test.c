@@ -0,0 +1,49 @@
+#include "util/latency_histogram.h"
+
+#include <assert.h>
+
+static void test_empty() {
+    latency_histogram_t histogram;
+    latency_histogram_reset(&histogram);
+    latency_summary_t summary;
+    latency_histogram_summarize(&histogram, &summary);
+    assert(summary.count == 0 && summary.p50_us == 0 && summary.p99_us == 0 && summary.max_us == 0);
+}
+
+static void test_percentiles() {
+    latency_histogram_t histogram;
+    latency_histogram_reset(&histogram);
+    // 1..1000us, once each
+    for (uint32_t i = 1; i <= 1000; i++) {
+        latency_histogram_record(&histogram, i);
+    }
+    latency_summary_t summary;
+    latency_histogram_summarize(&histogram, &summary);
+    assert(summary.count == 1000);
+    assert(summary.max_us == 1000);
+    assert(summary.avg_us == 500);
+    // Within bucket precision of the exact values
+    assert(summary.p50_us >= 500 && summary.p50_us <= 500 * 5 / 4);
+    assert(summary.p95_us >= 950 && summary.p95_us <= 1000);
+    assert(summary.p99_us >= 990 && summary.p99_us <= 1000);
+}
+
+static void test_small_and_large() {
+    latency_histogram_t histogram;
+    latency_histogram_reset(&histogram);
+    for (int i = 0; i < 99; i++) {
+        latency_histogram_record(&histogram, 3);
+    }
+    latency_histogram_record(&histogram, UINT32_MAX);
+    latency_summary_t summary;
+    latency_histogram_summarize(&histogram, &summary);
+    assert(summary.p50_us == 3 && summary.p95_us == 3 && summary.p99_us == 3);
+    assert(summary.max_us == UINT32_MAX);
+}
+
+int main() {
+    test_empty();
+    test_percentiles();
+    test_small_and_large();
+    return 0;
+}
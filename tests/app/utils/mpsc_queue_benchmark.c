@@ -0,0 +1,121 @@
+/**
+ * Compare posting to the main thread through mpsc_queue with SDL_PushEvent, with several threads posting at once.
+ */
+#include "util/mpsc_queue.h"
+
+#include <stdio.h>
+
+#define POSTS_PER_PRODUCER 200000
+#define MAX_PRODUCERS 8
+
+typedef struct bench_item_t {
+    void *action;
+    void *data;
+    unsigned char payload[32];
+} bench_item_t;
+
+typedef struct bench_t {
+    mpsc_queue_t *queue;
+    Uint32 event_type;
+    SDL_atomic_t start;
+} bench_t;
+
+static int queue_producer(void *arg);
+
+static int event_producer(void *arg);
+
+static double run(bench_t *bench, int producers, bool use_queue);
+
+int main() {
+    if (SDL_Init(SDL_INIT_EVENTS) != 0) {
+        fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+        return 127;
+    }
+    bench_t bench = {
+            .queue = mpsc_queue_create(128, sizeof(bench_item_t)),
+            .event_type = SDL_RegisterEvents(1),
+    };
+    printf("%-10s %18s %18s\n", "Producers", "mpsc_queue/s", "SDL_PushEvent/s");
+    for (int producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+        double queue_rate = run(&bench, producers, true);
+        double event_rate = run(&bench, producers, false);
+        printf("%-10d %18.0f %18.0f\n", producers, queue_rate, event_rate);
+    }
+    mpsc_queue_destroy(bench.queue);
+    SDL_Quit();
+    return 0;
+}
+
+/**
+ * @return Posts consumed per second
+ */
+static double run(bench_t *bench, int producers, bool use_queue) {
+    SDL_Thread *threads[MAX_PRODUCERS];
+    SDL_AtomicSet(&bench->start, 0);
+    for (int i = 0; i < producers; i++) {
+        threads[i] = SDL_CreateThread(use_queue ? queue_producer : event_producer, "producer", bench);
+    }
+    int total = producers * POSTS_PER_PRODUCER;
+    Uint64 begin = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&bench->start, 1);
+    for (int consumed = 0; consumed < total;) {
+        if (use_queue) {
+            bench_item_t *item = mpsc_queue_read_begin(bench->queue);
+            if (item == NULL) {
+                SDL_Delay(0);
+                continue;
+            }
+            mpsc_queue_read_end(bench->queue);
+            consumed++;
+        } else {
+            SDL_Event events[64];
+            int count = SDL_PeepEvents(events, 64, SDL_GETEVENT, bench->event_type, bench->event_type);
+            if (count <= 0) {
+                SDL_Delay(0);
+                continue;
+            }
+            consumed += count;
+        }
+    }
+    Uint64 end = SDL_GetPerformanceCounter();
+    for (int i = 0; i < producers; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+    return (double) total * (double) SDL_GetPerformanceFrequency() / (double) (end - begin);
+}
+
+static int queue_producer(void *arg) {
+    bench_t *bench = arg;
+    while (!SDL_AtomicGet(&bench->start)) {
+        SDL_Delay(0);
+    }
+    for (int i = 0; i < POSTS_PER_PRODUCER;) {
+        bench_item_t *item = mpsc_queue_write_begin(bench->queue);
+        if (item == NULL) {
+            SDL_Delay(0);
+            continue;
+        }
+        item->action = NULL;
+        item->data = item->payload;
+        mpsc_queue_write_commit(bench->queue, item);
+        i++;
+    }
+    return 0;
+}
+
+static int event_producer(void *arg) {
+    bench_t *bench = arg;
+    while (!SDL_AtomicGet(&bench->start)) {
+        SDL_Delay(0);
+    }
+    for (int i = 0; i < POSTS_PER_PRODUCER;) {
+        SDL_Event event = {.user = {.type = bench->event_type}};
+        // SDL's queue holds 65535 events, and refuses more
+        if (SDL_PushEvent(&event) != 1) {
+            SDL_Delay(0);
+            continue;
+        }
+        i++;
+    }
+    return 0;
+}
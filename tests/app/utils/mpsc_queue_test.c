@@ -0,0 +1,109 @@
+#include "util/mpsc_queue.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#define PRODUCERS 4
+#define PRODUCER_ITEMS 100000
+
+typedef struct test_item_t {
+    int producer;
+    uint32_t value;
+} test_item_t;
+
+typedef struct producer_args_t {
+    mpsc_queue_t *queue;
+    int producer;
+} producer_args_t;
+
+static int producer_worker(void *arg) {
+    producer_args_t *args = arg;
+    for (uint32_t i = 0; i < PRODUCER_ITEMS;) {
+        test_item_t *item = mpsc_queue_write_begin(args->queue);
+        if (item == NULL) {
+            SDL_Delay(0);
+            continue;
+        }
+        item->producer = args->producer;
+        item->value = i;
+        mpsc_queue_write_commit(args->queue, item);
+        i++;
+    }
+    return 0;
+}
+
+static void test_single_thread() {
+    mpsc_queue_t *queue = mpsc_queue_create(3, sizeof(test_item_t));
+    assert(mpsc_queue_read_begin(queue) == NULL);
+
+    // Wrap around a few times
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++) {
+            test_item_t *item = mpsc_queue_write_begin(queue);
+            assert(item != NULL);
+            item->value = i;
+            mpsc_queue_write_commit(queue, item);
+        }
+        assert(mpsc_queue_write_begin(queue) == NULL);
+
+        for (int i = 0; i < 4; i++) {
+            test_item_t *item = mpsc_queue_read_begin(queue);
+            assert(item != NULL);
+            assert(item->value == (uint32_t) i);
+            mpsc_queue_read_end(queue);
+        }
+        assert(mpsc_queue_read_begin(queue) == NULL);
+    }
+
+    // Claimed but not committed element blocks the ones after it
+    test_item_t *first = mpsc_queue_write_begin(queue);
+    test_item_t *second = mpsc_queue_write_begin(queue);
+    assert(first != NULL && second != NULL && first != second);
+    second->value = 2;
+    mpsc_queue_write_commit(queue, second);
+    assert(mpsc_queue_read_begin(queue) == NULL);
+    first->value = 1;
+    mpsc_queue_write_commit(queue, first);
+    assert(mpsc_queue_read_begin(queue) == first);
+    mpsc_queue_read_end(queue);
+    assert(mpsc_queue_read_begin(queue) == second);
+    mpsc_queue_read_end(queue);
+    mpsc_queue_destroy(queue);
+}
+
+static void test_producers_consumer() {
+    mpsc_queue_t *queue = mpsc_queue_create(16, sizeof(test_item_t));
+    producer_args_t args[PRODUCERS];
+    SDL_Thread *producers[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        args[i].queue = queue;
+        args[i].producer = i;
+        producers[i] = SDL_CreateThread(producer_worker, "producer", &args[i]);
+    }
+    uint32_t expected[PRODUCERS] = {0};
+    for (int received = 0; received < PRODUCERS * PRODUCER_ITEMS;) {
+        test_item_t *item = mpsc_queue_read_begin(queue);
+        if (item == NULL) {
+            SDL_Delay(0);
+            continue;
+        }
+        assert(item->producer >= 0 && item->producer < PRODUCERS);
+        // Order of each producer is kept
+        assert(item->value == expected[item->producer]);
+        expected[item->producer]++;
+        mpsc_queue_read_end(queue);
+        received++;
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        SDL_WaitThread(producers[i], NULL);
+        assert(expected[i] == PRODUCER_ITEMS);
+    }
+    assert(mpsc_queue_read_begin(queue) == NULL);
+    mpsc_queue_destroy(queue);
+}
+
+int main() {
+    test_single_thread();
+    test_producers_consumer();
+    return 0;
+}
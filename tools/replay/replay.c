@@ -0,0 +1,365 @@
+/**
+ * Plays a recording made with IHSPLAY_RECORD through stream_media, the same way a session does, without host or
+ * network. Useful as a repeatable benchmark for the decode path.
+ */
+/* Recordings may be larger than 2 GiB. Must come before any system header */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+#include "app.h"
+#include "ss4s.h"
+
+#include "backend/stream/stream_manager_internal.h"
+#include "backend/stream/stream_media.h"
+#include "backend/stream/stream_recorder.h"
+#include "logging/app_logging.h"
+#include "util/os_info.h"
+
+typedef struct replay_options_t {
+    const char *path;
+    /** Submit records as fast as they're consumed, instead of at recorded pace */
+    bool max_pace;
+    int viewport_width, viewport_height;
+} replay_options_t;
+
+typedef struct replay_stats_t {
+    uint32_t video_frames, keyframes, audio_packets;
+    uint32_t keyframe_requests;
+    /** Records the recorder couldn't keep up with */
+    uint32_t dropped_records;
+    uint64_t dropped_bytes;
+    uint64_t video_bytes, audio_bytes;
+    /** Time spent inside submit callbacks */
+    uint64_t video_submit_us, audio_submit_us;
+    uint64_t duration_us;
+} replay_stats_t;
+
+typedef struct replay_record_t {
+    stream_record_type_t type;
+    uint8_t flags;
+    uint32_t size;
+    uint64_t timestamp_us;
+} replay_record_t;
+
+/** Set by stream_media when the session couldn't continue */
+static bool stream_error = false;
+
+static bool parse_options(int argc, char *argv[], replay_options_t *options);
+
+static int replay(FILE *file, stream_media_session_t *media, const replay_options_t *options, replay_stats_t *stats);
+
+static int read_record(FILE *file, replay_record_t *record, unsigned char **payload, size_t *payload_capacity);
+
+static uint32_t read_le32(const unsigned char *in);
+
+static uint64_t read_le64(const unsigned char *in);
+
+static uint64_t elapsed_us(Uint64 start, Uint64 frequency);
+
+static void print_stats(stream_media_session_t *media, const replay_stats_t *stats);
+
+int main(int argc, char *argv[]) {
+    replay_options_t options = {.viewport_width = 1920, .viewport_height = 1080};
+    if (!parse_options(argc, argv, &options)) {
+        fprintf(stderr, "Usage: %s [--max-pace] [--viewport WIDTHxHEIGHT] RECORDING\n", argv[0]);
+        return 1;
+    }
+    FILE *file = fopen(options.path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", options.path);
+        return 1;
+    }
+    char magic[STREAM_RECORD_MAGIC_SIZE];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, STREAM_RECORD_MAGIC, STREAM_RECORD_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "%s is not a stream recording\n", options.path);
+        fclose(file);
+        return 1;
+    }
+
+    app_logging_init();
+    SDL_Init(SDL_INIT_TIMER);
+
+    os_info_t os_info;
+    os_info_get(&os_info);
+    app_settings_t settings;
+    app_settings_init(&settings, &os_info);
+    if (settings.record_path != NULL && strcmp(settings.record_path, options.path) == 0) {
+        // Would truncate the recording before reading it
+        settings.record_path = NULL;
+    }
+
+    SS4S_Config ss4s_config = {
+            .audioDriver = settings.audio_driver,
+            .videoDriver = settings.video_driver,
+            .loggingFunction = app_ss4s_logf,
+    };
+    SS4S_Init(argc, argv, &ss4s_config);
+    SS4S_PostInit(argc, argv);
+
+    app_t app = {.running = true, .main_thread_id = SDL_ThreadID(), .settings = &settings};
+    stream_manager_t manager = {.app = &app, .viewport_width = options.viewport_width,
+            .viewport_height = options.viewport_height};
+    stream_media_session_t *media = stream_media_create(&manager);
+    stream_media_set_viewport_size(media, options.viewport_width, options.viewport_height);
+
+    replay_stats_t stats = {0};
+    int ret = replay(file, media, &options, &stats);
+    print_stats(media, &stats);
+
+    stream_media_destroy(media);
+    fclose(file);
+
+    app_settings_deinit(&settings);
+    SS4S_Quit();
+    SDL_Quit();
+    app_logging_deinit();
+    os_info_clear(&os_info);
+    return ret;
+}
+
+/**
+ * Used by stream_media to report the capture size to the stream manager, which replay doesn't have.
+ */
+void stream_manager_set_capture_size(stream_manager_t *manager, int width, int height) {
+    manager->capture_width = width;
+    manager->capture_height = height;
+}
+
+/**
+ * Used by stream_media to stop the session after an error, which stops the replay.
+ */
+void stream_manager_stop_on_error(stream_manager_t *manager) {
+    (void) manager;
+    stream_error = true;
+}
+
+static bool parse_options(int argc, char *argv[], replay_options_t *options) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-pace") == 0) {
+            options->max_pace = true;
+        } else if (strcmp(argv[i], "--viewport") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &options->viewport_width, &options->viewport_height) != 2 ||
+                options->viewport_width <= 0 || options->viewport_height <= 0) {
+                return false;
+            }
+        } else if (argv[i][0] == '-' || options->path != NULL) {
+            return false;
+        } else {
+            options->path = argv[i];
+        }
+    }
+    return options->path != NULL;
+}
+
+/**
+ * Feed every record to the callbacks. Streams still running at the end of the recording are stopped, like a session
+ * disconnecting would.
+ */
+static int replay(FILE *file, stream_media_session_t *media, const replay_options_t *options, replay_stats_t *stats) {
+    const IHS_StreamVideoCallbacks *video = stream_media_video_callbacks();
+    const IHS_StreamAudioCallbacks *audio = stream_media_audio_callbacks();
+    bool video_started = false, audio_started = false;
+    unsigned char *payload = NULL;
+    size_t payload_capacity = 0;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 start = SDL_GetPerformanceCounter();
+    uint64_t first_timestamp_us = 0;
+    bool first = true;
+    int ret = 0;
+    replay_record_t record;
+    int read = 0;
+    while (!stream_error && (read = read_record(file, &record, &payload, &payload_capacity)) > 0) {
+        if (first) {
+            first_timestamp_us = record.timestamp_us;
+            first = false;
+        }
+        if (!options->max_pace) {
+            uint64_t due_us = record.timestamp_us - first_timestamp_us, now_us = elapsed_us(start, frequency);
+            if (due_us > now_us) {
+                SDL_Delay((Uint32) ((due_us - now_us) / 1000));
+            }
+        }
+        IHS_Buffer buffer = {.data = payload, .offset = 0, .size = record.size};
+        switch (record.type) {
+            case STREAM_RECORD_VIDEO_START: {
+                IHS_StreamVideoConfig config = {
+                        .codec = (IHS_StreamVideoCodec) read_le32(payload),
+                        .width = read_le32(payload + 4),
+                        .height = read_le32(payload + 8),
+                };
+                if (video->start(NULL, &config, media) != 0) {
+                    app_log_error("Replay", "Failed to start video");
+                    ret = 1;
+                } else {
+                    video_started = true;
+                }
+                break;
+            }
+            case STREAM_RECORD_VIDEO_FRAME: {
+                if (!video_started) {
+                    break;
+                }
+                IHS_StreamVideoFrameFlag flags = IHS_StreamVideoFrameNone;
+                if (record.flags & STREAM_RECORD_FLAG_KEYFRAME) {
+                    flags = IHS_StreamVideoFrameKeyFrame;
+                    stats->keyframes++;
+                }
+                Uint64 submit_start = SDL_GetPerformanceCounter();
+                if (video->submit(NULL, &buffer, flags, media) != 0) {
+                    stats->keyframe_requests++;
+                }
+                stats->video_submit_us += elapsed_us(submit_start, frequency);
+                stats->video_frames++;
+                stats->video_bytes += record.size;
+                break;
+            }
+            case STREAM_RECORD_VIDEO_STOP: {
+                if (video_started) {
+                    video->stop(NULL, media);
+                    video_started = false;
+                }
+                break;
+            }
+            case STREAM_RECORD_AUDIO_START: {
+                IHS_StreamAudioConfig config = {
+                        .codec = (IHS_StreamAudioCodec) read_le32(payload),
+                        .channels = read_le32(payload + 4),
+                        .frequency = read_le32(payload + 8),
+                };
+                if (audio->start(NULL, &config, media) != 0) {
+                    app_log_error("Replay", "Failed to start audio");
+                    ret = 1;
+                } else {
+                    audio_started = true;
+                }
+                break;
+            }
+            case STREAM_RECORD_AUDIO_PACKET: {
+                if (!audio_started) {
+                    break;
+                }
+                Uint64 submit_start = SDL_GetPerformanceCounter();
+                audio->submit(NULL, &buffer, media);
+                stats->audio_submit_us += elapsed_us(submit_start, frequency);
+                stats->audio_packets++;
+                stats->audio_bytes += record.size;
+                break;
+            }
+            case STREAM_RECORD_AUDIO_STOP: {
+                if (audio_started) {
+                    audio->stop(NULL, media);
+                    audio_started = false;
+                }
+                break;
+            }
+            case STREAM_RECORD_DROPPED: {
+                uint32_t records = read_le32(payload);
+                uint64_t bytes = read_le64(payload + 4);
+                app_log_warn("Replay", "%u records (%llu bytes) were dropped while recording, before %.3f s",
+                             records, (unsigned long long) bytes, (double) record.timestamp_us / 1000000);
+                stats->dropped_records += records;
+                stats->dropped_bytes += bytes;
+                break;
+            }
+            default: {
+                app_log_warn("Replay", "Skipping unknown record type %d", record.type);
+                break;
+            }
+        }
+    }
+    if (stream_error) {
+        app_log_error("Replay", "Stream stopped after an error");
+        ret = 1;
+    } else if (read < 0) {
+        app_log_warn("Replay", "Recording is truncated");
+    }
+    stats->duration_us = elapsed_us(start, frequency);
+    if (video_started) {
+        video->stop(NULL, media);
+    }
+    if (audio_started) {
+        audio->stop(NULL, media);
+    }
+    free(payload);
+    return ret;
+}
+
+/**
+ * @return 1 if a record was read, 0 at end of file, -1 if the record is incomplete or invalid
+ */
+static int read_record(FILE *file, replay_record_t *record, unsigned char **payload, size_t *payload_capacity) {
+    unsigned char header[STREAM_RECORD_HEADER_SIZE];
+    size_t header_read = fread(header, 1, sizeof(header), file);
+    if (header_read == 0) {
+        return 0;
+    } else if (header_read != sizeof(header)) {
+        return -1;
+    }
+    record->type = (stream_record_type_t) header[0];
+    record->flags = header[1];
+    record->size = read_le32(header + 4);
+    record->timestamp_us = read_le64(header + 8);
+    // Start and dropped records are read as 12 bytes even if the payload is shorter
+    size_t capacity = record->size > 12 ? record->size : 12;
+    if (capacity > *payload_capacity) {
+        unsigned char *resized = realloc(*payload, capacity);
+        if (resized == NULL) {
+            return -1;
+        }
+        *payload = resized;
+        *payload_capacity = capacity;
+    }
+    memset(*payload, 0, 12);
+    if (fread(*payload, 1, record->size, file) != record->size) {
+        return -1;
+    }
+    return 1;
+}
+
+static uint32_t read_le32(const unsigned char *in) {
+    return (uint32_t) in[0] | (uint32_t) in[1] << 8 | (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+}
+
+static uint64_t read_le64(const unsigned char *in) {
+    return (uint64_t) read_le32(in) | (uint64_t) read_le32(in + 4) << 32;
+}
+
+static uint64_t elapsed_us(Uint64 start, Uint64 frequency) {
+    return (SDL_GetPerformanceCounter() - start) * 1000000 / frequency;
+}
+
+static void print_stats(stream_media_session_t *media, const replay_stats_t *stats) {
+    double seconds = (double) stats->duration_us / 1000000;
+    printf("Replayed in %.3f s\n", seconds);
+    if (stats->video_frames > 0) {
+        printf("Video: %u frames (%u keyframes), %.2f MiB, %.1f fps, %.2f MiB/s, submit avg %llu us, "
+               "keyframe requests %u\n", stats->video_frames, stats->keyframes,
+               (double) stats->video_bytes / (1024 * 1024), seconds > 0 ? stats->video_frames / seconds : 0,
+               seconds > 0 ? (double) stats->video_bytes / (1024 * 1024) / seconds : 0,
+               (unsigned long long) (stats->video_submit_us / stats->video_frames), stats->keyframe_requests);
+    }
+    if (stats->audio_packets > 0) {
+        printf("Audio: %u packets, %.2f KiB, submit avg %llu us\n", stats->audio_packets,
+               (double) stats->audio_bytes / 1024,
+               (unsigned long long) (stats->audio_submit_us / stats->audio_packets));
+    }
+    if (stats->dropped_records > 0) {
+        printf("Dropped while recording: %u records, %.2f KiB\n", stats->dropped_records,
+               (double) stats->dropped_bytes / 1024);
+    }
+    for (int i = 0; i < STREAM_MEDIA_LATENCY_STAGE_COUNT; i++) {
+        latency_summary_t summary;
+        stream_media_get_video_latency(media, (stream_media_latency_stage_t) i, &summary);
+        if (summary.count == 0) {
+            continue;
+        }
+        printf("Latency %-8s: count=%u, p50=%u us, p95=%u us, p99=%u us, max=%u us, avg=%u us\n",
+               stream_media_latency_stage_name((stream_media_latency_stage_t) i), summary.count, summary.p50_us,
+               summary.p95_us, summary.p99_us, summary.max_us, summary.avg_us);
+    }
+}
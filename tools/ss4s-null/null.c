@@ -0,0 +1,233 @@
+/**
+ * SS4S module that accepts audio and video without decoding them, so the cost of ihsplay itself can be measured on
+ * machines without a hardware decoder. Configured with environment variables:
+ *
+ *     SS4S_NULL_VIDEO_DECODE_US  Simulated decode time per video frame
+ *     SS4S_NULL_VIDEO_QUEUE      Frames the simulated decoder queues before feeding blocks. 0 blocks for every frame
+ *     SS4S_NULL_AUDIO_DELAY_US   Time each audio feed blocks
+ *     SS4S_NULL_TRACE            Write the timestamp, size and duration of every feed call to this file, as CSV
+ */
+#include "ss4s/modapi.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct null_trace_entry_t {
+    uint64_t timestamp_us;
+    uint32_t size;
+    uint32_t duration_us;
+} null_trace_entry_t;
+
+typedef struct null_trace_t {
+    const char *kind;
+    null_trace_entry_t *entries;
+    size_t count, capacity;
+    uint64_t bytes;
+} null_trace_t;
+
+struct SS4S_VideoInstance {
+    uint32_t decode_us;
+    int queue_size;
+    /* When the simulated decoder finishes every frame fed so far */
+    uint64_t busy_until_us;
+    null_trace_t trace;
+};
+
+struct SS4S_AudioInstance {
+    uint32_t delay_us;
+    null_trace_t trace;
+};
+
+static const SS4S_LibraryContext *library_context = NULL;
+
+static SS4S_VideoOpenResult video_open(const SS4S_VideoInfo *info, const SS4S_VideoExtraInfo *extraInfo,
+                                       SS4S_VideoInstance **instance, SS4S_PlayerContext *context);
+
+static SS4S_VideoFeedResult video_feed(SS4S_VideoInstance *instance, const unsigned char *data, size_t size,
+                                       SS4S_VideoFeedFlags flags);
+
+static bool video_size_changed(SS4S_VideoInstance *instance, int width, int height);
+
+static bool video_set_display_area(SS4S_VideoInstance *instance, const SS4S_VideoRect *src,
+                                   const SS4S_VideoRect *dst);
+
+static void video_close(SS4S_VideoInstance *instance);
+
+static SS4S_AudioOpenResult audio_open(const SS4S_AudioInfo *info, SS4S_AudioInstance **instance,
+                                       SS4S_PlayerContext *context);
+
+static SS4S_AudioFeedResult audio_feed(SS4S_AudioInstance *instance, const unsigned char *data, size_t size);
+
+static void audio_close(SS4S_AudioInstance *instance);
+
+static void trace_add(null_trace_t *trace, uint64_t timestamp_us, size_t size, uint64_t end_us);
+
+static void trace_finish(null_trace_t *trace);
+
+static uint64_t now_us();
+
+static void sleep_until_us(uint64_t deadline_us);
+
+static uint32_t env_uint(const char *name, uint32_t def);
+
+static const SS4S_VideoDriver VideoDriver = {
+        .Open = video_open,
+        .Feed = video_feed,
+        .SizeChanged = video_size_changed,
+        .SetDisplayArea = video_set_display_area,
+        .Close = video_close,
+};
+
+static const SS4S_AudioDriver AudioDriver = {
+        .Open = audio_open,
+        .Feed = audio_feed,
+        .Close = audio_close,
+};
+
+SS4S_EXPORTED bool SS4S_ModuleOpen_NULL(SS4S_Module *module, const SS4S_LibraryContext *context) {
+    library_context = context;
+    module->Name = "null";
+    module->VideoDriver = &VideoDriver;
+    module->AudioDriver = &AudioDriver;
+    return true;
+}
+
+static SS4S_VideoOpenResult video_open(const SS4S_VideoInfo *info, const SS4S_VideoExtraInfo *extraInfo,
+                                       SS4S_VideoInstance **instance, SS4S_PlayerContext *context) {
+    SS4S_VideoInstance *video = calloc(1, sizeof(SS4S_VideoInstance));
+    video->decode_us = env_uint("SS4S_NULL_VIDEO_DECODE_US", 0);
+    video->queue_size = (int) env_uint("SS4S_NULL_VIDEO_QUEUE", 0);
+    video->trace.kind = "video";
+    *instance = video;
+    return SS4S_VIDEO_OPEN_OK;
+}
+
+/**
+ * Blocks until the simulated decoder has room for the frame, like a decoder with a full input queue would.
+ */
+static SS4S_VideoFeedResult video_feed(SS4S_VideoInstance *instance, const unsigned char *data, size_t size,
+                                       SS4S_VideoFeedFlags flags) {
+    uint64_t begin = now_us();
+    if (instance->decode_us > 0) {
+        uint64_t start = instance->busy_until_us > begin ? instance->busy_until_us : begin;
+        instance->busy_until_us = start + instance->decode_us;
+        // Frames still waiting for the decoder after this one is added
+        uint64_t queued_us = (uint64_t) instance->queue_size * instance->decode_us;
+        if (instance->busy_until_us > begin + queued_us) {
+            sleep_until_us(instance->busy_until_us - queued_us);
+        }
+    }
+    trace_add(&instance->trace, begin, size, now_us());
+    return SS4S_VIDEO_FEED_OK;
+}
+
+static bool video_size_changed(SS4S_VideoInstance *instance, int width, int height) {
+    return true;
+}
+
+static bool video_set_display_area(SS4S_VideoInstance *instance, const SS4S_VideoRect *src,
+                                   const SS4S_VideoRect *dst) {
+    return true;
+}
+
+static void video_close(SS4S_VideoInstance *instance) {
+    trace_finish(&instance->trace);
+    free(instance);
+}
+
+static SS4S_AudioOpenResult audio_open(const SS4S_AudioInfo *info, SS4S_AudioInstance **instance,
+                                       SS4S_PlayerContext *context) {
+    SS4S_AudioInstance *audio = calloc(1, sizeof(SS4S_AudioInstance));
+    audio->delay_us = env_uint("SS4S_NULL_AUDIO_DELAY_US", 0);
+    audio->trace.kind = "audio";
+    *instance = audio;
+    return SS4S_AUDIO_OPEN_OK;
+}
+
+static SS4S_AudioFeedResult audio_feed(SS4S_AudioInstance *instance, const unsigned char *data, size_t size) {
+    uint64_t begin = now_us();
+    if (instance->delay_us > 0) {
+        sleep_until_us(begin + instance->delay_us);
+    }
+    trace_add(&instance->trace, begin, size, now_us());
+    return SS4S_AUDIO_FEED_OK;
+}
+
+static void audio_close(SS4S_AudioInstance *instance) {
+    trace_finish(&instance->trace);
+    free(instance);
+}
+
+static void trace_add(null_trace_t *trace, uint64_t timestamp_us, size_t size, uint64_t end_us) {
+    trace->bytes += size;
+    if (trace->count == trace->capacity) {
+        size_t capacity = trace->capacity > 0 ? trace->capacity * 2 : 4096;
+        null_trace_entry_t *entries = realloc(trace->entries, capacity * sizeof(null_trace_entry_t));
+        if (entries == NULL) {
+            return;
+        }
+        trace->entries = entries;
+        trace->capacity = capacity;
+    }
+    null_trace_entry_t *entry = &trace->entries[trace->count++];
+    entry->timestamp_us = timestamp_us;
+    entry->size = (uint32_t) size;
+    entry->duration_us = (uint32_t) (end_us - timestamp_us);
+}
+
+/**
+ * Log a summary of the calls, and append them to the trace file if configured.
+ */
+static void trace_finish(null_trace_t *trace) {
+    uint64_t total_us = 0;
+    for (size_t i = 0; i < trace->count; i++) {
+        total_us += trace->entries[i].duration_us;
+    }
+    if (trace->count > 0) {
+        uint64_t span_us = trace->entries[trace->count - 1].timestamp_us - trace->entries[0].timestamp_us;
+        library_context->Log(SS4S_LogLevelInfo, "Null",
+                             "%s: calls=%zu, bytes=%llu, span=%llu us, blocked avg=%llu us", trace->kind,
+                             trace->count, (unsigned long long) trace->bytes, (unsigned long long) span_us,
+                             (unsigned long long) (total_us / trace->count));
+    }
+    const char *path = getenv("SS4S_NULL_TRACE");
+    FILE *file = path != NULL && trace->count > 0 ? fopen(path, "a") : NULL;
+    if (file != NULL) {
+        for (size_t i = 0; i < trace->count; i++) {
+            const null_trace_entry_t *entry = &trace->entries[i];
+            fprintf(file, "%s,%llu,%u,%u\n", trace->kind, (unsigned long long) entry->timestamp_us, entry->size,
+                    entry->duration_us);
+        }
+        fclose(file);
+    }
+    free(trace->entries);
+    memset(trace, 0, sizeof(null_trace_t));
+}
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until_us(uint64_t deadline_us) {
+    struct timespec ts = {
+            .tv_sec = (time_t) (deadline_us / 1000000),
+            .tv_nsec = (long) (deadline_us % 1000000) * 1000,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static uint32_t env_uint(const char *name, uint32_t def) {
+    const char *v = getenv(name);
+    if (v == NULL) {
+        return def;
+    }
+    char *end = NULL;
+    unsigned long value = strtoul(v, &end, 10);
+    return end != v && value <= UINT32_MAX ? (uint32_t) value : def;
+}